@@ -0,0 +1,101 @@
+#include "batch.h"
+#include "eval.h"
+#include "nnue.h"
+#include "search.h"
+#include "tt.h"
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+// per worker state, set up before the tasks are submitted so a task never allocates
+struct alignas(64) BatchWorker {
+    std::unique_ptr<TranspositionTable> table;
+    std::unique_ptr<Search> search;
+    std::unique_ptr<NnueEvaluator> nnue;
+    Board board;
+    double busy_seconds = 0;
+};
+
+struct BatchJob {
+    const Position *positions;
+    const BatchOptions *options;
+    BatchResults *results;
+    std::vector<BatchWorker> workers;
+};
+
+static void batch_task(BatchJob &job, size_t begin, size_t end, int worker) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    BatchWorker &state = job.workers[worker];
+    const BatchResults &results = *job.results;
+    PackedMove moves[MAX_MOVES];
+    SearchLimits limits;
+    SearchResult result;
+    int eval;
+    size_t i;
+
+    limits.depth = job.options->search_depth;
+    for (i = begin; i < end; i++) {
+        const Position &position = job.positions[i];
+        if (results.legal_moves) {
+            results.legal_moves[i] = (uint8_t) generate_legal_moves(position, moves);
+        }
+        if (results.in_check) {
+            results.in_check[i] = position.in_check();
+        }
+        if (results.static_eval) {
+            if (state.nnue) {
+                state.nnue->reset(position);
+                eval = state.nnue->evaluate(position);
+            } else {
+                eval = evaluate(position);
+            }
+            results.static_eval[i] = (int16_t) std::min(std::max(eval, -MATE_BOUND + 1), MATE_BOUND - 1);
+        }
+        if (state.search) {
+            state.board.set_position(position);
+            state.table->clear();
+            state.search->clear();
+            result = state.search->run(state.board, limits);
+            if (results.score) {
+                results.score[i] = (int16_t) result.score;
+            }
+            if (results.best_move) {
+                results.best_move[i] = result.best_move;
+            }
+        }
+    }
+    state.busy_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+BatchStats analyse_batch(const Position *positions, size_t count, const BatchOptions &options, BatchResults &results,
+                         ThreadPool &pool) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    BatchJob job {positions, &options, &results, std::vector<BatchWorker>(pool.size())};
+    BatchStats stats = {count, 0, pool.size(), 0};
+    const Network *network = options.network && options.network->is_loaded() ? options.network : nullptr;
+    bool searching = options.search_depth > 0 && (results.score || results.best_move);
+    size_t chunk = std::max<size_t>(options.chunk_size, 1), begin;
+
+    for (BatchWorker &worker : job.workers) {
+        if (network && results.static_eval) {
+            worker.nnue.reset(new NnueEvaluator(*network));
+        }
+        if (searching) {
+            worker.table.reset(new TranspositionTable(std::max<size_t>(options.hash_megabytes, 1)));
+            worker.search.reset(new Search(*worker.table));
+            worker.search->set_network(network);
+        }
+    }
+
+    for (begin = 0; begin < count; begin += chunk) {
+        pool.submit([&job, begin, end = std::min(begin + chunk, count)](int worker) { batch_task(job, begin, end, worker); });
+    }
+    pool.wait();
+
+    for (const BatchWorker &worker : job.workers) {
+        stats.busy_seconds += worker.busy_seconds;
+    }
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "chess.h"
+#include "thread_pool.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#ifndef CPP_CHESS_BATCH_H
+#define CPP_CHESS_BATCH_H
+
+class Network;
+
+// what to compute for every position of a batch
+struct BatchOptions {
+    // depth of the search run on every position, 0 skips the search
+    int search_depth = 0;
+    // table size of each worker's search. the table is cleared before every position so results don't depend on
+    // which worker got which position
+    size_t hash_megabytes = 1;
+    // static evaluation (and search) with this network instead of the hand written evaluation
+    const Network *network = nullptr;
+    // positions per task, big enough to amortise the task overhead and small enough to balance the load
+    size_t chunk_size = 512;
+};
+
+// one array per result, each indexed like the positions and owned by the caller. a null array isn't filled,
+// the search only runs when score or best_move asks for it. scores are from the side to move's point of view
+struct BatchResults {
+    uint8_t *legal_moves = nullptr;
+    uint8_t *in_check = nullptr;
+    int16_t *static_eval = nullptr;
+    int16_t *score = nullptr;
+    PackedMove *best_move = nullptr;
+};
+
+struct BatchStats {
+    size_t positions;
+    double seconds;
+    int threads;
+    // summed over the workers, busy_seconds / threads close to seconds means the pool was kept busy
+    double busy_seconds;
+};
+
+// analyses count positions on the pool, chunk by chunk. every worker has its own Board (and search and network
+// accumulator when they're wanted), nothing is shared but the read-only input and network
+BatchStats analyse_batch(const Position *positions, size_t count, const BatchOptions &options, BatchResults &results,
+                         ThreadPool &pool);
+
+#endif //CPP_CHESS_BATCH_H
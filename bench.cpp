@@ -0,0 +1,1037 @@
+//
+// Benchmarks for the board internals, run with the names of the benchmarks to run (or nothing to run all of them).
+//
+// usage: bench [NAME...] [--json FILE] [--csv FILE] [--compare BASELINE] [--threshold PERCENT] [--repetitions N]
+//
+// every ns/op line also goes to the JSON and CSV files, in the order the benchmarks ran. --compare reads a JSON file
+// written earlier and exits with status 1 when a benchmark got slower by more than the threshold (10% by default)
+// or allocates more than it did, so a baseline saved before a change can gate it:
+//     bench micro --json baseline.json
+//     bench micro --compare baseline.json
+// (the bench_baseline and bench_compare targets do exactly that in the build directory)
+//
+
+#include "batch.h"
+#include "chess.h"
+#include "fen.h"
+#include "game_file.h"
+#include "mapped_file.h"
+#include "pgn.h"
+#include "profile.h"
+#include "search.h"
+#include "tablebase.h"
+#include "eval.h"
+#include "nnue.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <new>
+#include <thread>
+
+// every heap allocation made by the process is counted, so a benchmark can report allocations per operation.
+// the profiling build counts them itself (per thread, the benchmarks measure on the main one)
+#ifdef CPP_CHESS_PROFILE
+static unsigned long long allocation_count() {
+    return profile_thread_count(PROFILE_ALLOCATIONS);
+}
+#else
+static unsigned long long allocations = 0;
+
+void *operator new(size_t size) {
+    allocations++;
+    void *ptr = malloc(size ? size : 1);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    free(ptr);
+}
+
+static unsigned long long allocation_count() {
+    return allocations;
+}
+#endif
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// what report() printed, kept for the machine readable output
+struct BenchResult {
+    std::string name;
+    double ns_per_op;
+    double allocs_per_op;
+    unsigned long long operations;
+};
+
+static std::vector<BenchResult> results;
+
+static void report(const char *name, double seconds, unsigned long long operations, unsigned long long allocs) {
+    results.push_back({name, seconds * 1e9 / operations, (double) allocs / operations, operations});
+    std::cout << name << ": " << seconds * 1e9 / operations << " ns/op, "
+              << (double) allocs / operations << " allocs/op, " << operations << " ops" << std::endl;
+}
+
+// keeps the compiler from dropping work whose result is never used: the value has to be in memory, and the asm
+// may have read any of it
+template <typename T>
+inline void keep(const T &value) {
+    asm volatile("" : : "r"(&value) : "memory");
+}
+
+// how long one batch of a microbenchmark should run, and how many batches are timed
+static const double MICRO_BATCH_SECONDS = 0.02;
+static int micro_repetitions = 5;
+
+// times one call of body, which has to leave its state as it found it. the batch size doubles until a batch takes
+// MICRO_BATCH_SECONDS, then the fastest of micro_repetitions batches is reported, steadier than a mean on a
+// machine that is doing other things
+template <typename Body>
+static void measure(const char *name, Body body) {
+    std::chrono::steady_clock::time_point start;
+    unsigned long long iterations = 1, allocs, i;
+    double seconds, best = 0;
+    int repetition;
+
+    while (true) {
+        start = std::chrono::steady_clock::now();
+        for (i = 0; i < iterations; i++) {
+            body();
+        }
+        if (seconds_since(start) >= MICRO_BATCH_SECONDS || iterations >= (1ULL << 32)) {
+            break;
+        }
+        iterations *= 2;
+    }
+
+    allocs = allocation_count();
+    for (repetition = 0; repetition < micro_repetitions; repetition++) {
+        start = std::chrono::steady_clock::now();
+        for (i = 0; i < iterations; i++) {
+            body();
+        }
+        seconds = seconds_since(start);
+        best = repetition ? std::min(best, seconds) : seconds;
+    }
+    report(name, best, iterations, (allocation_count() - allocs) / micro_repetitions);
+}
+
+// a short opening line covering captures, castling and double pawn pushes
+static const char *LINE[] = {"e2e4", "e7e5", "g1f3", "b8c6", "f1c4", "g8f6", "e1g1", "f6e4", "d2d4", "e5d4",
+                             "f1e1", "d7d5", "c4d5", "d8d5", "b1c3", "d5c4", "c3e4", "c8e6", "e4g5", "e8c8"};
+static const int LINE_LENGTH = sizeof(LINE) / sizeof(LINE[0]);
+static const int REPETITIONS = 200000;
+
+// single operations on the board, each push/pop on a position where that kind of move is on
+static void bench_micro() {
+    Board board = Board(), copy = Board();
+    PackedMove move = NULL_MOVE;
+    char uci[6];
+    const struct {
+        const char *name;
+        const char *fen;
+        const char *move;
+    } moves[] = {
+            {"push_pop_quiet", "r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3", "f1c4"},
+            {"push_pop_capture", "rnbqkbnr/ppp1pppp/8/3p4/4P3/8/PPPP1PPP/RNBQKBNR w KQkq d6 0 2", "e4d5"},
+            {"push_pop_castle", "r1bqk2r/pppp1ppp/2n2n2/2b1p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4", "e1g1"},
+            {"push_pop_ep", "rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3", "e5f6"},
+            {"push_pop_promotion", "3qk3/1P6/8/8/8/8/8/4K3 w - - 0 1", "b7b8q"},
+    };
+
+    measure("reset", [&] {
+        board.reset();
+        keep(board);
+    });
+    for (const auto &entry : moves) {
+        board.set_fen(entry.fen);
+        move = board.parse_uci(entry.move);
+        measure(entry.name, [&] {
+            board.push(move);
+            board.pop();
+            keep(board);
+        });
+    }
+
+    board.set_fen(moves[2].fen);
+    measure("mirror", [&] {
+        board.mirror();
+        keep(board);
+    });
+    measure("switch_colors", [&] {
+        board.switch_colors();
+        keep(board);
+    });
+    // mirror and switch_colors ran an unknown number of times
+    board.set_fen(moves[2].fen);
+    measure("uci_parse", [&] {
+        move = board.parse_uci("e1g1");
+        keep(move);
+    });
+    measure("uci_format", [&] {
+        format_uci(move, uci);
+        keep(uci);
+    });
+    measure("micro_board_copy", [&] {
+        copy = board;
+        keep(copy);
+    });
+}
+
+static void bench_push_pop() {
+    Board board = Board();
+    std::array<PackedMove, LINE_LENGTH> moves;
+    std::chrono::steady_clock::time_point start;
+    unsigned long long allocs;
+    int i, j;
+
+    for (i = 0; i < LINE_LENGTH; i++) {
+        std::unique_ptr<Move> move = move_from_uci(std::unique_ptr<std::string>(new std::string(LINE[i])));
+        moves[i] = board.pack_move(*move);
+        board.push(moves[i]);
+    }
+    board.reset();
+
+    allocs = allocation_count();
+    start = std::chrono::steady_clock::now();
+    for (i = 0; i < REPETITIONS; i++) {
+        for (j = 0; j < LINE_LENGTH; j++) {
+            board.push(moves[j]);
+        }
+        for (j = 0; j < LINE_LENGTH; j++) {
+            board.pop();
+        }
+    }
+    report("push_pop", seconds_since(start), (unsigned long long) REPETITIONS * LINE_LENGTH, allocation_count() - allocs);
+
+    // the old interface, every push hands over a heap allocated Move
+    allocs = allocation_count();
+    start = std::chrono::steady_clock::now();
+    for (i = 0; i < REPETITIONS / 10; i++) {
+        for (j = 0; j < LINE_LENGTH; j++) {
+            board.push(std::unique_ptr<Move>(new Move({square_row(moves[j].from()), square_col(moves[j].from())},
+                                                      {square_row(moves[j].to()), square_col(moves[j].to())}, false)));
+        }
+        for (j = 0; j < LINE_LENGTH; j++) {
+            board.pop();
+        }
+    }
+    report("push_pop_legacy", seconds_since(start), (unsigned long long) REPETITIONS / 10 * LINE_LENGTH, allocation_count() - allocs);
+}
+
+// snapshotting a board for another thread: copy-make against push/pop, a fork against a full copy
+static void bench_copy() {
+    Board board = Board(), copy = Board();
+    std::array<PackedMove, LINE_LENGTH> moves;
+    std::chrono::steady_clock::time_point start;
+    Position position;
+    unsigned long long allocs;
+    uint64_t sink = 0;
+    int i, j;
+
+    for (i = 0; i < LINE_LENGTH; i++) {
+        moves[i] = board.parse_uci(LINE[i]);
+        board.push(moves[i]);
+    }
+
+    allocs = allocation_count();
+    start = std::chrono::steady_clock::now();
+    for (i = 0; i < REPETITIONS; i++) {
+        position.set_startpos();
+        for (j = 0; j < LINE_LENGTH; j++) {
+            position = position.after(moves[j]);
+        }
+        sink += position.key;
+    }
+    report("copy_make", seconds_since(start), (unsigned long long) REPETITIONS * LINE_LENGTH, allocation_count() - allocs);
+
+    allocs = allocation_count();
+    start = std::chrono::steady_clock::now();
+    for (i = 0; i < REPETITIONS; i++) {
+        board.fork(copy);
+        sink += copy.key();
+    }
+    report("fork", seconds_since(start), REPETITIONS, allocation_count() - allocs);
+
+    allocs = allocation_count();
+    start = std::chrono::steady_clock::now();
+    for (i = 0; i < REPETITIONS; i++) {
+        copy = board;
+        sink += copy.key();
+    }
+    report("board_copy", seconds_since(start), REPETITIONS, allocation_count() - allocs);
+
+    // the old way of getting a copy to look at, 64 heap allocated pieces
+    allocs = allocation_count();
+    start = std::chrono::steady_clock::now();
+    for (i = 0; i < REPETITIONS / 10; i++) {
+        sink += (*board.get_state())[0][0]->get_type();
+    }
+    report("get_state", seconds_since(start), REPETITIONS / 10, allocation_count() - allocs);
+    if (sink == 0) {
+        std::cout << "unreachable" << std::endl;
+    }
+}
+
+static const int FEN_POSITIONS = 50000;
+
+// positions from random playouts (seeded, so every run measures the same text), one FEN per line
+static std::string random_fens(int count) {
+    Board board = Board();
+    MoveList list;
+    std::string text;
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        board.legal_moves(list);
+        if (list.size == 0 || board.get_ply() >= 120) {
+            board.reset();
+            board.legal_moves(list);
+        }
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        board.push(list.moves[seed % list.size]);
+        text += board.get_fen();
+        text.push_back('\n');
+    }
+    return text;
+}
+
+static void bench_fen() {
+    std::string text = random_fens(FEN_POSITIONS), path = "/tmp/cpp_chess_bench.epd";
+    std::vector<Position> positions;
+    std::vector<int> fullmoves;
+    std::chrono::steady_clock::time_point start;
+    std::string_view rest, line, operations;
+    Position position;
+    FenResult result;
+    MappedFile file;
+    char buffer[FEN_BUFFER_SIZE];
+    unsigned long long allocs, parsed = 0, written = 0;
+    size_t end;
+    int spaces;
+
+    allocs = allocation_count();
+    start = std::chrono::steady_clock::now();
+    for (rest = text; !rest.empty(); rest.remove_prefix(end + 1)) {
+        end = rest.find('\n');
+        line = rest.substr(0, end);
+        result = parse_fen(line, position);
+        parsed += result.ok;
+    }
+    report("fen_parse", seconds_since(start), parsed, allocation_count() - allocs);
+
+    for (rest = text; !rest.empty(); rest.remove_prefix(end + 1)) {
+        end = rest.find('\n');
+        positions.push_back(position);
+        fullmoves.push_back(parse_fen(rest.substr(0, end), positions.back()).fullmove_number);
+    }
+    allocs = allocation_count();
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < positions.size(); i++) {
+        written += write_fen(positions[i], fullmoves[i], buffer, sizeof(buffer)) > 0;
+    }
+    report("fen_write", seconds_since(start), written, allocation_count() - allocs);
+
+    // the same positions as an EPD file, read through a memory mapping
+    {
+        std::ofstream out(path, std::ios::binary);
+        for (size_t i = 0; i < positions.size(); i++) {
+            // EPD has no move counter fields, they travel as operations instead
+            write_fen(positions[i], fullmoves[i], buffer, sizeof(buffer));
+            for (end = 0, spaces = 0; spaces < 4; end++) {
+                spaces += buffer[end] == ' ';
+            }
+            out << "# position " << i << "\n" << std::string_view(buffer, end) << "hmvc "
+                << (int) positions[i].halfmove_clock << "; fmvn " << fullmoves[i] << ";\n";
+        }
+    }
+    if (!file.open(path)) {
+        std::cout << "epd_mapped: can't map " << path << std::endl;
+        return;
+    }
+    parsed = 0;
+    allocs = allocation_count();
+    start = std::chrono::steady_clock::now();
+    EpdReader reader(file.view());
+    while (reader.next(position, operations, result)) {
+        parsed += result.ok && result.fullmove_number == fullmoves[parsed];
+    }
+    report("epd_mapped", seconds_since(start), parsed, allocation_count() - allocs);
+    file.close();
+    remove(path.c_str());
+}
+
+static void bench_uci() {
+    Board board = Board();
+    std::array<char[6], LINE_LENGTH> tokens;
+    std::chrono::steady_clock::time_point start;
+    unsigned long long allocs, sink = 0;
+    char uci[6];
+    int i, j;
+
+    for (j = 0; j < LINE_LENGTH; j++) {
+        strcpy(tokens[j], LINE[j]);
+    }
+
+    // parse every token against the position it is played in, then format it back
+    allocs = allocation_count();
+    start = std::chrono::steady_clock::now();
+    for (i = 0; i < REPETITIONS / 10; i++) {
+        for (j = 0; j < LINE_LENGTH; j++) {
+            PackedMove move = board.parse_uci(tokens[j]);
+            format_uci(move, uci);
+            sink += uci[0];
+            board.push(move);
+        }
+        for (j = 0; j < LINE_LENGTH; j++) {
+            board.pop();
+        }
+    }
+    report("uci", seconds_since(start), (unsigned long long) REPETITIONS / 10 * LINE_LENGTH, allocation_count() - allocs);
+
+    // the same through move_from_uci, pack_move and get_uci
+    allocs = allocation_count();
+    start = std::chrono::steady_clock::now();
+    for (i = 0; i < REPETITIONS / 10; i++) {
+        for (j = 0; j < LINE_LENGTH; j++) {
+            std::unique_ptr<Move> move = move_from_uci(std::unique_ptr<std::string>(new std::string(tokens[j])));
+            PackedMove packed = board.pack_move(*move);
+            sink += (*move->get_uci())[0];
+            board.push(packed);
+        }
+        for (j = 0; j < LINE_LENGTH; j++) {
+            board.pop();
+        }
+    }
+    report("uci_legacy", seconds_since(start), (unsigned long long) REPETITIONS / 10 * LINE_LENGTH, allocation_count() - allocs);
+    if (sink == 0) {
+        std::cout << "unreachable" << std::endl;
+    }
+}
+
+// the incremental evaluation against a recomputation from the bitboards, over the positions of the opening line
+static void bench_eval() {
+    Board board = Board();
+    std::array<Position, LINE_LENGTH> positions;
+    std::chrono::steady_clock::time_point start;
+    long long sink = 0;
+    int i, j;
+
+    for (i = 0; i < LINE_LENGTH; i++) {
+        board.push_uci(LINE[i]);
+        positions[i] = board.get_position();
+    }
+
+    start = std::chrono::steady_clock::now();
+    for (i = 0; i < REPETITIONS; i++) {
+        for (j = 0; j < LINE_LENGTH; j++) {
+            sink += evaluate(positions[j]);
+        }
+    }
+    report("eval", seconds_since(start), (unsigned long long) REPETITIONS * LINE_LENGTH, 0);
+
+    start = std::chrono::steady_clock::now();
+    for (i = 0; i < REPETITIONS; i++) {
+        for (j = 0; j < LINE_LENGTH; j++) {
+            sink += evaluate_from_scratch(positions[j]);
+        }
+    }
+    report("eval_from_scratch", seconds_since(start), (unsigned long long) REPETITIONS * LINE_LENGTH, 0);
+    if (sink == 1) {
+        std::cout << "unreachable" << std::endl;
+    }
+}
+
+// a generated network saved and mapped back in. for every kernel the CPU runs: full evaluations after a refresh
+// of the accumulator, and evaluations along the opening line with the accumulator updated move by move
+static void bench_nnue() {
+    std::string path = "/tmp/cpp_chess_bench.nnue";
+    Network generated, network;
+    Board board = Board();
+    std::array<Position, LINE_LENGTH> positions;
+    std::array<PackedMove, LINE_LENGTH> moves;
+    std::chrono::steady_clock::time_point start;
+    NNUE_KERNEL kernel, best = nnue_best_kernel();
+    std::string name;
+    long long sink = 0;
+    int i, j;
+
+    generated.randomize(1);
+    if (!generated.save(path) || !network.load(path)) {
+        std::cout << "nnue: can't write and map " << path << std::endl;
+        return;
+    }
+    NnueEvaluator evaluator(network);
+    for (i = 0; i < LINE_LENGTH; i++) {
+        moves[i] = board.parse_uci(LINE[i]);
+        board.push(moves[i]);
+        positions[i] = board.get_position();
+    }
+
+    for (kernel = NNUE_SCALAR; kernel <= NNUE_AVX2; kernel = static_cast<NNUE_KERNEL>(kernel + 1)) {
+        if (!nnue_set_kernel(kernel)) {
+            continue;
+        }
+        name = std::string("nnue_refresh_") + nnue_kernel_name(kernel);
+        start = std::chrono::steady_clock::now();
+        for (i = 0; i < REPETITIONS / 10; i++) {
+            for (j = 0; j < LINE_LENGTH; j++) {
+                evaluator.reset(positions[j]);
+                sink += evaluator.evaluate(positions[j]);
+            }
+        }
+        report(name.c_str(), seconds_since(start), (unsigned long long) REPETITIONS / 10 * LINE_LENGTH, 0);
+
+        name = std::string("nnue_incremental_") + nnue_kernel_name(kernel);
+        board.reset();
+        start = std::chrono::steady_clock::now();
+        for (i = 0; i < REPETITIONS / 10; i++) {
+            evaluator.reset(board.get_position());
+            for (j = 0; j < LINE_LENGTH; j++) {
+                board.push(moves[j]);
+                evaluator.push(board);
+                sink += evaluator.evaluate(board.get_position());
+            }
+            for (j = 0; j < LINE_LENGTH; j++) {
+                board.pop();
+                evaluator.pop();
+            }
+        }
+        report(name.c_str(), seconds_since(start), (unsigned long long) REPETITIONS / 10 * LINE_LENGTH, 0);
+    }
+    nnue_set_kernel(best);
+    remove(path.c_str());
+    if (sink == 1) {
+        std::cout << "unreachable" << std::endl;
+    }
+}
+
+static const int GAME_COUNT = 5000;
+
+// random games stored as UCI move lists and as a game file: sizes, conversion, and replaying every move of every
+// game from each (the text through parse_uci, the binary through GameDecoder)
+static void bench_games() {
+    std::string text_path = "/tmp/cpp_chess_bench.uci", game_path = "/tmp/cpp_chess_bench.games";
+    std::chrono::steady_clock::time_point start;
+    std::string_view rest, line, word;
+    Board board = Board();
+    MoveList list;
+    MappedFile text;
+    GameWriter writer;
+    GameReader reader;
+    GameDecoder decoder;
+    GameRecord record;
+    ConvertResult converted;
+    PackedMove move;
+    uint64_t seed = 0x9E3779B97F4A7C15ULL, plies = 0, replayed = 0;
+    unsigned long long allocs;
+    size_t end;
+    char uci[6];
+    int game, ply;
+
+    {
+        std::ofstream out(text_path, std::ios::binary);
+        for (game = 0; game < GAME_COUNT; game++) {
+            board.reset();
+            out << "startpos moves";
+            for (ply = 0; ply < 160; ply++) {
+                board.legal_moves(list);
+                if (list.size == 0) {
+                    break;
+                }
+                seed ^= seed << 13;
+                seed ^= seed >> 7;
+                seed ^= seed << 17;
+                board.push(list.moves[seed % list.size]);
+                format_uci(board.last_move(), uci);
+                out << ' ' << uci;
+                plies++;
+            }
+            out << " *\n";
+        }
+    }
+    text.open(text_path);
+
+    allocs = allocation_count();
+    start = std::chrono::steady_clock::now();
+    writer.open(game_path);
+    converted = convert_uci_games(text.view(), writer);
+    writer.finish();
+    report("games_convert", seconds_since(start), plies, allocation_count() - allocs);
+    if (!converted.ok || !reader.open(game_path)) {
+        std::cout << "games: conversion failed" << std::endl;
+        return;
+    }
+    std::cout << "games: " << GAME_COUNT << " games, " << plies << " plies, text " << text.size() << " bytes, binary "
+              << std::ifstream(game_path, std::ios::binary | std::ios::ate).tellg() << " bytes" << std::endl;
+
+    start = std::chrono::steady_clock::now();
+    for (rest = text.view(); !rest.empty(); rest.remove_prefix(end + 1)) {
+        end = rest.find('\n');
+        line = rest.substr(0, end);
+        board.reset();
+        for (line.remove_prefix(15); !line.empty() && line[0] != '*'; line.remove_prefix(std::min(word.size() + 1, line.size()))) {
+            word = line.substr(0, line.find(' '));
+            board.push(board.parse_uci(word));
+            replayed++;
+        }
+    }
+    report("games_replay_uci", seconds_since(start), replayed, 0);
+
+    replayed = 0;
+    start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < reader.game_count(); i++) {
+        reader.game(i, record);
+        decoder.start(record, board);
+        while (decoder.next(board, move)) {
+            replayed++;
+        }
+    }
+    report("games_replay_binary", seconds_since(start), replayed, 0);
+    reader.close();
+    text.close();
+    remove(text_path.c_str());
+    remove(game_path.c_str());
+}
+
+static const int PGN_GAMES = 20000;
+
+// a PGN file read and replayed on one thread, then on the pool. set CPP_CHESS_PGN to measure a real archive,
+// otherwise random games are written out as a sample
+static void bench_pgn() {
+    const char *sample = getenv("CPP_CHESS_PGN");
+    std::string path = sample ? sample : "/tmp/cpp_chess_bench.pgn";
+    std::chrono::steady_clock::time_point start;
+    Board board = Board();
+    MoveList list;
+    PgnReader reader;
+    PgnGame game;
+    PgnReplay replay;
+    PgnStats stats;
+    ThreadPool pool;
+    uint64_t seed = 0x9E3779B97F4A7C15ULL, games = 0, positions = 0;
+    double seconds;
+    char san[SAN_BUFFER_SIZE];
+    int i, ply;
+
+    if (!sample) {
+        std::ofstream out(path, std::ios::binary);
+        for (i = 0; i < PGN_GAMES; i++) {
+            board.reset();
+            out << "[Event \"random\"]\n[Round \"" << i << "\"]\n[Result \"*\"]\n\n";
+            for (ply = 0; ply < 160; ply++) {
+                board.legal_moves(list);
+                if (list.size == 0) {
+                    break;
+                }
+                seed ^= seed << 13;
+                seed ^= seed >> 7;
+                seed ^= seed << 17;
+                format_san(board, list.moves[seed % list.size], san);
+                board.push(list.moves[seed % list.size]);
+                out << (ply % 2 ? "" : std::to_string(ply / 2 + 1) + ". ") << san << (ply % 12 == 11 ? "\n" : " ");
+            }
+            out << "*\n\n";
+        }
+    }
+
+    start = std::chrono::steady_clock::now();
+    if (!reader.open(path)) {
+        std::cout << "pgn: can't read " << path << std::endl;
+        return;
+    }
+    while (reader.next(game)) {
+        replay = replay_pgn_game(game, board, games++, 0, nullptr);
+        positions += replay.plies + replay.started;
+    }
+    seconds = seconds_since(start);
+    std::cout << "pgn_replay: " << (uint64_t) (games / std::max(seconds, 1e-9)) << " games/s, "
+              << (uint64_t) (positions / std::max(seconds, 1e-9)) << " positions/s, " << games << " games" << std::endl;
+
+    stats = replay_pgn_parallel(path, pool, nullptr);
+    std::cout << "pgn_parallel: " << (uint64_t) (stats.games / std::max(stats.seconds, 1e-9)) << " games/s, "
+              << (uint64_t) (stats.positions / std::max(stats.seconds, 1e-9)) << " positions/s, " << pool.size()
+              << " threads, " << stats.failed_games << " failed" << std::endl;
+    if (!sample) {
+        remove(path.c_str());
+    }
+}
+
+// the random playout positions analysed in bulk: legal move counts and static evaluation, then with a depth 2
+// search on top. throughput is given per worker thread
+static void bench_batch() {
+    std::string text = random_fens(FEN_POSITIONS);
+    std::vector<Position> positions;
+    std::string_view rest;
+    Position position;
+    ThreadPool pool;
+    BatchOptions options;
+    BatchResults results;
+    BatchStats stats;
+    size_t end;
+
+    for (rest = text; !rest.empty(); rest.remove_prefix(end + 1)) {
+        end = rest.find('\n');
+        if (parse_fen(rest.substr(0, end), position).ok) {
+            positions.push_back(position);
+        }
+    }
+    std::vector<uint8_t> legal(positions.size());
+    std::vector<int16_t> evals(positions.size()), scores(positions.size());
+    std::vector<PackedMove> moves(positions.size());
+    results.legal_moves = legal.data();
+    results.static_eval = evals.data();
+
+    stats = analyse_batch(positions.data(), positions.size(), options, results, pool);
+    std::cout << "batch_static: " << (uint64_t) (stats.positions / std::max(stats.seconds, 1e-9) / stats.threads)
+              << " positions/s per core, " << stats.threads << " threads" << std::endl;
+
+    options.search_depth = 2;
+    results.score = scores.data();
+    results.best_move = moves.data();
+    stats = analyse_batch(positions.data(), positions.size() / 10, options, results, pool);
+    std::cout << "batch_search: " << (uint64_t) (stats.positions / std::max(stats.seconds, 1e-9) / stats.threads)
+              << " positions/s per core at depth " << options.search_depth << ", " << stats.threads << " threads" << std::endl;
+}
+
+// fixed positions searched to a fixed depth, so time-to-depth and nps can be compared from one release to the next
+static const char *SEARCH_POSITIONS[] = {
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+        "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+        "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+        "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+        "r1bq1rk1/pp2bppp/2n1pn2/3p4/2PP4/2N1PN2/PP2BPPP/R1BQK2R w KQ - 0 8",
+        "6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1",
+};
+static const int SEARCH_DEPTH = 9;
+
+static const int TB_PROBES = 200000;
+
+// generates a three and a four piece set, then probes random KRvKN positions through a warm cache and through a
+// cache of one block, where nearly every probe decompresses a block
+static void bench_tablebase() {
+    std::string directory = "/tmp/cpp_chess_bench_tb";
+    std::chrono::steady_clock::time_point start;
+    std::vector<Position> positions;
+    Tablebases tables, cold(1);
+    TbGenerateStats stats;
+    TbCacheStats cache;
+    TbProbe probe;
+    Position position;
+    uint64_t seed = 0x9E3779B97F4A7C15ULL, sink = 0;
+    unsigned long long allocs;
+    int squares[4], i;
+
+    for (const char *signature : {"KPvK", "KRvKN"}) {
+        if (!generate_tablebases(signature, directory, &stats)) {
+            std::cout << "tablebase: can't write " << directory << std::endl;
+            return;
+        }
+        std::cout << "tb_generate " << signature << ": " << stats.seconds << " s, " << stats.tables << " tables, "
+                  << (uint64_t) (stats.positions / std::max(stats.seconds, 1e-9)) << " entries/s, " << stats.bytes_written
+                  << " bytes, " << (double) stats.positions / stats.bytes_written << "x compressed" << std::endl;
+    }
+    tables.open(directory);
+    cold.open(directory);
+
+    while ((int) positions.size() < TB_PROBES) {
+        for (i = 0; i < 4; i++) {
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+            squares[i] = (int) (seed % 64);
+        }
+        if (squares[0] == squares[1] || squares[0] == squares[2] || squares[0] == squares[3] || squares[1] == squares[2] ||
+            squares[1] == squares[3] || squares[2] == squares[3]) {
+            continue;
+        }
+        position.clear();
+        position.put_piece(WHITE, KING, squares[0]);
+        position.put_piece(BLACK, KING, squares[1]);
+        position.put_piece(WHITE, ROOK, squares[2]);
+        position.put_piece(BLACK, KNIGHT, squares[3]);
+        position.side_to_move = (uint8_t) (seed >> 63);
+        // the side that just moved can't be left in check
+        if (position.attackers_to(position.king_square(static_cast<COLOR>(position.side_to_move ^ 1)), position.occupied()) &
+            position.occupancy[position.side_to_move]) {
+            continue;
+        }
+        position.key = position.compute_key();
+        positions.push_back(position);
+    }
+
+    for (const Position &p : positions) {
+        tables.probe(p, probe);
+    }
+    allocs = allocation_count();
+    start = std::chrono::steady_clock::now();
+    for (const Position &p : positions) {
+        tables.probe(p, probe);
+        sink += probe.dtm;
+    }
+    report("tb_probe_cached", seconds_since(start), positions.size(), allocation_count() - allocs);
+
+    allocs = allocation_count();
+    start = std::chrono::steady_clock::now();
+    for (i = 0; i < TB_PROBES / 10; i++) {
+        cold.probe(positions[i], probe);
+        sink += probe.dtm;
+    }
+    report("tb_probe_uncached", seconds_since(start), TB_PROBES / 10, allocation_count() - allocs);
+    cache = cold.cache_stats();
+    std::cout << "tb_probe_uncached: " << (double) cache.misses / cache.probes << " miss rate" << std::endl;
+    if (sink == 0) {
+        std::cout << "unreachable" << std::endl;
+    }
+}
+
+static void bench_search() {
+    TranspositionTable table(64);
+    Search search(table);
+    SearchLimits limits;
+    SearchResult result;
+    Board board = Board();
+    uint64_t nodes = 0;
+    double seconds = 0;
+    char uci[6];
+
+    limits.depth = SEARCH_DEPTH;
+    for (const char *fen : SEARCH_POSITIONS) {
+        board.set_fen(fen);
+        table.clear();
+        search.clear();
+        result = search.run(board, limits);
+        format_uci(result.best_move, uci);
+        nodes += result.nodes;
+        seconds += result.seconds;
+        std::cout << "search depth " << result.depth << " " << uci << " " << format_score(result.score) << " nodes "
+                  << result.nodes << " time " << result.seconds * 1000 << "ms nps "
+                  << (uint64_t) (result.nodes / std::max(result.seconds, 1e-9)) << " (" << fen << ")" << std::endl;
+    }
+    std::cout << "search: time to depth " << SEARCH_DEPTH << " " << seconds * 1000 << "ms, " << nodes << " nodes, "
+              << (uint64_t) (nodes / std::max(seconds, 1e-9)) << " nps" << std::endl;
+    report("search_node", seconds, nodes, 0);
+}
+
+// the same suite with 1, 2, 4 ... threads up to the hardware's, time-to-depth and nps relative to one thread
+static void bench_smp() {
+    TranspositionTable table(64);
+    Search search(table);
+    SearchLimits limits;
+    SearchResult result;
+    Board board = Board();
+    uint64_t nodes;
+    double seconds, base_seconds = 0, base_nps = 0;
+    int threads, max_threads = std::max((int) std::thread::hardware_concurrency(), 1);
+
+    limits.depth = SEARCH_DEPTH;
+    for (threads = 1; threads <= max_threads; threads = threads < max_threads && threads * 2 > max_threads ? max_threads : threads * 2) {
+        search.set_threads(threads);
+        nodes = 0;
+        seconds = 0;
+        for (const char *fen : SEARCH_POSITIONS) {
+            board.set_fen(fen);
+            table.clear();
+            result = search.run(board, limits);
+            nodes += result.nodes;
+            seconds += result.seconds;
+        }
+        if (threads == 1) {
+            base_seconds = seconds;
+            base_nps = nodes / std::max(seconds, 1e-9);
+        }
+        std::cout << "smp threads " << threads << ": time to depth " << SEARCH_DEPTH << " " << seconds * 1000 << "ms speedup "
+                  << base_seconds / std::max(seconds, 1e-9) << " nps " << (uint64_t) (nodes / std::max(seconds, 1e-9))
+                  << " nps scaling " << nodes / std::max(seconds, 1e-9) / base_nps << std::endl;
+        if (threads == max_threads) {
+            break;
+        }
+    }
+}
+
+struct Benchmark {
+    const char *name;
+    void (*run)();
+};
+
+static const Benchmark BENCHMARKS[] = {
+        {"micro", bench_micro},
+        {"push_pop", bench_push_pop},
+        {"copy", bench_copy},
+        {"fen", bench_fen},
+        {"uci", bench_uci},
+        {"eval", bench_eval},
+        {"nnue", bench_nnue},
+        {"batch", bench_batch},
+        {"games", bench_games},
+        {"pgn", bench_pgn},
+        {"tablebase", bench_tablebase},
+        {"search", bench_search},
+        {"smp", bench_smp},
+};
+
+// one result per line, so a baseline diffs well under version control. names have to be unique, compare() looks
+// results up by name
+static bool write_json(const std::string &path) {
+    std::ofstream out;
+    std::map<std::string, int> seen;
+    size_t i;
+
+    for (const BenchResult &result : results) {
+        if (seen[result.name]++) {
+            std::cerr << "two results named " << result.name << ", not writing " << path << std::endl;
+            return false;
+        }
+    }
+    out.open(path);
+    out << "{\"format\": 1, \"profile\": " << (PROFILE_ENABLED ? "true" : "false") << ", \"results\": [" << std::endl;
+    for (i = 0; i < results.size(); i++) {
+        out << "  {\"name\": \"" << results[i].name << "\", \"ns_per_op\": " << results[i].ns_per_op
+            << ", \"allocs_per_op\": " << results[i].allocs_per_op << ", \"ops\": " << results[i].operations << "}"
+            << (i + 1 < results.size() ? "," : "") << std::endl;
+    }
+    out << "]}" << std::endl;
+    return out.good();
+}
+
+static bool write_csv(const std::string &path) {
+    std::ofstream out(path);
+
+    out << "name,ns_per_op,allocs_per_op,ops" << std::endl;
+    for (const BenchResult &result : results) {
+        out << result.name << "," << result.ns_per_op << "," << result.allocs_per_op << "," << result.operations << std::endl;
+    }
+    return out.good();
+}
+
+// reads back what write_json wrote (one result per line), false if the file can't be read
+static bool read_json(const std::string &path, std::map<std::string, BenchResult> &baseline) {
+    std::ifstream in(path);
+    std::string line;
+    BenchResult result;
+    size_t name, end, ns, allocs;
+
+    if (!in) {
+        return false;
+    }
+    while (std::getline(in, line)) {
+        name = line.find("\"name\": \"");
+        ns = line.find("\"ns_per_op\": ");
+        allocs = line.find("\"allocs_per_op\": ");
+        if (name == std::string::npos || ns == std::string::npos || allocs == std::string::npos) {
+            continue;
+        }
+        name += 9;
+        end = line.find('"', name);
+        result.name = line.substr(name, end - name);
+        result.ns_per_op = strtod(line.c_str() + ns + 13, nullptr);
+        result.allocs_per_op = strtod(line.c_str() + allocs + 17, nullptr);
+        result.operations = 0;
+        baseline[result.name] = result;
+    }
+    return true;
+}
+
+// prints every result next to its baseline, returns the number that regressed (a name used twice counts as one).
+// benchmarks missing on either side are shown but don't count
+static int compare(const std::map<std::string, BenchResult> &baseline, double threshold) {
+    std::map<std::string, BenchResult>::const_iterator found;
+    std::map<std::string, int> seen;
+    double change;
+    bool slower, allocates;
+    int regressions = 0;
+
+    std::cout << "compared with the baseline (threshold " << threshold << "%):" << std::endl;
+    for (const BenchResult &result : results) {
+        // a second result under one name would be held against the first one's baseline, that is no check at all
+        if (seen[result.name]++) {
+            std::cout << "  " << result.name << ": name used twice, not compared" << std::endl;
+            regressions++;
+            continue;
+        }
+        found = baseline.find(result.name);
+        if (found == baseline.end()) {
+            std::cout << "  " << result.name << ": " << result.ns_per_op << " ns/op, not in the baseline" << std::endl;
+            continue;
+        }
+        change = found->second.ns_per_op > 0 ? 100.0 * (result.ns_per_op / found->second.ns_per_op - 1) : 0;
+        slower = change > threshold;
+        // allocation counts are exact, any growth is a regression (the small slack absorbs rounding in the file)
+        allocates = result.allocs_per_op > found->second.allocs_per_op * 1.001 + 1e-6;
+        regressions += slower || allocates;
+        std::cout << "  " << result.name << ": " << found->second.ns_per_op << " -> " << result.ns_per_op << " ns/op ("
+                  << (change >= 0 ? "+" : "") << change << "%)" << (slower ? " SLOWER" : "")
+                  << (allocates ? " MORE ALLOCATIONS" : "") << std::endl;
+    }
+    std::cout << regressions << " regression(s)" << std::endl;
+    return regressions;
+}
+
+int main(int argc, char **argv) {
+    std::vector<const char *> names;
+    std::map<std::string, BenchResult> baseline;
+    std::string json_path, csv_path, baseline_path;
+    double threshold = 10;
+    int i, status = 0;
+    bool run;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--json") && i + 1 < argc) {
+            json_path = argv[++i];
+        } else if (!strcmp(argv[i], "--csv") && i + 1 < argc) {
+            csv_path = argv[++i];
+        } else if (!strcmp(argv[i], "--compare") && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (!strcmp(argv[i], "--threshold") && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--repetitions") && i + 1 < argc) {
+            micro_repetitions = std::max(atoi(argv[++i]), 1);
+        } else if (argv[i][0] == '-') {
+            std::cerr << "unknown argument " << argv[i] << std::endl;
+            return 2;
+        } else {
+            names.push_back(argv[i]);
+        }
+    }
+    // read first, a missing baseline shouldn't cost a whole run
+    if (!baseline_path.empty() && !read_json(baseline_path, baseline)) {
+        std::cerr << "can't read baseline " << baseline_path << std::endl;
+        return 2;
+    }
+
+    for (const Benchmark &benchmark : BENCHMARKS) {
+        run = names.empty();
+        for (const char *name : names) {
+            run |= strcmp(name, benchmark.name) == 0;
+        }
+        if (run) {
+            benchmark.run();
+        }
+    }
+
+    if ((!json_path.empty() && !write_json(json_path)) || (!csv_path.empty() && !write_csv(csv_path))) {
+        std::cerr << "can't write the results" << std::endl;
+        status = 2;
+    }
+    if (!baseline_path.empty() && compare(baseline, threshold) > 0) {
+        status = std::max(status, 1);
+    }
+    return status;
+}
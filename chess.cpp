@@ -1,10 +1,16 @@
 #include "chess.h"
+#include "eval.h"
+#include "fen.h"
+#include "profile.h"
 
 #include <iostream>
 #include <stdlib.h>
-#include <stack>
 #include <vector>
 #include <memory>
+#include <cassert>
+#include <cstring>
+#include <cstddef>
+#include <utility>
 
 /**
  * Features:
@@ -12,7 +18,7 @@
  *  - move stack (push, pop)
  *  - mirror board
  *  - legal moves generator
- *  - detect game end (rep)
+ *  - detect game end (mate, stalemate, rep, 50 moves, material)
  *  - UCI Interfacing
  */
 
@@ -24,11 +30,15 @@ Move::Move(std::array<int, 2> sq1, std::array<int, 2> sq2, bool is_promo, PIECE_
 }
 
 std::unique_ptr<std::string> Move::get_uci() {
-    if (!promotion) {
-        return std::make_unique<std::string>(COLUMN_LETTERS[8-from_square[0]], (char) from_square[1], COLUMN_LETTERS[8-to_square[0]], (char) to_square[1]);
-    } else {
-        return std::make_unique<std::string>(COLUMN_LETTERS[8-from_square[0]], (char) from_square[1], COLUMN_LETTERS[8-to_square[0]], (char) to_square[1], NAME_TABLE[1+(int) new_piece]);
+    std::unique_ptr<std::string> uci = std::make_unique<std::string>();
+    uci->push_back(COLUMN_LETTERS[from_square[1]]);
+    uci->push_back((char) ('1' + from_square[0]));
+    uci->push_back(COLUMN_LETTERS[to_square[1]]);
+    uci->push_back((char) ('1' + to_square[0]));
+    if (promotion) {
+        uci->push_back(NAME_TABLE[1+(int) new_piece]);
     }
+    return uci;
 }
 
 // Piece class implementations
@@ -73,309 +83,1288 @@ Pawn::Pawn(COLOR col) : Piece(col, PAWN) {};
 
 std::vector<std::unique_ptr<Move>> King::get_pseudo_legal_moves(Board *board_ptr, int r, int c) {
     std::vector<std::unique_ptr<Move>> legal_moves;
-    int i, j, tr, tc;
-    bool proc;
-    std::unique_ptr<std::array<std::array<std::unique_ptr<Piece>, 8>, 8>> board_array_ptr;
-    std::array<std::array<std::unique_ptr<Piece>, 8>, 8> board_array;
-
-    board_array_ptr = board_ptr->get_state();
-    board_array = static_cast<std::array<std::array<std::unique_ptr<Piece>, 8>, 8> &&>(*board_array_ptr);
-
-    for (i = -1; i<2; i++) {
-        for (j = -1; j<2; j++) {
-            if (!(i==0 && j==0))
-                tr = r+i;
-                tc = c+j;
-                if (0<=tr<=7 && 0<=tc<=7) {
-                    proc = board_array[tr][tc]->is_protected();
-                    if (!proc) {
-                        legal_moves.push_back(std::unique_ptr<Move>(new Move({r, c}, {tr,tc}, -1)));
-                    }
-                }
-            }
+    MoveList list;
+
+    board_ptr->legal_moves(list);
+    for (PackedMove move : list) {
+        if (move.from() == make_square(r, c)) {
+            legal_moves.push_back(std::unique_ptr<Move>(new Move({r, c}, {square_row(move.to()), square_col(move.to())}, false)));
         }
+    }
     return legal_moves;
 }
 // End King class implementations
 
-// Begin Board function implementations
-Board::Board() {
-    // instantiate board
-    reset();
+// zobrist keys, generated at compile time from a fixed seed (splitmix64) so keys are stable between builds
+struct ZobristKeys {
+    std::array<std::array<std::array<uint64_t, 64>, 6>, 2> pieces;
+    std::array<uint64_t, 16> castling;
+    std::array<uint64_t, 8> ep_file;
+    uint64_t side;
 };
 
-void Board::push(std::unique_ptr<Move> move) {
-    int deltax, deltay, i, dist;
-    bool clear = true;
-    // in special cases such as en-passant or castling, this might be ignored, hence placement might differ in the final release
-    move->taken_piece = std::move(board[move->to_square[0]][move->to_square[1]]);
-    move->old_piece = board[move->from_square[0]][move->from_square[1]]->get_type();
-
-    // CASTLE CHECKING
-    // If the moved piece is a king..
-    if (board[move->from_square[0]][move->from_square[1]]->get_type() == KING) {
-        // set deltax to be the number of horizontal squares moved
-        deltax = move->to_square[1] - move->from_square[1];
-        // if deltax is 2 or more
-        if (abs(deltax) > 1) {
-            // and if there is a rook at the end of the file (which end depends on the direction of deltax)
-            if (deltax > 0) {
-                if (board[move->from_square[0]][7]->get_type() == ROOK) {
-                    // and if the file is clear
-                    for (i = move->from_square[1]+1; i<7; i++) {
-                        if (board[move->from_square[0]][i]->get_type() != EMPTY) {
-                            clear = false;
-                            break;
-                        }
-                    }
-                    if (clear) {
-                        // then the move is (probably, still need to check distances) a castle and we move the pieces accordingly
-                        // note that by default no checks are done to ensure that castling or any moves in particular are legal
-                        dist = 7-move->from_square[1];
-                        if (dist == 3) {
-                            // then the king must be in the fifth square, and this move is a castle
-                            move->castle = true;
-                            // move king to the seventh square
-                            board[move->from_square[0]][6] = std::move(board[move->from_square[0]][4]);
-                            // move rook to the sixth square
-                            board[move->from_square[0]][5] = std::move(board[move->from_square[0]][7]);
-                            // replace the empty squares
-                            board[move->from_square[0]][4] = std::unique_ptr<Piece>(new Piece(NO_COLOR, EMPTY));
-                            board[move->from_square[0]][7] = std::unique_ptr<Piece>(new Piece(NO_COLOR, EMPTY));
-                        } else if (dist == 4) {
-                            // then the king must be in the fourth square, and this move is a castle
-                            move->castle = true;
-                            // move king to the sixth square
-                            board[move->from_square[0]][5] = std::move(board[move->from_square[0]][3]);
-                            // move rook to the fifth square
-                            board[move->from_square[0]][4] = std::move(board[move->from_square[0]][7]);
-                            // replace the empty squares
-                            board[move->from_square[0]][3] = std::unique_ptr<Piece>(new Piece(NO_COLOR, EMPTY));
-                            board[move->from_square[0]][7] = std::unique_ptr<Piece>(new Piece(NO_COLOR, EMPTY));
-                        }
-                    }
-                }
-            // otherwise if deltax < 0, we must be castling in the other direction
-            } else {
-                if (board[move->from_square[0]][0]->get_type() == ROOK) {
-                    // and if the file is clear
-                    for (i = move->from_square[1]-1; i>=0; i--) {
-                        if (board[move->from_square[0]][i]->get_type() != EMPTY) {
-                            clear = false;
-                            break;
-                        }
-                    }
-                    if (clear) {
-                        // then the move is (probably, still need to check distances) a castle and we move the pieces accordingly
-                        // note that by default no checks are done to ensure that castling or any moves in particular are legal
-                        dist = move->from_square[1];
-                        if (dist == 3) {
-                            // then the king must be in the fourth square, and this move is a castle
-                            move->castle = true;
-                            // move king to the second square
-                            board[move->from_square[0]][1] = std::move(board[move->from_square[0]][3]);
-                            // move rook to the third square
-                            board[move->from_square[0]][2] = std::move(board[move->from_square[0]][0]);
-                            // replace the empty squares
-                            board[move->from_square[0]][3] = std::unique_ptr<Piece>(new Piece(NO_COLOR, EMPTY));
-                            board[move->from_square[0]][0] = std::unique_ptr<Piece>(new Piece(NO_COLOR, EMPTY));
-                        } else if (dist == 4) {
-                            // then the king must be in the fifth square, and this move is a castle
-                            move->castle = true;
-                            // move king to the third square
-                            board[move->from_square[0]][2] = std::move(board[move->from_square[0]][3]);
-                            // move rook to the fourth square
-                            board[move->from_square[0]][3] = std::move(board[move->from_square[0]][7]);
-                            // replace the empty squares
-                            board[move->from_square[0]][4] = std::unique_ptr<Piece>(new Piece(NO_COLOR, EMPTY));
-                            board[move->from_square[0]][0] = std::unique_ptr<Piece>(new Piece(NO_COLOR, EMPTY));
-                        }
-                    }
-                }
+static constexpr ZobristKeys ZOBRIST = [] {
+    ZobristKeys keys {};
+    uint64_t state = 0x2545F4914F6CDD1DULL;
+    auto next = [&state] {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    };
+    int color = 0, type = 0, sq = 0, i = 0;
+
+    for (color = 0; color < 2; color++) {
+        for (type = 0; type < 6; type++) {
+            for (sq = 0; sq < 64; sq++) {
+                keys.pieces[color][type][sq] = next();
             }
         }
     }
-    if (!move->castle) {
-        // check for en-passant
-        if (board[move->from_square[0]][move->from_square[1]]->get_type() == PAWN) {
-            deltax = move->from_square[1]-move->to_square[1];
-            deltay = move->from_square[0]-move->to_square[0];
-
-            if (abs(deltax) == 1) {
-                if (abs(deltay) == 1) {
-                    // if the square immediately to the left or right is an enemy pawn
-                    // left case
-                    if (board[move->from_square[0]][move->from_square[1]-deltax]->get_color() != board[move->from_square[0]][move->from_square[1]]->get_color()) {
-                        if (board[move->from_square[0]][move->from_square[1]-deltax]->get_type() == PAWN) {
-                            // then the move is an en-passant move and the pieces are moved accordingly
-                            move->en_passant = true;
-
-                            board[move->to_square[0]][move->to_square[1]] = std::move(board[move->from_square[0]][move->from_square[1]]);
-                            // replace empty squares
-                            board[move->from_square[0]][move->from_square[1]] = std::unique_ptr<Piece>(new Piece(NO_COLOR, EMPTY));
-                            board[move->from_square[0]-deltax][move->from_square[1]] = std::unique_ptr<Piece>(new Piece(NO_COLOR, EMPTY));
-                        }
-                    }
+    // castling keys are xor combinations of the four single rights, so removing one right is one xor
+    std::array<uint64_t, 4> rights {next(), next(), next(), next()};
+    for (i = 0; i < 16; i++) {
+        keys.castling[i] = (i & 1 ? rights[0] : 0) ^ (i & 2 ? rights[1] : 0) ^ (i & 4 ? rights[2] : 0) ^ (i & 8 ? rights[3] : 0);
+    }
+    for (i = 0; i < 8; i++) {
+        keys.ep_file[i] = next();
+    }
+    keys.side = next();
+    return keys;
+}();
 
-                }
+// Begin Position function implementations
+void Position::clear() {
+    int i;
+    for (i = 0; i < 2; i++) {
+        pieces[i].fill(0);
+    }
+    occupancy.fill(0);
+    side_to_move = WHITE;
+    castling = NO_CASTLING;
+    ep_square = NO_SQUARE;
+    halfmove_clock = 0;
+    key = 0;
+    psqt = PsqtScore {0, 0};
+}
+
+void Position::set_startpos() {
+    int i, j;
+    const std::array<PIECE_TYPE, 8> back_rank {ROOK, KNIGHT, BISHOP, QUEEN, KING, BISHOP, KNIGHT, ROOK};
+
+    clear();
+    for (i = 0; i <= 1; i++) {
+        for (j = 0; j < 8; j++) {
+            put_piece(static_cast<COLOR>(i), back_rank[j], make_square(i*7, j));
+            put_piece(static_cast<COLOR>(i), PAWN, make_square(i*5+1, j));
+        }
+    }
+    castling = ALL_CASTLING;
+    key = compute_key();
+}
+
+Bitboard Position::occupied() const {
+    return occupancy[WHITE] | occupancy[BLACK];
+}
+
+COLOR Position::color_on(int sq) const {
+    if (occupancy[WHITE] & square_bb(sq)) {
+        return WHITE;
+    } else if (occupancy[BLACK] & square_bb(sq)) {
+        return BLACK;
+    }
+    return NO_COLOR;
+}
+
+PIECE_TYPE Position::piece_on(int sq) const {
+    int type;
+    COLOR color = color_on(sq);
+
+    if (color == NO_COLOR) {
+        return EMPTY;
+    }
+    for (type = KING; type < PAWN; type++) {
+        if (pieces[color][type] & square_bb(sq)) {
+            break;
+        }
+    }
+    return static_cast<PIECE_TYPE>(type);
+}
+
+void Position::put_piece(COLOR color, PIECE_TYPE type, int sq) {
+    pieces[color][type] |= square_bb(sq);
+    occupancy[color] |= square_bb(sq);
+    key ^= ZOBRIST.pieces[color][type][sq];
+    psqt += PSQT[color][type][sq];
+}
+
+void Position::remove_piece(COLOR color, PIECE_TYPE type, int sq) {
+    pieces[color][type] &= ~square_bb(sq);
+    occupancy[color] &= ~square_bb(sq);
+    key ^= ZOBRIST.pieces[color][type][sq];
+    psqt -= PSQT[color][type][sq];
+}
+
+void Position::move_piece(COLOR color, PIECE_TYPE type, int from, int to) {
+    Bitboard from_to = square_bb(from) | square_bb(to);
+    pieces[color][type] ^= from_to;
+    occupancy[color] ^= from_to;
+    key ^= ZOBRIST.pieces[color][type][from] ^ ZOBRIST.pieces[color][type][to];
+    psqt += PSQT[color][type][to];
+    psqt -= PSQT[color][type][from];
+}
+
+bool Position::ep_capturable() const {
+    // a pawn of the side to move stands where an enemy pawn on the en-passant square would attack
+    return ep_square != NO_SQUARE && (pawn_attacks(side_to_move == WHITE ? BLACK : WHITE, ep_square) & pieces[side_to_move][PAWN]);
+}
+
+PsqtScore Position::compute_psqt() const {
+    PsqtScore result = {0, 0};
+    Bitboard b;
+    int color, type;
+
+    for (color = WHITE; color <= BLACK; color++) {
+        for (type = KING; type <= PAWN; type++) {
+            for (b = pieces[color][type]; b;) {
+                result += PSQT[color][type][pop_lsb(b)];
             }
         }
     }
-    if (!move->en_passant) {
-        if (!move->castle) {
-            if (!move->promotion) {
-                board[move->to_square[0]][move->to_square[1]] = std::move(board[move->from_square[0]][move->from_square[1]]);
-                board[move->from_square[0]][move->from_square[1]] = std::make_unique<Piece>(NO_COLOR);
-            } else {
-                board[move->to_square[0]][move->to_square[1]] = create_piece(move->new_piece);
-                board[move->to_square[0]][move->to_square[1]]->set_color(board[move->from_square[0]][move->from_square[1]]->get_color());
-                board[move->from_square[0]][move->from_square[1]] = std::make_unique<Piece>(NO_COLOR);
+    return result;
+}
+
+uint64_t Position::compute_key() const {
+    uint64_t result = 0;
+    Bitboard b;
+    int color, type;
+
+    for (color = 0; color < 2; color++) {
+        for (type = 0; type < 6; type++) {
+            b = pieces[color][type];
+            while (b) {
+                result ^= ZOBRIST.pieces[color][type][pop_lsb(b)];
+            }
+        }
+    }
+    result ^= ZOBRIST.castling[castling];
+    if (ep_capturable()) {
+        result ^= ZOBRIST.ep_file[square_col(ep_square)];
+    }
+    if (side_to_move == BLACK) {
+        result ^= ZOBRIST.side;
+    }
+    return result;
+}
+
+bool Position::set_fen(std::string_view fen) {
+    return parse_fen(fen, *this).ok;
+}
+
+std::string Position::get_fen(int fullmove_number) const {
+    char buffer[FEN_BUFFER_SIZE];
+    return std::string(buffer, write_fen(*this, fullmove_number, buffer, sizeof(buffer)));
+}
+
+int Position::king_square(COLOR color) const {
+    return lsb(pieces[color][KING]);
+}
+
+Bitboard Position::attackers_to(int sq, Bitboard occupied) const {
+    return (pawn_attacks(WHITE, sq) & pieces[BLACK][PAWN]) | (pawn_attacks(BLACK, sq) & pieces[WHITE][PAWN]) |
+           (knight_attacks(sq) & (pieces[WHITE][KNIGHT] | pieces[BLACK][KNIGHT])) |
+           (king_attacks(sq) & (pieces[WHITE][KING] | pieces[BLACK][KING])) |
+           (bishop_attacks(sq, occupied) & (pieces[WHITE][BISHOP] | pieces[BLACK][BISHOP] | pieces[WHITE][QUEEN] | pieces[BLACK][QUEEN])) |
+           (rook_attacks(sq, occupied) & (pieces[WHITE][ROOK] | pieces[BLACK][ROOK] | pieces[WHITE][QUEEN] | pieces[BLACK][QUEEN]));
+}
+
+bool Position::in_check() const {
+    COLOR us = static_cast<COLOR>(side_to_move);
+    return attackers_to(king_square(us), occupied()) & occupancy[us == WHITE ? BLACK : WHITE];
+}
+
+bool Position::insufficient_material() const {
+    const Bitboard dark_squares = 0xAA55AA55AA55AA55ULL;
+    Bitboard bishops = pieces[WHITE][BISHOP] | pieces[BLACK][BISHOP];
+    Bitboard minors = bishops | pieces[WHITE][KNIGHT] | pieces[BLACK][KNIGHT];
+
+    if (pieces[WHITE][PAWN] | pieces[BLACK][PAWN] | pieces[WHITE][ROOK] | pieces[BLACK][ROOK] | pieces[WHITE][QUEEN] | pieces[BLACK][QUEEN]) {
+        return false;
+    }
+    return popcount(minors) <= 1 || (minors == bishops && (!(bishops & dark_squares) || !(bishops & ~dark_squares)));
+}
+// End Position function implementations
+
+// Begin attack table implementations
+// every table here is a constant expression. compilers cap the work done for a single one, so each square's
+// slice of the sliding tables is built on its own (SlidingTable) and ROOK_MAGICS/BISHOP_MAGICS point into them
+
+// directions as {row, column} steps, the first four go towards higher squares. rooks use the even ones
+static constexpr int RAY_STEPS[8][2] = {{1, 0}, {1, 1}, {0, 1}, {1, -1}, {-1, 0}, {-1, -1}, {0, -1}, {-1, 1}};
+static constexpr int ROOK_RAYS = 0;
+static constexpr int BISHOP_RAYS = 1;
+
+// squares from sq to the edge of the board in each direction, sq itself excluded
+static constexpr std::array<std::array<Bitboard, 64>, 8> RAYS = [] {
+    std::array<std::array<Bitboard, 64>, 8> rays {};
+    int d = 0, sq = 0, r = 0, c = 0;
+
+    for (d = 0; d < 8; d++) {
+        for (sq = 0; sq < 64; sq++) {
+            r = square_row(sq) + RAY_STEPS[d][0];
+            c = square_col(sq) + RAY_STEPS[d][1];
+            while (0 <= r && r <= 7 && 0 <= c && c <= 7) {
+                rays[d][sq] |= square_bb(make_square(r, c));
+                r += RAY_STEPS[d][0];
+                c += RAY_STEPS[d][1];
             }
         }
     }
+    return rays;
+}();
 
-    move_stack.push(std::move(move));
+// each ray is cut behind the first piece on it, only used to build the tables
+static constexpr Bitboard sliding_attacks(int sq, Bitboard occupied, int first_ray) {
+    Bitboard attacks = 0, blockers = 0;
+    const Bitboard *ray = nullptr;
+    int d = 0;
+
+    for (d = first_ray; d < 8; d += 2) {
+        ray = RAYS[d].data();
+        attacks |= ray[sq];
+        blockers = ray[sq] & occupied;
+        if (blockers) {
+            attacks ^= ray[d < 4 ? lsb(blockers) : 63 - __builtin_clzll(blockers)];
+        }
+    }
+    return attacks;
+}
+
+// attacks from sq to the squares given as {row, column} offsets, dropping the ones that fall off the board
+template <int N>
+static constexpr Bitboard step_attacks(int sq, const int (&steps)[N][2]) {
+    Bitboard attacks = 0;
+    int i = 0, r = 0, c = 0;
+
+    for (i = 0; i < N; i++) {
+        r = square_row(sq) + steps[i][0];
+        c = square_col(sq) + steps[i][1];
+        if (0 <= r && r <= 7 && 0 <= c && c <= 7) {
+            attacks |= square_bb(make_square(r, c));
+        }
+    }
+    return attacks;
+}
+
+static constexpr int WHITE_PAWN_STEPS[2][2] = {{1, -1}, {1, 1}};
+static constexpr int BLACK_PAWN_STEPS[2][2] = {{-1, -1}, {-1, 1}};
+static constexpr int KNIGHT_STEPS[8][2] = {{2, 1}, {2, -1}, {-2, 1}, {-2, -1}, {1, 2}, {1, -2}, {-1, 2}, {-1, -2}};
+static constexpr int KING_STEPS[8][2] = {{1, 1}, {1, 0}, {1, -1}, {0, 1}, {0, -1}, {-1, 1}, {-1, 0}, {-1, -1}};
+
+constexpr std::array<std::array<Bitboard, 64>, 2> PAWN_ATTACKS = [] {
+    std::array<std::array<Bitboard, 64>, 2> attacks {};
+    int sq = 0;
+
+    for (sq = 0; sq < 64; sq++) {
+        attacks[WHITE][sq] = step_attacks(sq, WHITE_PAWN_STEPS);
+        attacks[BLACK][sq] = step_attacks(sq, BLACK_PAWN_STEPS);
+    }
+    return attacks;
+}();
+
+constexpr std::array<Bitboard, 64> KNIGHT_ATTACKS = [] {
+    std::array<Bitboard, 64> attacks {};
+    int sq = 0;
+
+    for (sq = 0; sq < 64; sq++) {
+        attacks[sq] = step_attacks(sq, KNIGHT_STEPS);
+    }
+    return attacks;
+}();
+
+constexpr std::array<Bitboard, 64> KING_ATTACKS = [] {
+    std::array<Bitboard, 64> attacks {};
+    int sq = 0;
+
+    for (sq = 0; sq < 64; sq++) {
+        attacks[sq] = step_attacks(sq, KING_STEPS);
+    }
+    return attacks;
+}();
+
+// fixed magic multipliers, found offline by random search so that every occupancy subset maps to its own slot
+static constexpr std::array<Bitboard, 64> ROOK_MAGIC_NUMBERS = {
+        0x1080004008801020ULL, 0x0840092002C03000ULL, 0x1900200010400900ULL, 0x0880100008000480ULL,
+        0x4200100420080200ULL, 0x8100020100080400ULL, 0x0200040110886200ULL, 0x0200008040220411ULL,
+        0x0404800084400220ULL, 0x0000401000402000ULL, 0x0086001081220440ULL, 0x0408800800100280ULL,
+        0x000A001201040820ULL, 0x8848800200840080ULL, 0x4001000100040200ULL, 0x0442000102105084ULL,
+        0x9080010020804100ULL, 0x0040404000201009ULL, 0x0000808010002009ULL, 0x2200090021D00100ULL,
+        0x0008008008040080ULL, 0x0004004002010040ULL, 0x0011040008015042ULL, 0x00000A0001768104ULL,
+        0x0000800080204009ULL, 0x2010004140002001ULL, 0x9800200280100080ULL, 0x1000100080080080ULL,
+        0x0442000A00049020ULL, 0x2100040080020080ULL, 0x0800120400900148ULL, 0x0010040A00128541ULL,
+        0x2800804000800030ULL, 0x1010002000400041ULL, 0x4000200011004100ULL, 0x0610008410800800ULL,
+        0x0400802402800800ULL, 0xC100020080800400ULL, 0x0002000802000401ULL, 0x0182085882000401ULL,
+        0x0220204000808000ULL, 0x2860100040024022ULL, 0x0001002004110040ULL, 0x99101042000A0020ULL,
+        0x0004080004008080ULL, 0x0010040002008080ULL, 0x2012004881020004ULL, 0x8300842444820011ULL,
+        0x0088403882010200ULL, 0x0820400080210100ULL, 0x0110910040A00300ULL, 0x0801100280080480ULL,
+        0x0242009008200600ULL, 0x1002000489500200ULL, 0x0040800200010080ULL, 0x0091800041000080ULL,
+        0x0000209300488001ULL, 0x04C1002414824001ULL, 0x020020000B001041ULL, 0x7000100004200901ULL,
+        0x8002002004100802ULL, 0x30010002084C0007ULL, 0x0888221800813004ULL, 0x4000002840840112ULL
 };
-void Board::pop() {
-    std::unique_ptr<Move> move;
-    int deltax, dist;
-    // stack broken?
-    move = move_stack.top();
-    move_stack.pop();
-    if (!move->en_passant) {
-        if (!move->castle) {
-            if (!move->promotion) {
-                board[move->from_square[0]][move->from_square[1]] = std::move(board[move->to_square[0]][move->to_square[1]]);
-            } else {
-                board[move->from_square[0]][move->from_square[1]] = create_piece(move->old_piece);
+
+static constexpr std::array<Bitboard, 64> BISHOP_MAGIC_NUMBERS = {
+        0xA010041108003100ULL, 0x006082020A002900ULL, 0x6810010619200000ULL, 0x08281A0520000408ULL,
+        0x0001104001000400ULL, 0x0018901008048400ULL, 0x00040A0210245280ULL, 0x000200210808A402ULL,
+        0x9140048410821200ULL, 0x0800091010820041ULL, 0x20504804832202C0ULL, 0x0100091401081000ULL,
+        0x8021011140000012ULL, 0x0810020804450400ULL, 0x208B0542109008A2ULL, 0x0080084A08040204ULL,
+        0x0040E2A80811244CULL, 0x2505022008008108ULL, 0x0430220100420040ULL, 0x010A040420220040ULL,
+        0x1105000290400000ULL, 0x0093001200822120ULL, 0x4000A62048043004ULL, 0x280120048A015004ULL,
+        0x006090002A020814ULL, 0x44042000240800D0ULL, 0x01102800040A4400ULL, 0x1004080080220040ULL,
+        0x0001001011004024ULL, 0x0010044000805040ULL, 0x0914041200820100ULL, 0x0004821012821480ULL,
+        0x0024040500C05021ULL, 0x0088611002080200ULL, 0x0116080A00040020ULL, 0x4000020080080080ULL,
+        0x2450450140840040ULL, 0x0000880201484100ULL, 0x0222020404020092ULL, 0x8081110600002E00ULL,
+        0x2842101105000801ULL, 0x1100809008001025ULL, 0x00020202221C0400ULL, 0x0422014022009020ULL,
+        0x0210046102100C00ULL, 0xC004008082029102ULL, 0x00AA461801101200ULL, 0x0404080080201108ULL,
+        0x020542108C205002ULL, 0x0410544804100100ULL, 0x0040910841100000ULL, 0x0400200042021100ULL,
+        0x00004204850400C0ULL, 0x0200100410A42102ULL, 0x1040020801210102ULL, 0x0805040410420000ULL,
+        0x2884804130100200ULL, 0x800C262201242000ULL, 0x1058000194108800ULL, 0x0014221054420204ULL,
+        0x0104000012A02200ULL, 0x0200881003300100ULL, 0x0140400202840100ULL, 0x0402020801010201ULL
+};
+
+// the edge squares never block anything further, so they are left out of the mask
+static constexpr Bitboard relevant_mask(int sq, int first_ray) {
+    Bitboard edges = ((ROW_1 | ROW_8) & ~(ROW_1 << (8*square_row(sq)))) | ((FILE_A | FILE_H) & ~(FILE_A << square_col(sq)));
+    return sliding_attacks(sq, 0, first_ray) & ~edges;
+}
+
+template <int FirstRay, int Sq>
+struct SlidingTable {
+    static constexpr Bitboard mask = relevant_mask(Sq, FirstRay);
+    static constexpr Bitboard magic = FirstRay == ROOK_RAYS ? ROOK_MAGIC_NUMBERS[Sq] : BISHOP_MAGIC_NUMBERS[Sq];
+    static constexpr int bits = popcount(mask);
+
+    static constexpr std::array<Bitboard, 1 << bits> build() {
+        std::array<Bitboard, 1 << bits> table {};
+        Bitboard *slots = table.data();
+        Bitboard subset = 0;
+
+        // enumerate every subset of the mask (carry-rippler trick)
+        do {
+            slots[(subset * magic) >> (64 - bits)] = sliding_attacks(Sq, subset, FirstRay);
+            subset = (subset - mask) & mask;
+        } while (subset);
+        return table;
+    }
+
+    static constexpr std::array<Bitboard, 1 << bits> attacks = build();
+};
+
+template <int FirstRay, std::size_t... Sq>
+static constexpr std::array<Magic, 64> make_magics(std::index_sequence<Sq...>) {
+    return {{Magic {SlidingTable<FirstRay, Sq>::mask, SlidingTable<FirstRay, Sq>::magic,
+                    SlidingTable<FirstRay, Sq>::attacks.data(), 64 - SlidingTable<FirstRay, Sq>::bits}...}};
+}
+
+constexpr std::array<Magic, 64> ROOK_MAGICS = make_magics<ROOK_RAYS>(std::make_index_sequence<64>());
+constexpr std::array<Magic, 64> BISHOP_MAGICS = make_magics<BISHOP_RAYS>(std::make_index_sequence<64>());
+
+constexpr std::array<std::array<Bitboard, 64>, 64> BETWEEN_BB = [] {
+    std::array<std::array<Bitboard, 64>, 64> between {};
+    Bitboard ray = 0;
+    int a = 0, b = 0, d = 0;
+
+    for (a = 0; a < 64; a++) {
+        for (d = 0; d < 8; d++) {
+            for (ray = RAYS[d][a]; ray; ray &= ray - 1) {
+                b = lsb(ray);
+                between[a][b] = RAYS[d][a] & ~RAYS[d][b] & ~square_bb(b);
             }
-        } else {
-            //undo castle move
-            board[move->from_square[0]][move->from_square[1]] = std::move(board[move->to_square[0]][move->to_square[1]]);
-            deltax = move->from_square[1]-move->to_square[1];
-            if (deltax > 0) {
-                board[move->to_square[0]][7] = std::move(board[move->to_square[0]][move->to_square[1]-1]);
-                dist = 7-move->from_square[1];
-                // now fill in empty squares
-                if (dist == 3) {
-                    board[move->to_square[0]][5] = std::make_unique<Piece>(NO_COLOR, EMPTY);
-                    board[move->to_square[0]][6] = std::make_unique<Piece>(NO_COLOR, EMPTY);
-                } else if (dist == 4) {
-                    board[move->to_square[0]][4] = std::make_unique<Piece>(NO_COLOR, EMPTY);
-                    board[move->to_square[0]][5] = std::make_unique<Piece>(NO_COLOR, EMPTY);
-                    board[move->to_square[0]][6] = std::make_unique<Piece>(NO_COLOR, EMPTY);
-                }
+        }
+    }
+    return between;
+}();
 
-            } else {
-                board[move->to_square[0]][0] = std::move(board[move->to_square[0]][move->to_square[1]+1]);
-                // now fill in empty squares
-                if (dist == 3) {
-                    board[move->to_square[0]][1] = std::make_unique<Piece>(NO_COLOR, EMPTY);
-                    board[move->to_square[0]][2] = std::make_unique<Piece>(NO_COLOR, EMPTY);
-                } else if (dist == 4) {
-                    board[move->to_square[0]][1] = std::make_unique<Piece>(NO_COLOR, EMPTY);
-                    board[move->to_square[0]][2] = std::make_unique<Piece>(NO_COLOR, EMPTY);
-                    board[move->to_square[0]][3] = std::make_unique<Piece>(NO_COLOR, EMPTY);
+constexpr std::array<std::array<Bitboard, 64>, 64> LINE_BB = [] {
+    std::array<std::array<Bitboard, 64>, 64> line {};
+    Bitboard ray = 0;
+    int a = 0, d = 0;
+
+    for (a = 0; a < 64; a++) {
+        for (d = 0; d < 8; d++) {
+            for (ray = RAYS[d][a]; ray; ray &= ray - 1) {
+                line[a][lsb(ray)] = RAYS[d][a] | RAYS[(d + 4) % 8][a] | square_bb(a);
+            }
+        }
+    }
+    return line;
+}();
+// End attack table implementations
+
+// Begin move generator implementations
+// what tells the two sides apart, as compile-time constants. the generator, is_legal and make/unmake are
+// templated on the side to move and the public entry points pick the instance, so each side gets its own
+// straight-line code with the directions, rows and castling squares folded in
+template <COLOR Us>
+struct SideTraits {
+    static constexpr COLOR them = Us == WHITE ? BLACK : WHITE;
+    static constexpr int up = Us == WHITE ? 8 : -8;
+    // a1 or a8, the castling squares are counted from here
+    static constexpr int home = Us == WHITE ? 0 : 56;
+    static constexpr int pawn_row = Us == WHITE ? 1 : 6;
+    static constexpr Bitboard promotion_row = Us == WHITE ? ROW_8 : ROW_1;
+    static constexpr Bitboard third_row = Us == WHITE ? ROW_1 << 16 : ROW_8 >> 16;
+    static constexpr uint8_t king_castle = Us == WHITE ? WHITE_OO : BLACK_OO;
+    static constexpr uint8_t queen_castle = Us == WHITE ? WHITE_OOO : BLACK_OOO;
+};
+
+template <int Offset>
+inline Bitboard shift(Bitboard b) {
+    if constexpr (Offset > 0) {
+        return b << Offset;
+    } else {
+        return b >> -Offset;
+    }
+}
+
+// pieces of one color attacking sq, half the work of Position::attackers_to when only one side matters
+template <COLOR By>
+inline Bitboard attackers_by(const Position &position, int sq, Bitboard occupied) {
+    const std::array<Bitboard, 6> &pieces = position.pieces[By];
+    return (pawn_attacks(SideTraits<By>::them, sq) & pieces[PAWN]) | (knight_attacks(sq) & pieces[KNIGHT]) |
+           (king_attacks(sq) & pieces[KING]) | (bishop_attacks(sq, occupied) & (pieces[BISHOP] | pieces[QUEEN])) |
+           (rook_attacks(sq, occupied) & (pieces[ROOK] | pieces[QUEEN]));
+}
+
+// type of the Color piece on sq, which must hold one. pawns are looked at first as they move most
+template <COLOR Color>
+inline PIECE_TYPE type_on(const Position &position, int sq) {
+    int type;
+    for (type = PAWN; type > KING && !(position.pieces[Color][type] & square_bb(sq)); type--);
+    return static_cast<PIECE_TYPE>(type);
+}
+
+inline PackedMove *add_moves(PackedMove *moves, int from, Bitboard targets, int flags) {
+    while (targets) {
+        *moves++ = PackedMove(from, pop_lsb(targets), flags);
+    }
+    return moves;
+}
+
+// pawn moves are generated set-wise, so the from square is recovered from the to square and the shift used
+template <int Offset>
+inline PackedMove *add_pawn_moves(PackedMove *moves, Bitboard targets, int flags) {
+    int to;
+    while (targets) {
+        to = pop_lsb(targets);
+        *moves++ = PackedMove(to - Offset, to, flags);
+    }
+    return moves;
+}
+
+inline PackedMove *add_promotions(PackedMove *moves, int from, int to, int capture) {
+    *moves++ = PackedMove(from, to, QUEEN_PROMOTION | capture);
+    *moves++ = PackedMove(from, to, ROOK_PROMOTION | capture);
+    *moves++ = PackedMove(from, to, BISHOP_PROMOTION | capture);
+    *moves++ = PackedMove(from, to, KNIGHT_PROMOTION | capture);
+    return moves;
+}
+
+template <int Offset>
+inline PackedMove *add_pawn_promotions(PackedMove *moves, Bitboard targets, int capture) {
+    int to;
+    while (targets) {
+        to = pop_lsb(targets);
+        moves = add_promotions(moves, to - Offset, to, capture);
+    }
+    return moves;
+}
+
+// moves of the pieces in b, which all move like Type (queens are passed in as bishops and again as rooks).
+// pinned knights can never move, pinned sliders may move along their pin line
+template <PIECE_TYPE Type>
+inline PackedMove *add_piece_moves(PackedMove *moves, Bitboard b, Bitboard own, Bitboard enemy, Bitboard checkmask,
+                                   Bitboard pinned, int ksq) {
+    Bitboard targets, occupied = own | enemy;
+    int from;
+
+    if constexpr (Type == KNIGHT) {
+        b &= ~pinned;
+    }
+    while (b) {
+        from = pop_lsb(b);
+        targets = piece_attacks<Type>(from, occupied) & ~own & checkmask;
+        if constexpr (Type != KNIGHT) {
+            if (pinned & square_bb(from)) {
+                targets &= LINE_BB[ksq][from];
+            }
+        }
+        moves = add_moves(moves, from, targets & enemy, CAPTURE);
+        moves = add_moves(moves, from, targets & ~enemy, QUIET);
+    }
+    return moves;
+}
+
+template <COLOR Us>
+static int generate_legal(const Position &position, PackedMove *moves) {
+    typedef SideTraits<Us> side;
+    constexpr COLOR them = side::them;
+    constexpr int up = side::up, home = side::home;
+    PackedMove *start = moves;
+    Bitboard own = position.occupancy[Us], enemy = position.occupancy[them], occupied = own | enemy;
+    Bitboard checkers, pinned, snipers, checkmask, b, targets, pawns, single, row;
+    int ksq = position.king_square(Us), from, to;
+
+    checkers = attackers_by<them>(position, ksq, occupied);
+
+    // the king may go anywhere that is not attacked once it has left its square (so it can't hide behind itself)
+    targets = king_attacks(ksq) & ~own;
+    while (targets) {
+        to = pop_lsb(targets);
+        if (!attackers_by<them>(position, to, occupied ^ square_bb(ksq))) {
+            *moves++ = PackedMove(ksq, to, enemy & square_bb(to) ? CAPTURE : QUIET);
+        }
+    }
+    // in double check only the king can move
+    if (checkers & (checkers - 1)) {
+        return (int) (moves - start);
+    }
+    // in single check every other move has to capture the checker or block it
+    checkmask = checkers ? BETWEEN_BB[ksq][lsb(checkers)] | checkers : ~0ULL;
+
+    // a piece is pinned when it is the only thing between the king and an enemy slider
+    pinned = 0;
+    snipers = (rook_attacks(ksq, enemy) & (position.pieces[them][ROOK] | position.pieces[them][QUEEN])) |
+              (bishop_attacks(ksq, enemy) & (position.pieces[them][BISHOP] | position.pieces[them][QUEEN]));
+    while (snipers) {
+        b = BETWEEN_BB[ksq][pop_lsb(snipers)] & occupied;
+        if (b && !(b & (b - 1))) {
+            pinned |= b & own;
+        }
+    }
+
+    // castling, the rights guarantee the king and rook haven't moved but the path still has to be empty and safe
+    if (!checkers) {
+        if ((position.castling & side::king_castle) && (position.pieces[Us][ROOK] & square_bb(home + 7)) &&
+            !(occupied & (square_bb(home + 5) | square_bb(home + 6))) &&
+            !attackers_by<them>(position, home + 5, occupied) && !attackers_by<them>(position, home + 6, occupied)) {
+            *moves++ = PackedMove(home + 4, home + 6, KING_CASTLE);
+        }
+        if ((position.castling & side::queen_castle) && (position.pieces[Us][ROOK] & square_bb(home)) &&
+            !(occupied & (square_bb(home + 1) | square_bb(home + 2) | square_bb(home + 3))) &&
+            !attackers_by<them>(position, home + 3, occupied) && !attackers_by<them>(position, home + 2, occupied)) {
+            *moves++ = PackedMove(home + 4, home + 2, QUEEN_CASTLE);
+        }
+    }
+
+    moves = add_piece_moves<KNIGHT>(moves, position.pieces[Us][KNIGHT], own, enemy, checkmask, pinned, ksq);
+    moves = add_piece_moves<BISHOP>(moves, position.pieces[Us][BISHOP] | position.pieces[Us][QUEEN], own, enemy,
+                                    checkmask, pinned, ksq);
+    moves = add_piece_moves<ROOK>(moves, position.pieces[Us][ROOK] | position.pieces[Us][QUEEN], own, enemy,
+                                  checkmask, pinned, ksq);
+
+    // pawns that aren't pinned, set-wise
+    pawns = position.pieces[Us][PAWN] & ~pinned;
+
+    single = shift<up>(pawns) & ~occupied;
+    moves = add_pawn_moves<2*up>(moves, shift<up>(single & side::third_row) & ~occupied & checkmask, DOUBLE_PUSH);
+    single &= checkmask;
+    moves = add_pawn_moves<up>(moves, single & ~side::promotion_row, QUIET);
+    moves = add_pawn_promotions<up>(moves, single & side::promotion_row, QUIET);
+
+    // captures towards the a file then towards the h file
+    targets = shift<up - 1>(pawns & ~FILE_A) & enemy & checkmask;
+    moves = add_pawn_moves<up - 1>(moves, targets & ~side::promotion_row, CAPTURE);
+    moves = add_pawn_promotions<up - 1>(moves, targets & side::promotion_row, CAPTURE);
+    targets = shift<up + 1>(pawns & ~FILE_H) & enemy & checkmask;
+    moves = add_pawn_moves<up + 1>(moves, targets & ~side::promotion_row, CAPTURE);
+    moves = add_pawn_promotions<up + 1>(moves, targets & side::promotion_row, CAPTURE);
+
+    // pinned pawns one at a time, they can only move along the pin line
+    b = position.pieces[Us][PAWN] & pinned;
+    while (b) {
+        from = pop_lsb(b);
+        row = LINE_BB[ksq][from] & checkmask;
+        to = from + up;
+        if (!(occupied & square_bb(to))) {
+            if (row & square_bb(to)) {
+                if (side::promotion_row & square_bb(to)) {
+                    moves = add_promotions(moves, from, to, QUIET);
+                } else {
+                    *moves++ = PackedMove(from, to, QUIET);
                 }
             }
+            if ((shift<2*up>(square_bb(from)) & shift<up>(side::third_row) & row & ~occupied)) {
+                *moves++ = PackedMove(from, to + up, DOUBLE_PUSH);
+            }
+        }
+        targets = pawn_attacks(Us, from) & enemy & row;
+        while (targets) {
+            to = pop_lsb(targets);
+            if (side::promotion_row & square_bb(to)) {
+                moves = add_promotions(moves, from, to, CAPTURE);
+            } else {
+                *moves++ = PackedMove(from, to, CAPTURE);
+            }
+        }
+    }
+
+    // en-passant is rare enough to check by replaying the occupancy change, which also catches the rank pin case
+    if (position.ep_square != NO_SQUARE) {
+        to = position.ep_square;
+        b = pawn_attacks(them, to) & position.pieces[Us][PAWN];
+        while (b) {
+            from = pop_lsb(b);
+            targets = occupied ^ square_bb(from) ^ square_bb(to) ^ square_bb(to - up);
+            if (!(attackers_by<them>(position, ksq, targets) & ~square_bb(to - up))) {
+                *moves++ = PackedMove(from, to, EP_CAPTURE);
+            }
+        }
+    }
+
+    return (int) (moves - start);
+}
+
+#ifdef CPP_CHESS_PROFILE
+static void count_generated(const PackedMove *moves, int count) {
+    uint64_t captures = 0, castles = 0, ep = 0, promotions = 0;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        captures += moves[i].is_capture();
+        castles += moves[i].is_castle();
+        ep += moves[i].flags() == EP_CAPTURE;
+        promotions += moves[i].is_promotion();
+    }
+    PROFILE_COUNT(PROFILE_GENERATE_CALLS, 1);
+    PROFILE_COUNT(PROFILE_GENERATED_MOVES, count);
+    PROFILE_COUNT(PROFILE_GENERATED_CAPTURES, captures);
+    PROFILE_COUNT(PROFILE_GENERATED_CASTLES, castles);
+    PROFILE_COUNT(PROFILE_GENERATED_EP, ep);
+    PROFILE_COUNT(PROFILE_GENERATED_PROMOTIONS, promotions);
+}
+#endif
+
+int generate_legal_moves(const Position &position, PackedMove *moves) {
+    PROFILE_SCOPE(TIMER_GENERATE_MOVES);
+    int count = position.side_to_move == WHITE ? generate_legal<WHITE>(position, moves) : generate_legal<BLACK>(position, moves);
+
+#ifdef CPP_CHESS_PROFILE
+    count_generated(moves, count);
+#endif
+    return count;
+}
+
+template <COLOR Us>
+static bool is_legal_for(const Position &position, PackedMove move) {
+    typedef SideTraits<Us> side;
+    constexpr COLOR them = side::them;
+    constexpr int up = side::up, home = side::home;
+    Bitboard own = position.occupancy[Us], enemy = position.occupancy[them], occupied = own | enemy;
+    Bitboard captured, after;
+    int from = move.from(), to = move.to(), flags = move.flags();
+    int ksq, type;
+
+    if (!(own & square_bb(from)) || (own & square_bb(to))) {
+        return false;
+    }
+    // checked first, an ep flag on an arbitrary to square would put the captured pawn off the board
+    if (flags == EP_CAPTURE && to != position.ep_square) {
+        return false;
+    }
+    type = type_on<Us>(position, from);
+    captured = flags == EP_CAPTURE ? square_bb(to - up) : enemy & square_bb(to);
+    // the capture bit has to agree with the board, which also rules out ep flags on pieces landing on something
+    if (flags != EP_CAPTURE && ((flags & CAPTURE) != 0) != (captured != 0)) {
+        return false;
+    }
+
+    if (type == PAWN) {
+        if (((flags & KNIGHT_PROMOTION) != 0) != ((square_bb(to) & (ROW_1 | ROW_8)) != 0)) {
+            return false;
+        }
+        if (flags == EP_CAPTURE) {
+            if (!(pawn_attacks(Us, from) & square_bb(to))) {
+                return false;
+            }
+        } else if (flags == DOUBLE_PUSH) {
+            if (to != from + 2*up || square_row(from) != side::pawn_row ||
+                (occupied & (square_bb(from + up) | square_bb(to)))) {
+                return false;
+            }
+        } else if (!(flags & KNIGHT_PROMOTION) && flags != QUIET && flags != CAPTURE) {
+            return false;
+        } else if (flags & CAPTURE) {
+            if (!(pawn_attacks(Us, from) & square_bb(to))) {
+                return false;
+            }
+        } else if (to != from + up || (occupied & square_bb(to))) {
+            return false;
+        }
+    } else if (flags == KING_CASTLE || flags == QUEEN_CASTLE) {
+        // the rights guarantee the king and rook haven't moved, the path has to be empty and safe like in the generator
+        if (type != KING || from != home + 4 || to != (flags == KING_CASTLE ? home + 6 : home + 2) ||
+            !(position.pieces[Us][ROOK] & square_bb(flags == KING_CASTLE ? home + 7 : home)) ||
+            (occupied & BETWEEN_BB[from][flags == KING_CASTLE ? home + 7 : home]) ||
+            !(position.castling & (flags == KING_CASTLE ? side::king_castle : side::queen_castle)) ||
+            attackers_by<them>(position, from, occupied) || attackers_by<them>(position, (from + to) / 2, occupied)) {
+            return false;
         }
     } else {
-        // undo en-passant move
-        board[move->from_square[0]][move->from_square[1]] = std::move(board[move->to_square[0]][move->to_square[1]]);
-        deltax = move->from_square[1]-move->to_square[1];
-        board[move->from_square[0]-deltax][move->from_square[1]] = std::unique_ptr<Piece>(new Pawn((
-                board[move->from_square[0]][move->from_square[1]]->get_color()==WHITE ? BLACK : WHITE)));
+        if (flags & ~CAPTURE) {
+            return false;
+        }
+        if (!((type == KING ? king_attacks(from) : type == KNIGHT ? knight_attacks(from) :
+               type == BISHOP ? bishop_attacks(from, occupied) : type == ROOK ? rook_attacks(from, occupied) :
+               queen_attacks(from, occupied)) & square_bb(to))) {
+            return false;
+        }
     }
 
-    board[move->to_square[0]][move->to_square[1]] = std::move(move->taken_piece);
-};
+    // replay the occupancy change and see whether our king is attacked afterwards
+    after = (occupied ^ square_bb(from) ^ captured) | square_bb(to);
+    ksq = type == KING ? to : position.king_square(Us);
+    return !(attackers_by<them>(position, ksq, after) & ~captured);
+}
 
-void Board::reset() {
-    int i, j;
-    for (i = 0; i<=1; i++) {
-        board[i*7][0] = std::unique_ptr<Piece>(new Rook(static_cast<COLOR>(i)));
-        //std::cout << board[0][i*7]->get_type();
-        board[i*7][1] = std::unique_ptr<Piece>(new Knight(static_cast<COLOR>(i)));
-        board[i*7][2] = std::unique_ptr<Piece>(new Bishop(static_cast<COLOR>(i)));
-        board[i*7][3] = std::unique_ptr<Piece>(new Queen(static_cast<COLOR>(i)));
-        board[i*7][4] = std::unique_ptr<Piece>(new King(static_cast<COLOR>(i)));
-        board[i*7][5] = std::unique_ptr<Piece>(new Bishop(static_cast<COLOR>(i)));
-        board[i*7][6] = std::unique_ptr<Piece>(new Knight(static_cast<COLOR>(i)));
-        board[i*7][7] = std::unique_ptr<Piece>(new Rook(static_cast<COLOR>(i)));
-    }
-
-    for (i = 0; i<=1; i++) {
-        board[i*5+1][0] = std::unique_ptr<Piece>(new Pawn(static_cast<COLOR>(i)));
-        board[i*5+1][1] = std::unique_ptr<Piece>(new Pawn(static_cast<COLOR>(i)));
-        board[i*5+1][2] = std::unique_ptr<Piece>(new Pawn(static_cast<COLOR>(i)));
-        board[i*5+1][3] = std::unique_ptr<Piece>(new Pawn(static_cast<COLOR>(i)));
-        board[i*5+1][4] = std::unique_ptr<Piece>(new Pawn(static_cast<COLOR>(i)));
-        board[i*5+1][5] = std::unique_ptr<Piece>(new Pawn(static_cast<COLOR>(i)));
-        board[i*5+1][6] = std::unique_ptr<Piece>(new Pawn(static_cast<COLOR>(i)));
-        board[i*5+1][7] = std::unique_ptr<Piece>(new Pawn(static_cast<COLOR>(i)));
-    }
-
-    // use nullptr for empty squares?
-    for (i = 2; i<6; i++) {
-        for (j = 0; j<8; j++) {
-            board[i][j] = std::make_unique<Piece>(NO_COLOR);
+bool is_legal(const Position &position, PackedMove move) {
+    return position.side_to_move == WHITE ? is_legal_for<WHITE>(position, move) : is_legal_for<BLACK>(position, move);
+}
+
+PackedMove parse_uci(const Position &position, std::string_view uci) {
+    PackedMove move;
+    COLOR them = position.side_to_move == WHITE ? BLACK : WHITE;
+    int from, to, flags = QUIET, type, promotion = EMPTY;
+
+    if (uci.size() < 4 || uci.size() > 5 || index(uci[0]) > 7 || index(uci[2]) > 7 ||
+        uci[1] < '1' || uci[1] > '8' || uci[3] < '1' || uci[3] > '8') {
+        return NULL_MOVE;
+    }
+    from = make_square(uci[1] - '1', uci[0] - 'a');
+    to = make_square(uci[3] - '1', uci[2] - 'a');
+    if (uci.size() == 5) {
+        promotion = piece_from_char(uci[4]);
+        if (promotion == EMPTY || promotion == PAWN || promotion == KING) {
+            return NULL_MOVE;
         }
     }
+
+    // UCI leaves the flags implicit, they follow from what stands on the board. is_legal then checks the lot
+    type = position.piece_on(from);
+    if (type == PAWN && to == position.ep_square && square_col(from) != square_col(to)) {
+        flags = EP_CAPTURE;
+    } else if (type == PAWN && abs(to - from) == 16) {
+        flags = DOUBLE_PUSH;
+    } else if (type == KING && abs(to - from) == 2) {
+        flags = to > from ? KING_CASTLE : QUEEN_CASTLE;
+    } else {
+        if (position.occupancy[them] & square_bb(to)) {
+            flags = CAPTURE;
+        }
+        if (promotion != EMPTY) {
+            flags |= KNIGHT_PROMOTION | (KNIGHT - promotion);
+        }
+    }
+    // a promotion letter on anything but a promotion is malformed, not ignored
+    if (promotion != EMPTY && !(flags & KNIGHT_PROMOTION)) {
+        return NULL_MOVE;
+    }
+    move = PackedMove(from, to, flags);
+    return is_legal(position, move) ? move : NULL_MOVE;
+}
+
+std::string_view next_token(std::string_view &rest) {
+    size_t start = rest.find_first_not_of(" \t\r"), end;
+    std::string_view token;
+
+    if (start == std::string_view::npos) {
+        rest = std::string_view();
+        return rest;
+    }
+    end = rest.find_first_of(" \t\r", start);
+    if (end == std::string_view::npos) {
+        end = rest.size();
+    }
+    token = rest.substr(start, end - start);
+    rest.remove_prefix(end);
+    return token;
+}
+
+// End move generator implementations
+
+// castling rights that survive a move touching the given square (king or rook leaving, rook being captured)
+static const std::array<uint8_t, 64> CASTLING_MASK = [] {
+    std::array<uint8_t, 64> mask {};
+    mask.fill(ALL_CASTLING);
+    mask[make_square(0, 0)] &= ~WHITE_OOO;
+    mask[make_square(0, 4)] &= ~(WHITE_OO | WHITE_OOO);
+    mask[make_square(0, 7)] &= ~WHITE_OO;
+    mask[make_square(7, 0)] &= ~BLACK_OOO;
+    mask[make_square(7, 4)] &= ~(BLACK_OO | BLACK_OOO);
+    mask[make_square(7, 7)] &= ~BLACK_OO;
+    return mask;
+}();
+
+// rotates a bitboard by 180 degrees, i.e. square s goes to square 63-s
+static Bitboard rotate_180(Bitboard b) {
+    b = ((b >> 1) & 0x5555555555555555ULL) | ((b & 0x5555555555555555ULL) << 1);
+    b = ((b >> 2) & 0x3333333333333333ULL) | ((b & 0x3333333333333333ULL) << 2);
+    b = ((b >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((b & 0x0F0F0F0F0F0F0F0FULL) << 4);
+    return __builtin_bswap64(b);
+}
+
+// Begin make move implementations
+template <COLOR Us>
+static void make_move_for(Position &position, PackedMove move, UndoState &undo) {
+    typedef SideTraits<Us> side;
+    constexpr COLOR them = side::them;
+    int from = move.from(), to = move.to(), flags = move.flags();
+    PIECE_TYPE moved = type_on<Us>(position, from), captured = EMPTY;
+
+    undo.move = move;
+    undo.moved_piece = moved;
+    undo.castling = position.castling;
+    undo.ep_square = position.ep_square;
+    undo.halfmove_clock = position.halfmove_clock;
+    undo.key = position.key;
+
+    // the piece helpers keep the key in step with the bitboards, the rest of the state is hashed here
+    if (position.ep_square != NO_SQUARE && (pawn_attacks(them, position.ep_square) & position.pieces[Us][PAWN])) {
+        position.key ^= ZOBRIST.ep_file[square_col(position.ep_square)];
+    }
+    position.key ^= ZOBRIST.castling[position.castling] ^ ZOBRIST.side;
+
+    if (flags == EP_CAPTURE) {
+        // the captured pawn sits right behind the square the pawn moves to
+        captured = PAWN;
+        position.remove_piece(them, PAWN, to - side::up);
+    } else if (move.is_capture()) {
+        captured = type_on<them>(position, to);
+        position.remove_piece(them, captured, to);
+    }
+    undo.captured_piece = captured;
+
+    if (move.is_promotion()) {
+        position.remove_piece(Us, PAWN, from);
+        position.put_piece(Us, move.promotion_piece(), to);
+    } else {
+        position.move_piece(Us, moved, from, to);
+    }
+
+    // the rook comes from the corner the king moved towards and lands on the square the king passed over
+    if (flags == KING_CASTLE) {
+        position.move_piece(Us, ROOK, side::home + 7, side::home + 5);
+    } else if (flags == QUEEN_CASTLE) {
+        position.move_piece(Us, ROOK, side::home, side::home + 3);
+    }
+
+    position.ep_square = NO_SQUARE;
+    if (flags == DOUBLE_PUSH) {
+        position.ep_square = (int8_t) (from + side::up);
+        if (pawn_attacks(Us, position.ep_square) & position.pieces[them][PAWN]) {
+            position.key ^= ZOBRIST.ep_file[square_col(position.ep_square)];
+        }
+    }
+    if (moved == PAWN || captured != EMPTY) {
+        position.halfmove_clock = 0;
+    } else if (position.halfmove_clock < 255) {
+        position.halfmove_clock++;
+    }
+    position.castling &= CASTLING_MASK[from] & CASTLING_MASK[to];
+    position.side_to_move = them;
+    position.key ^= ZOBRIST.castling[position.castling];
+    assert(position.key == position.compute_key());
+    assert(position.psqt == position.compute_psqt());
+}
+
+void Position::make_move(PackedMove move, UndoState &undo) {
+    PROFILE_SCOPE(TIMER_MAKE_MOVE);
+    PROFILE_COUNT(PROFILE_MAKE_MOVES, 1);
+    if (side_to_move == WHITE) {
+        make_move_for<WHITE>(*this, move, undo);
+    } else {
+        make_move_for<BLACK>(*this, move, undo);
+    }
+}
+
+void Position::make_null(UndoState &undo) {
+    PROFILE_COUNT(PROFILE_NULL_MOVES, 1);
+    undo.move = NULL_MOVE;
+    undo.moved_piece = EMPTY;
+    undo.captured_piece = EMPTY;
+    undo.castling = castling;
+    undo.ep_square = ep_square;
+    undo.halfmove_clock = halfmove_clock;
+    undo.key = key;
+
+    if (ep_capturable()) {
+        key ^= ZOBRIST.ep_file[square_col(ep_square)];
+    }
+    key ^= ZOBRIST.side;
+    ep_square = NO_SQUARE;
+    if (halfmove_clock < 255) {
+        halfmove_clock++;
+    }
+    side_to_move ^= 1;
+    assert(key == compute_key());
+    assert(psqt == compute_psqt());
+}
+
+void Position::unmake_null(const UndoState &undo) {
+    side_to_move ^= 1;
+    ep_square = undo.ep_square;
+    halfmove_clock = undo.halfmove_clock;
+    key = undo.key;
+}
+
+template <COLOR Us>
+static void unmake_move_for(Position &position, const UndoState &undo) {
+    typedef SideTraits<Us> side;
+    constexpr COLOR them = side::them;
+    PackedMove move = undo.move;
+    int from = move.from(), to = move.to(), flags = move.flags();
+
+    if (move.is_promotion()) {
+        position.remove_piece(Us, move.promotion_piece(), to);
+        position.put_piece(Us, PAWN, from);
+    } else {
+        position.move_piece(Us, static_cast<PIECE_TYPE>(undo.moved_piece), to, from);
+    }
+
+    if (flags == KING_CASTLE) {
+        position.move_piece(Us, ROOK, side::home + 5, side::home + 7);
+    } else if (flags == QUEEN_CASTLE) {
+        position.move_piece(Us, ROOK, side::home + 3, side::home);
+    }
+
+    if (flags == EP_CAPTURE) {
+        position.put_piece(them, PAWN, to - side::up);
+    } else if (undo.captured_piece != EMPTY) {
+        position.put_piece(them, static_cast<PIECE_TYPE>(undo.captured_piece), to);
+    }
+
+    position.castling = undo.castling;
+    position.ep_square = undo.ep_square;
+    position.halfmove_clock = undo.halfmove_clock;
+    position.side_to_move = Us;
+    position.key = undo.key;
+    assert(position.key == position.compute_key());
+    assert(position.psqt == position.compute_psqt());
+}
+
+void Position::unmake_move(const UndoState &undo) {
+    PROFILE_SCOPE(TIMER_UNMAKE_MOVE);
+    PROFILE_COUNT(PROFILE_UNMAKE_MOVES, 1);
+    // the side that made the move is the one not to move now
+    if (side_to_move == BLACK) {
+        unmake_move_for<WHITE>(*this, undo);
+    } else {
+        unmake_move_for<BLACK>(*this, undo);
+    }
+}
+
+Position Position::after(PackedMove move) const {
+    Position child = *this;
+    UndoState undo;
+
+    child.make_move(move, undo);
+    return child;
+}
+// End make move implementations
+
+// Begin Board function implementations
+Board::Board() {
+    // instantiate board
+    reset();
 };
 
-void Board::mirror() {
-    int i, j, color1, color2;
-    std::unique_ptr<Piece> ptr1, ptr2;
+// a full undo stack drops its older half. nothing pops back that far, and repetitions only look back to the last
+// capture or pawn move, so all that goes is the start of a very long game
+void Board::make_room() {
+    const int dropped = MAX_GAME_PLY / 2;
 
-    for (i = 0; i < 4; i++) {
-        for (j = 0; j < 8; j++) {
-            ptr1 = static_cast<std::unique_ptr<Piece> &&>(board[7 - i][7 - j]);
-            ptr2 = static_cast<std::unique_ptr<Piece> &&>(board[i][j]);
+    std::memmove(history.data(), history.data() + dropped, (ply - dropped) * sizeof(UndoState));
+    ply -= dropped;
+    first_fullmove += dropped / 2;
+}
+
+void Board::push(PackedMove move) {
+    if (ply == MAX_GAME_PLY) {
+        make_room();
+    }
+    position.make_move(move, history[ply++]);
+}
+
+void Board::push_null() {
+    if (ply == MAX_GAME_PLY) {
+        make_room();
+    }
+    position.make_null(history[ply++]);
+}
+
+void Board::pop_null() {
+    position.unmake_null(history[--ply]);
+}
+
+void Board::push(std::unique_ptr<Move> move) {
+    push(pack_move(*move));
+}
+
+void Board::pop() {
+    position.unmake_move(history[--ply]);
+}
+
+PackedMove Board::pack_move(Move &move) const {
+    int from, to, deltax, flags = QUIET;
 
-            board[i][j] = std::move(ptr1);
-            board[7-i][7-j] = std::move(ptr2);
+    from = make_square(move.from_square[0], move.from_square[1]);
+    to = make_square(move.to_square[0], move.to_square[1]);
+    deltax = move.to_square[1] - move.from_square[1];
+
+    move.old_piece = position.piece_on(from);
+    // note that by default no checks are done to ensure that castling or any moves in particular are legal
+    // a king moving two files is a castle, a pawn moving diagonally onto an empty square is an en-passant capture
+    move.castle = move.old_piece == KING && abs(deltax) == 2;
+    move.en_passant = move.old_piece == PAWN && deltax != 0 && position.piece_on(to) == EMPTY;
+
+    if (move.castle) {
+        flags = deltax > 0 ? KING_CASTLE : QUEEN_CASTLE;
+    } else if (move.en_passant) {
+        flags = EP_CAPTURE;
+    } else {
+        if (move.old_piece == PAWN && abs(move.to_square[0] - move.from_square[0]) == 2) {
+            flags = DOUBLE_PUSH;
+        }
+        if (move.promotion) {
+            flags = KNIGHT_PROMOTION | (KNIGHT - move.new_piece);
+        }
+        if (position.piece_on(to) != EMPTY) {
+            flags |= CAPTURE;
         }
     }
+    return PackedMove(from, to, flags);
+}
+
+int Board::get_ply() const {
+    return ply;
+}
+
+PackedMove Board::last_move() const {
+    return ply > 0 ? history[ply-1].move : NULL_MOVE;
+}
+
+const UndoState &Board::last_undo() const {
+    assert(ply > 0);
+    return history[ply-1];
+}
+
+uint64_t Board::key() const {
+    return position.key;
+}
+
+PackedMove Board::parse_uci(std::string_view uci) const {
+    return ::parse_uci(position, uci);
+}
+
+bool Board::push_uci(std::string_view uci) {
+    PackedMove move = ::parse_uci(position, uci);
+
+    if (move == NULL_MOVE) {
+        return false;
+    }
+    push(move);
+    return true;
+}
+
+void Board::legal_moves(MoveList &list) const {
+    list.size = generate_legal_moves(position, list.moves.data());
+}
+
+bool Board::in_check() const {
+    return position.in_check();
+}
+
+int Board::repetitions() const {
+    int count = 0, back, limit = std::min((int) position.halfmove_clock, ply);
+
+    // the side to move has to match, so only every second position can repeat this one
+    for (back = 2; back <= limit; back += 2) {
+        if (history[ply - back + 1].move == NULL_MOVE || history[ply - back].move == NULL_MOVE) {
+            break;
+        }
+        count += history[ply - back].key == position.key;
+    }
+    return count;
+}
+
+bool Board::is_draw() const {
+    // a repetition needs four reversible plies at least
+    return position.halfmove_clock >= 100 || (position.halfmove_clock >= 4 && repetitions() > 0) || position.insufficient_material();
+}
+
+GAME_STATUS Board::status() const {
+    PackedMove moves[MAX_MOVES];
+
+    if (generate_legal_moves(position, moves) == 0) {
+        return in_check() ? GAME_CHECKMATE : GAME_STALEMATE;
+    }
+    if (position.halfmove_clock >= 100) {
+        return GAME_FIFTY_MOVES;
+    }
+    if (repetitions() >= 2) {
+        return GAME_REPETITION;
+    }
+    if (position.insufficient_material()) {
+        return GAME_INSUFFICIENT_MATERIAL;
+    }
+    return GAME_ONGOING;
+}
+
+GAME_RESULT Board::result() const {
+    GAME_STATUS state = status();
+
+    if (state == GAME_ONGOING) {
+        return RESULT_UNKNOWN;
+    }
+    if (state == GAME_CHECKMATE) {
+        return position.side_to_move == WHITE ? RESULT_BLACK_WINS : RESULT_WHITE_WINS;
+    }
+    return RESULT_DRAW;
+}
+
+void Board::reset() {
+    position.set_startpos();
+    ply = 0;
+    first_fullmove = 1;
 };
 
-void Board::switch_colors() {
-    int i, j, color1, color2;
-    std::unique_ptr<Piece> ptr1, ptr2;
+bool Board::set_fen(std::string_view fen) {
+    FenResult result = parse_fen(fen, position);
 
-    for (i = 0; i < 4; i++) {
-        for (j = 0; j < 8; j++) {
-            ptr1 = static_cast<std::unique_ptr<Piece> &&>(board[7 - i][7 - j]);
-            ptr2 = static_cast<std::unique_ptr<Piece> &&>(board[i][j]);
-            color1 = ptr1->get_color();
-            color2 = ptr2->get_color();
+    if (!result.ok) {
+        reset();
+        return false;
+    }
+    ply = 0;
+    first_fullmove = result.fullmove_number;
+    return true;
+}
 
-            // if piece is not empty-square type
+std::string Board::get_fen() const {
+    return position.get_fen(fullmove_number());
+}
 
-            if (color1 != -1) {
-                color1++;
-                color1 %= 2;
-            }
+int Board::fullmove_number() const {
+    // the colour that moved first is whoever is to move now, flipped once per move on the stack
+    int black_started = (position.side_to_move == BLACK) ^ (ply & 1);
+    return first_fullmove + (ply + black_started) / 2;
+}
 
-            if (color2 != -1) {
-                color2++;
-                color2 %= 2;
-            }
+void Board::mirror() {
+    int i, j;
 
-            ptr1->set_color(static_cast<COLOR>(color1));
-            ptr2->set_color(static_cast<COLOR>(color2));
-            board[i][j] = std::move(ptr2);
-            board[7-i][7-j] = std::move(ptr1);
+    for (i = 0; i < 2; i++) {
+        for (j = 0; j < 6; j++) {
+            position.pieces[i][j] = rotate_180(position.pieces[i][j]);
         }
+        position.occupancy[i] = rotate_180(position.occupancy[i]);
+    }
+    // the kings and rooks are no longer on their home squares
+    position.castling = NO_CASTLING;
+    position.ep_square = NO_SQUARE;
+    position.key = position.compute_key();
+    position.psqt = position.compute_psqt();
+};
+
+void Board::switch_colors() {
+    int j;
+
+    for (j = 0; j < 6; j++) {
+        std::swap(position.pieces[WHITE][j], position.pieces[BLACK][j]);
+        position.pieces[WHITE][j] = rotate_180(position.pieces[WHITE][j]);
+        position.pieces[BLACK][j] = rotate_180(position.pieces[BLACK][j]);
+    }
+    std::swap(position.occupancy[WHITE], position.occupancy[BLACK]);
+    position.occupancy[WHITE] = rotate_180(position.occupancy[WHITE]);
+    position.occupancy[BLACK] = rotate_180(position.occupancy[BLACK]);
+
+    // the rotated en-passant square still sits behind the (now recoloured) pawn, castling squares don't survive the rotation
+    if (position.ep_square != NO_SQUARE) {
+        position.ep_square = 63 - position.ep_square;
     }
+    position.castling = NO_CASTLING;
+    position.side_to_move = position.side_to_move == WHITE ? BLACK : WHITE;
+    position.key = position.compute_key();
+    position.psqt = position.compute_psqt();
 };
 
+const Position &Board::get_position() const {
+    return position;
+}
+
+void Board::set_position(const Position &new_position, int fullmove_number) {
+    position = new_position;
+    ply = 0;
+    first_fullmove = fullmove_number;
+}
+
+void Board::fork(Board &child) const {
+    // moves before the last capture or pawn move can't come back, so only the reversible tail is copied
+    int tail = std::min((int) position.halfmove_clock, ply);
+    int black_started = (position.side_to_move == BLACK) ^ (tail & 1);
+
+    child.position = position;
+    child.ply = tail;
+    child.first_fullmove = fullmove_number() - (tail + black_started) / 2;
+    std::memcpy(child.history.data(), history.data() + (ply - tail), tail * sizeof(UndoState));
+}
+
+BoardView Board::view() const {
+    return BoardView(position, fullmove_number());
+}
+
 std::unique_ptr<std::array<std::array<std::unique_ptr<Piece>, 8>, 8>> Board::get_state() {
-    // sus
-    return std::unique_ptr<std::array<std::array<std::unique_ptr<Piece>, 8>, 8>>(&board);;
+    int i, j;
+    std::unique_ptr<std::array<std::array<std::unique_ptr<Piece>, 8>, 8>> state;
+
+    // the caller owns a fresh copy, the bitboards are left untouched
+    state = std::make_unique<std::array<std::array<std::unique_ptr<Piece>, 8>, 8>>();
+    for (i = 0; i < 8; i++) {
+        for (j = 0; j < 8; j++) {
+            (*state)[i][j] = create_piece(position.piece_on(make_square(i, j)), position.color_on(make_square(i, j)));
+        }
+    }
+    return state;
 }
 
 void Board::set_state(std::array<std::array<std::unique_ptr<Piece>, 8>, 8> i_board) {
-    board = static_cast<std::array<std::array<std::unique_ptr<Piece>, 8>, 8> &&>(i_board);
+    int i, j;
+    COLOR side = static_cast<COLOR>(position.side_to_move);
+    uint8_t castling = position.castling;
+
+    // the undo stack belongs to the old pieces, the move number carries on from where the board was
+    first_fullmove = fullmove_number();
+    ply = 0;
+    position.clear();
+    position.side_to_move = side;
+    for (i = 0; i < 8; i++) {
+        for (j = 0; j < 8; j++) {
+            if (i_board[i][j] && i_board[i][j]->get_type() != EMPTY) {
+                position.put_piece(i_board[i][j]->get_color(), i_board[i][j]->get_type(), make_square(i, j));
+            }
+        }
+    }
+
+    // keep whichever of the old castling rights still have their king and rook at home
+    if (position.pieces[WHITE][KING] & square_bb(make_square(0, 4))) {
+        if (position.pieces[WHITE][ROOK] & square_bb(make_square(0, 7))) position.castling |= WHITE_OO;
+        if (position.pieces[WHITE][ROOK] & square_bb(make_square(0, 0))) position.castling |= WHITE_OOO;
+    }
+    if (position.pieces[BLACK][KING] & square_bb(make_square(7, 4))) {
+        if (position.pieces[BLACK][ROOK] & square_bb(make_square(7, 7))) position.castling |= BLACK_OO;
+        if (position.pieces[BLACK][ROOK] & square_bb(make_square(7, 0))) position.castling |= BLACK_OOO;
+    }
+    position.castling &= castling;
+    position.key = position.compute_key();
 }
 
 void Board::print_board() {
@@ -383,12 +1372,11 @@ void Board::print_board() {
     int type, color;
     for (i = 0; i < 8; i++) {
         for (j = 0; j < 8; j++) {
-            type = board[i][j]->get_type();
-            color = board[i][j]->get_color();
-            //std::cout << type << " " << color << std::endl;
+            type = position.piece_on(make_square(i, j));
+            color = position.color_on(make_square(i, j));
 
             if (type != -1) {
-                std::cout << NAME_TABLE[color*5+1+color+type] << ' ';
+                std::cout << NAME_TABLE[color*6+1+type] << ' ';
             } else {
                 std::cout << ". ";
             }
@@ -396,4 +1384,56 @@ void Board::print_board() {
         std::cout << std::endl;
     }
 }
-// End Board function implementations
\ No newline at end of file
+// End Board function implementations
+
+// Begin BoardView function implementations
+BoardView::BoardView(const Position &position, int fullmove_number) : viewed(&position), fullmove(fullmove_number) {}
+
+const Position &BoardView::get_position() const {
+    return *viewed;
+}
+
+COLOR BoardView::side_to_move() const {
+    return static_cast<COLOR>(viewed->side_to_move);
+}
+
+PIECE_TYPE BoardView::piece_on(int sq) const {
+    return viewed->piece_on(sq);
+}
+
+COLOR BoardView::color_on(int sq) const {
+    return viewed->color_on(sq);
+}
+
+uint64_t BoardView::key() const {
+    return viewed->key;
+}
+
+bool BoardView::in_check() const {
+    return viewed->in_check();
+}
+
+void BoardView::legal_moves(MoveList &list) const {
+    list.size = generate_legal_moves(*viewed, list.moves.data());
+}
+
+bool BoardView::is_legal(PackedMove move) const {
+    return ::is_legal(*viewed, move);
+}
+
+PackedMove BoardView::parse_uci(std::string_view uci) const {
+    return ::parse_uci(*viewed, uci);
+}
+
+Position BoardView::after(PackedMove move) const {
+    return viewed->after(move);
+}
+
+int BoardView::fullmove_number() const {
+    return fullmove;
+}
+
+std::string BoardView::get_fen() const {
+    return viewed->get_fen(fullmove);
+}
+// End BoardView function implementations
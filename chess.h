@@ -2,33 +2,292 @@
 
 #include <array>
 #include <vector>
-#include <stack>
 #include <algorithm>
 #include <memory>
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <type_traits>
 
 #ifndef CPP_CHESS_LIBRARY_H
 #define CPP_CHESS_LIBRARY_H
 
 typedef enum {EMPTY = -1, KING, QUEEN, ROOK, BISHOP, KNIGHT, PAWN} PIECE_TYPE;
 typedef enum {NO_COLOR = -1, WHITE, BLACK} COLOR;
-std::array<char, 8> COLUMN_LETTERS {'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h'};
-std::array<char, 13> NAME_TABLE = {'.', 'k', 'q', 'r', 'b', 'n', 'p', 'K', 'Q', 'R', 'B', 'N', 'P'};
+// castling rights are stored as a 4 bit mask
+typedef enum {NO_CASTLING = 0, WHITE_OO = 1, WHITE_OOO = 2, BLACK_OO = 4, BLACK_OOO = 8, ALL_CASTLING = 15} CASTLING_RIGHT;
+// result as PGN records it, RESULT_UNKNOWN for games still in progress or abandoned ("*")
+typedef enum {RESULT_UNKNOWN, RESULT_WHITE_WINS, RESULT_BLACK_WINS, RESULT_DRAW} GAME_RESULT;
+// why a game is over, GAME_ONGOING while it isn't
+typedef enum {
+    GAME_ONGOING, GAME_CHECKMATE, GAME_STALEMATE, GAME_FIFTY_MOVES, GAME_REPETITION, GAME_INSUFFICIENT_MATERIAL
+} GAME_STATUS;
+const std::array<char, 8> COLUMN_LETTERS {'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h'};
+const std::array<char, 13> NAME_TABLE = {'.', 'k', 'q', 'r', 'b', 'n', 'p', 'K', 'Q', 'R', 'B', 'N', 'P'};
+
+// squares are numbered row*8+col, so row 0 col 0 (a1) is bit 0 and row 7 col 7 (h8) is bit 63
+typedef uint64_t Bitboard;
+const int NO_SQUARE = -1;
+
+constexpr int make_square(int row, int col) {
+    return row*8 + col;
+}
+
+constexpr int square_row(int sq) {
+    return sq >> 3;
+}
+
+constexpr int square_col(int sq) {
+    return sq & 7;
+}
+
+constexpr Bitboard square_bb(int sq) {
+    return 1ULL << sq;
+}
+
+constexpr int popcount(Bitboard b) {
+    return __builtin_popcountll(b);
+}
+
+constexpr int lsb(Bitboard b) {
+    return __builtin_ctzll(b);
+}
+
+inline int pop_lsb(Bitboard &b) {
+    int sq = lsb(b);
+    b &= b - 1;
+    return sq;
+}
+
+// move flags, stored in the top four bits of a PackedMove
+// bit 2 marks captures and bit 3 marks promotions, the low two bits of a promotion select the new piece
+typedef enum {
+    QUIET = 0, DOUBLE_PUSH = 1, KING_CASTLE = 2, QUEEN_CASTLE = 3, CAPTURE = 4, EP_CAPTURE = 5,
+    KNIGHT_PROMOTION = 8, BISHOP_PROMOTION = 9, ROOK_PROMOTION = 10, QUEEN_PROMOTION = 11,
+    KNIGHT_PROMO_CAPTURE = 12, BISHOP_PROMO_CAPTURE = 13, ROOK_PROMO_CAPTURE = 14, QUEEN_PROMO_CAPTURE = 15
+} MOVE_FLAG;
+
+// longest game the undo stack can hold, in plies
+const int MAX_GAME_PLY = 1024;
+// no position has more than 218 legal moves
+const int MAX_MOVES = 256;
+
+const Bitboard FILE_A = 0x0101010101010101ULL;
+const Bitboard FILE_H = FILE_A << 7;
+const Bitboard ROW_1 = 0xFFULL;
+const Bitboard ROW_8 = ROW_1 << 56;
+
+// the attack tables are built by the compiler (see the attack table implementations in chess.cpp), they sit in
+// read-only data and nothing fills them in at startup
+struct Magic {
+    Bitboard mask;
+    Bitboard magic;
+    const Bitboard *attacks;
+    int shift;
+};
+
+extern const std::array<std::array<Bitboard, 64>, 2> PAWN_ATTACKS;
+extern const std::array<Bitboard, 64> KNIGHT_ATTACKS;
+extern const std::array<Bitboard, 64> KING_ATTACKS;
+extern const std::array<Magic, 64> ROOK_MAGICS;
+extern const std::array<Magic, 64> BISHOP_MAGICS;
+// squares strictly between two aligned squares, and the whole line through them (empty when not aligned)
+extern const std::array<std::array<Bitboard, 64>, 64> BETWEEN_BB;
+extern const std::array<std::array<Bitboard, 64>, 64> LINE_BB;
+
+inline Bitboard pawn_attacks(COLOR color, int sq) {
+    return PAWN_ATTACKS[color][sq];
+}
+
+inline Bitboard knight_attacks(int sq) {
+    return KNIGHT_ATTACKS[sq];
+}
+
+inline Bitboard king_attacks(int sq) {
+    return KING_ATTACKS[sq];
+}
+
+inline Bitboard rook_attacks(int sq, Bitboard occupied) {
+    const Magic &m = ROOK_MAGICS[sq];
+    return m.attacks[((occupied & m.mask) * m.magic) >> m.shift];
+}
+
+inline Bitboard bishop_attacks(int sq, Bitboard occupied) {
+    const Magic &m = BISHOP_MAGICS[sq];
+    return m.attacks[((occupied & m.mask) * m.magic) >> m.shift];
+}
+
+inline Bitboard queen_attacks(int sq, Bitboard occupied) {
+    return rook_attacks(sq, occupied) | bishop_attacks(sq, occupied);
+}
+
+// attacks of a piece type known at compile time, so code templated on the type carries no branch for it
+template <PIECE_TYPE Type>
+inline Bitboard piece_attacks(int sq, Bitboard occupied) {
+    static_assert(Type != PAWN && Type != EMPTY, "pawn attacks depend on the color");
+    if constexpr (Type == KING) {
+        return king_attacks(sq);
+    } else if constexpr (Type == KNIGHT) {
+        return knight_attacks(sq);
+    } else if constexpr (Type == BISHOP) {
+        return bishop_attacks(sq, occupied);
+    } else if constexpr (Type == ROOK) {
+        return rook_attacks(sq, occupied);
+    } else {
+        return queen_attacks(sq, occupied);
+    }
+}
 
 // Name Declarations
 class Board;
+class BoardView;
+struct PackedMove;
+struct UndoState;
 class Piece;
 // End Name Declarations
 
+// middlegame and endgame halves of a score, the evaluation blends them by game phase
+struct PsqtScore {
+    int16_t mg;
+    int16_t eg;
+
+    PsqtScore &operator+=(PsqtScore other) {
+        mg = (int16_t) (mg + other.mg);
+        eg = (int16_t) (eg + other.eg);
+        return *this;
+    }
+    PsqtScore &operator-=(PsqtScore other) {
+        mg = (int16_t) (mg - other.mg);
+        eg = (int16_t) (eg - other.eg);
+        return *this;
+    }
+    bool operator==(PsqtScore other) const { return mg == other.mg && eg == other.eg; }
+};
+
+// compact value type holding everything needed to describe a position, no heap allocation involved
+struct Position {
+    // one bitboard per (color, piece type) pair, indexed by the COLOR and PIECE_TYPE enums
+    std::array<std::array<Bitboard, 6>, 2> pieces;
+    std::array<Bitboard, 2> occupancy;
+    uint8_t side_to_move;
+    uint8_t castling;
+    // square skipped over by the last double pawn push, or NO_SQUARE
+    int8_t ep_square;
+    // plies since the last capture or pawn move, saturates at 255
+    uint8_t halfmove_clock;
+    // material plus piece-square score, white minus black, kept up to date by the piece helpers like the key
+    PsqtScore psqt;
+    // zobrist key of the pieces, side to move, castling rights and en-passant file, kept up to date by the
+    // piece helpers below and by make_move/unmake_move
+    uint64_t key;
+
+    void clear();
+    void set_startpos();
+    Bitboard occupied() const;
+    COLOR color_on(int sq) const;
+    PIECE_TYPE piece_on(int sq) const;
+    void put_piece(COLOR color, PIECE_TYPE type, int sq);
+    void remove_piece(COLOR color, PIECE_TYPE type, int sq);
+    void move_piece(COLOR color, PIECE_TYPE type, int from, int to);
+    // the key built from scratch, the en-passant file only counts when a pawn could actually take
+    uint64_t compute_key() const;
+    PsqtScore compute_psqt() const;
+    bool ep_capturable() const;
+    // loads the first five FEN fields (the fullmove number is left to Board), false if the string can't be parsed
+    bool set_fen(std::string_view fen);
+    std::string get_fen(int fullmove_number = 1) const;
+    int king_square(COLOR color) const;
+    // pieces of both colors attacking sq, with the given occupancy used to block sliders
+    Bitboard attackers_to(int sq, Bitboard occupied) const;
+    bool in_check() const;
+    // neither side can ever mate: bare kings, a single minor piece, or bishops that all stand on one colour
+    bool insufficient_material() const;
+    // plays the move (which must be legal), undo gets what unmake_move needs to take it back
+    void make_move(PackedMove move, UndoState &undo);
+    void unmake_move(const UndoState &undo);
+    // passes the turn
+    void make_null(UndoState &undo);
+    void unmake_null(const UndoState &undo);
+    // copy-make: the position after the move, this one is left as it is
+    Position after(PackedMove move) const;
+};
+
+// two cache lines, copied around freely instead of being made and unmade
+static_assert(std::is_trivially_copyable<Position>::value, "Position is copied with memcpy");
+static_assert(sizeof(Position) == 128, "Position is meant to fill two cache lines");
+
+// 16 bit move used by the board internals: bits 0-5 from square, bits 6-11 to square, bits 12-15 MOVE_FLAG
+struct PackedMove {
+    uint16_t data;
+
+    PackedMove() = default;
+    constexpr PackedMove(int from, int to, int flags) : data((uint16_t) (from | (to << 6) | (flags << 12))) {}
+    int from() const { return data & 63; }
+    int to() const { return (data >> 6) & 63; }
+    int flags() const { return data >> 12; }
+    bool is_capture() const { return (data >> 12) & CAPTURE; }
+    bool is_promotion() const { return (data >> 12) & KNIGHT_PROMOTION; }
+    bool is_castle() const { return flags() == KING_CASTLE || flags() == QUEEN_CASTLE; }
+    PIECE_TYPE promotion_piece() const { return static_cast<PIECE_TYPE>(KNIGHT - ((data >> 12) & 3)); }
+    bool operator==(PackedMove other) const { return data == other.data; }
+    bool operator!=(PackedMove other) const { return data != other.data; }
+};
+
+// from a1 to a1 is never a real move
+const PackedMove NULL_MOVE = PackedMove(0, 0, QUIET);
+
+// writes the move in UCI notation ("e2e4", "a7a8q") as a NUL terminated string, out must hold 6 chars
+inline void format_uci(PackedMove move, char *out) {
+    out[0] = COLUMN_LETTERS[square_col(move.from())];
+    out[1] = (char) ('1' + square_row(move.from()));
+    out[2] = COLUMN_LETTERS[square_col(move.to())];
+    out[3] = (char) ('1' + square_row(move.to()));
+    out[4] = move.is_promotion() ? NAME_TABLE[1+(int) move.promotion_piece()] : '\0';
+    out[5] = '\0';
+}
+
+// everything push() destroys, kept per ply so that pop() can restore it without allocating
+struct UndoState {
+    PackedMove move;
+    int8_t moved_piece;
+    int8_t captured_piece;
+    uint8_t castling;
+    int8_t ep_square;
+    uint8_t halfmove_clock;
+    uint64_t key;
+};
+
+// fixed size buffer the move generator writes into
+struct MoveList {
+    std::array<PackedMove, MAX_MOVES> moves;
+    int size = 0;
+
+    PackedMove *begin() { return moves.data(); }
+    PackedMove *end() { return moves.data() + size; }
+    const PackedMove *begin() const { return moves.data(); }
+    const PackedMove *end() const { return moves.data() + size; }
+    bool contains(PackedMove move) const { return std::find(begin(), end(), move) != end(); }
+};
+
+// writes every legal move of the side to move into moves (which must hold MAX_MOVES entries), returns the count
+int generate_legal_moves(const Position &position, PackedMove *moves);
+// true if the move (flags included) is one generate_legal_moves would produce, without generating anything
+bool is_legal(const Position &position, PackedMove move);
+// resolves a UCI move ("e2e4", "e1g1", "a7a8q") against the legal moves of the position, so castling, en-passant and
+// promotion flags come out right. NULL_MOVE if the text is malformed or the move is illegal
+PackedMove parse_uci(const Position &position, std::string_view uci);
+// splits the next space separated word off rest, for reading UCI commands and move lists. empty once rest is used up
+std::string_view next_token(std::string_view &rest);
+
 class Move {
 public:
     std::array<int, 2> from_square;
     std::array<int, 2> to_square;
     bool promotion;
-    bool castle;
-    bool en_passant;
-    PIECE_TYPE old_piece;
+    bool castle = false;
+    bool en_passant = false;
+    PIECE_TYPE old_piece = EMPTY;
     PIECE_TYPE new_piece;
-    std::unique_ptr<Piece> taken_piece;
 public:
     Move(std::array<int, 2> sq1, std::array<int, 2> sq2, bool is_promo, PIECE_TYPE f_piece = EMPTY);
     std::unique_ptr<std::string> get_uci();
@@ -40,7 +299,7 @@ private:
     // enums
     COLOR color;
     PIECE_TYPE type;
-    // used for king legal move detection
+    // not consulted by the move generator, kept for compatibility
     bool piece_protected = false;
 public:
     explicit Piece(COLOR col, PIECE_TYPE Type);
@@ -57,6 +316,7 @@ private:
     PIECE_TYPE type;
 public:
     explicit King(COLOR color);
+    // legal moves of the king standing on row r, column c (including castling)
     std::vector<std::unique_ptr<Move>> get_pseudo_legal_moves(Board *board_ptr, int r, int c);
 };
 
@@ -96,41 +356,114 @@ public:
 };
 
 
+const std::string STARTING_FEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
 class Board {
 private:
-    std::stack<std::unique_ptr<Move>> move_stack;
-    // array is better than vector here
-    std::array<std::array<std::unique_ptr<Piece>, 8>, 8> board;
+    Position position;
+    // number of moves on the undo stack
+    int ply;
+    // fullmove number of the position the stack starts from
+    int first_fullmove;
+    std::array<UndoState, MAX_GAME_PLY> history;
+    void make_room();
 public:
     Board();
+    void push(PackedMove move);
+    // converts the move with pack_move, the Move object itself is not kept
     void push(std::unique_ptr<Move> move);
     void pop();
+    // passes the turn (for null move pruning), undone with pop_null
+    void push_null();
+    void pop_null();
+    PackedMove pack_move(Move &move) const;
+    PackedMove parse_uci(std::string_view uci) const;
+    // pushes the move if it is legal
+    bool push_uci(std::string_view uci);
+    int get_ply() const;
+    PackedMove last_move() const;
+    // undo record of the last push, only valid with get_ply() > 0
+    const UndoState &last_undo() const;
+    uint64_t key() const;
+    void legal_moves(MoveList &list) const;
+    bool in_check() const;
+    // earlier occurrences of the current position, only looking back to the last capture, pawn move or null move
+    int repetitions() const;
+    // the game is a draw whatever the moves: fifty moves, a repetition (any, not just the third) or dead material.
+    // what the search wants, checkmate on the hundredth ply isn't told apart
+    bool is_draw() const;
+    // mate and stalemate first, as the rules have it, then the fifty move rule, threefold repetition and
+    // insufficient material
+    GAME_STATUS status() const;
+    GAME_RESULT result() const;
     void reset();
+    // replaces the position and clears the move stack, false (with the board reset) if the FEN is malformed
+    bool set_fen(std::string_view fen);
+    std::string get_fen() const;
     void mirror();
     void switch_colors();
+    const Position &get_position() const;
+    // replaces the position and clears the move stack
+    void set_position(const Position &new_position, int fullmove_number = 1);
+    // copies the board into child for another thread to play on. only the moves since the last capture or pawn
+    // move come along, which is all that repetitions() looks at, so a fork costs a few hundred bytes at most
+    void fork(Board &child) const;
+    BoardView view() const;
+    // fullmove number of the current position, as the FEN would give it
+    int fullmove_number() const;
+    // the piece arrays below are built from (and copied into) the bitboards, they are kept for compatibility
     std::unique_ptr<std::array<std::array<std::unique_ptr<Piece>, 8>, 8>> get_state();
     void set_state(std::array<std::array<std::unique_ptr<Piece>, 8>, 8> i_board);
     void print_board();
 };
 
-std::unique_ptr<Piece> create_piece(PIECE_TYPE type) {
+// the position and the undo stack are plain data, a whole Board can be copied with memcpy (fork copies less)
+static_assert(std::is_trivially_copyable<Board>::value, "Board is copied with memcpy");
+
+// read-only look at a position owned by someone else, a Board or a Position on a search stack. as cheap to pass
+// around as a pointer, and nothing it offers can change the position. it doesn't see the moves that led there
+class BoardView {
+public:
+    explicit BoardView(const Position &position, int fullmove_number = 1);
+    const Position &get_position() const;
+    COLOR side_to_move() const;
+    PIECE_TYPE piece_on(int sq) const;
+    COLOR color_on(int sq) const;
+    uint64_t key() const;
+    bool in_check() const;
+    void legal_moves(MoveList &list) const;
+    bool is_legal(PackedMove move) const;
+    PackedMove parse_uci(std::string_view uci) const;
+    // the position after the move, the viewed one is left as it is
+    Position after(PackedMove move) const;
+    int fullmove_number() const;
+    std::string get_fen() const;
+
+private:
+    const Position *viewed;
+    int fullmove;
+};
+
+inline std::unique_ptr<Piece> create_piece(PIECE_TYPE type, COLOR color = NO_COLOR) {
     if (type == PAWN) {
-        return std::unique_ptr<Piece>(new Pawn(NO_COLOR));
+        return std::unique_ptr<Piece>(new Pawn(color));
     } else if (type == KNIGHT) {
-        return std::unique_ptr<Piece>(new Knight(NO_COLOR));
+        return std::unique_ptr<Piece>(new Knight(color));
     } else if (type == BISHOP) {
-        return std::unique_ptr<Piece>(new Bishop(NO_COLOR));
+        return std::unique_ptr<Piece>(new Bishop(color));
     } else if (type == ROOK) {
-        return std::unique_ptr<Piece>(new Rook(NO_COLOR));
+        return std::unique_ptr<Piece>(new Rook(color));
     } else if (type == QUEEN) {
-        return std::unique_ptr<Piece>(new Queen(NO_COLOR));
+        return std::unique_ptr<Piece>(new Queen(color));
     } else if (type == KING) {
-        return std::unique_ptr<Piece>(new King(NO_COLOR));
+        return std::unique_ptr<Piece>(new King(color));
     }
-};
+    return std::unique_ptr<Piece>(new Piece(NO_COLOR, EMPTY));
+}
 
+// column of a file letter, 8 if it isn't one
 inline int index(char item) {
-    return std::distance(std::begin(COLUMN_LETTERS), std::find(std::begin(COLUMN_LETTERS), std::end(COLUMN_LETTERS), item));
+    return 'a' <= item && item <= 'h' ? item - 'a' : 8;
 }
 
 inline PIECE_TYPE piece_from_char(char piece) {
@@ -147,15 +480,17 @@ inline PIECE_TYPE piece_from_char(char piece) {
     } else if (piece == 'k') {
         return KING;
     }
+    return EMPTY;
 }
 
-std::unique_ptr<Move> move_from_uci(std::unique_ptr<std::string> uci) {
+// squares are {row, column}, where the row is the rank number minus one
+inline std::unique_ptr<Move> move_from_uci(std::unique_ptr<std::string> uci) {
     if (uci->length() == 4) {
-        return std::make_unique<Move>(new Move({index((*uci)[0]), (int) (*uci)[1]}, {index((*uci)[2]), (int) (*uci)[3]}, false));
+        return std::unique_ptr<Move>(new Move({(*uci)[1] - '1', index((*uci)[0])}, {(*uci)[3] - '1', index((*uci)[2])}, false));
     } else {
-        return std::make_unique<Move>(new Move({index((*uci)[0]), (int) (*uci)[1]}, {index((*uci)[2]), (int) (*uci)[3]}, true, piece_from_char((*uci)[4])));
+        return std::unique_ptr<Move>(new Move({(*uci)[1] - '1', index((*uci)[0])}, {(*uci)[3] - '1', index((*uci)[2])}, true, piece_from_char((*uci)[4])));
     }
 
 }
 
-#endif //CPP_CHESS_LIBRARY_H
\ No newline at end of file
+#endif //CPP_CHESS_LIBRARY_H
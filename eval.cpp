@@ -0,0 +1,137 @@
+#include "eval.h"
+
+// material in the middlegame and the endgame, indexed by PIECE_TYPE
+static constexpr int MG_VALUES[6] = {0, 1025, 477, 365, 337, 82};
+static constexpr int EG_VALUES[6] = {0, 936, 512, 297, 281, 94};
+
+// piece-square bonuses from white's point of view, laid out as the board is printed: row 8 first, a file first.
+// the middlegame tables serve the endgame as well, except for the pawns and the king
+static constexpr int PAWN_MG[64] = {
+          0,   0,   0,   0,   0,   0,   0,   0,
+         50,  50,  50,  50,  50,  50,  50,  50,
+         10,  10,  20,  30,  30,  20,  10,  10,
+          5,   5,  10,  25,  25,  10,   5,   5,
+          0,   0,   0,  20,  20,   0,   0,   0,
+          5,  -5, -10,   0,   0, -10,  -5,   5,
+          5,  10,  10, -20, -20,  10,  10,   5,
+          0,   0,   0,   0,   0,   0,   0,   0,
+};
+
+static constexpr int PAWN_EG[64] = {
+          0,   0,   0,   0,   0,   0,   0,   0,
+         80,  80,  80,  80,  80,  80,  80,  80,
+         50,  50,  50,  50,  50,  50,  50,  50,
+         30,  30,  30,  30,  30,  30,  30,  30,
+         15,  15,  15,  15,  15,  15,  15,  15,
+          5,   5,   5,   5,   5,   5,   5,   5,
+          0,   0,   0,   0,   0,   0,   0,   0,
+          0,   0,   0,   0,   0,   0,   0,   0,
+};
+
+static constexpr int KNIGHT_TABLE[64] = {
+        -50, -40, -30, -30, -30, -30, -40, -50,
+        -40, -20,   0,   0,   0,   0, -20, -40,
+        -30,   0,  10,  15,  15,  10,   0, -30,
+        -30,   5,  15,  20,  20,  15,   5, -30,
+        -30,   0,  15,  20,  20,  15,   0, -30,
+        -30,   5,  10,  15,  15,  10,   5, -30,
+        -40, -20,   0,   5,   5,   0, -20, -40,
+        -50, -40, -30, -30, -30, -30, -40, -50,
+};
+
+static constexpr int BISHOP_TABLE[64] = {
+        -20, -10, -10, -10, -10, -10, -10, -20,
+        -10,   0,   0,   0,   0,   0,   0, -10,
+        -10,   0,   5,  10,  10,   5,   0, -10,
+        -10,   5,   5,  10,  10,   5,   5, -10,
+        -10,   0,  10,  10,  10,  10,   0, -10,
+        -10,  10,  10,  10,  10,  10,  10, -10,
+        -10,   5,   0,   0,   0,   0,   5, -10,
+        -20, -10, -10, -10, -10, -10, -10, -20,
+};
+
+static constexpr int ROOK_TABLE[64] = {
+          0,   0,   0,   0,   0,   0,   0,   0,
+          5,  10,  10,  10,  10,  10,  10,   5,
+         -5,   0,   0,   0,   0,   0,   0,  -5,
+         -5,   0,   0,   0,   0,   0,   0,  -5,
+         -5,   0,   0,   0,   0,   0,   0,  -5,
+         -5,   0,   0,   0,   0,   0,   0,  -5,
+         -5,   0,   0,   0,   0,   0,   0,  -5,
+          0,   0,   0,   5,   5,   0,   0,   0,
+};
+
+static constexpr int QUEEN_TABLE[64] = {
+        -20, -10, -10,  -5,  -5, -10, -10, -20,
+        -10,   0,   0,   0,   0,   0,   0, -10,
+        -10,   0,   5,   5,   5,   5,   0, -10,
+         -5,   0,   5,   5,   5,   5,   0,  -5,
+          0,   0,   5,   5,   5,   5,   0,  -5,
+        -10,   5,   5,   5,   5,   5,   0, -10,
+        -10,   0,   5,   0,   0,   0,   0, -10,
+        -20, -10, -10,  -5,  -5, -10, -10, -20,
+};
+
+// the king hides behind its pawns while there are pieces around and walks to the centre once they are gone
+static constexpr int KING_MG[64] = {
+        -30, -40, -40, -50, -50, -40, -40, -30,
+        -30, -40, -40, -50, -50, -40, -40, -30,
+        -30, -40, -40, -50, -50, -40, -40, -30,
+        -30, -40, -40, -50, -50, -40, -40, -30,
+        -20, -30, -30, -40, -40, -30, -30, -20,
+        -10, -20, -20, -20, -20, -20, -20, -10,
+         20,  20,   0,   0,   0,   0,  20,  20,
+         20,  30,  10,   0,   0,  10,  30,  20,
+};
+
+static constexpr int KING_EG[64] = {
+        -50, -40, -30, -20, -20, -30, -40, -50,
+        -30, -20, -10,   0,   0, -10, -20, -30,
+        -30, -10,  20,  30,  30,  20, -10, -30,
+        -30, -10,  30,  40,  40,  30, -10, -30,
+        -30, -10,  30,  40,  40,  30, -10, -30,
+        -30, -10,  20,  30,  30,  20, -10, -30,
+        -30, -30,   0,   0,   0,   0, -30, -30,
+        -50, -30, -30, -30, -30, -30, -30, -50,
+};
+
+static constexpr const int *MG_TABLES[6] = {KING_MG, QUEEN_TABLE, ROOK_TABLE, BISHOP_TABLE, KNIGHT_TABLE, PAWN_MG};
+static constexpr const int *EG_TABLES[6] = {KING_EG, QUEEN_TABLE, ROOK_TABLE, BISHOP_TABLE, KNIGHT_TABLE, PAWN_EG};
+
+// white reads its tables upside down (they list row 8 first), black reads them as printed and counts negative
+constexpr std::array<std::array<std::array<PsqtScore, 64>, 6>, 2> PSQT = [] {
+    std::array<std::array<std::array<PsqtScore, 64>, 6>, 2> table {};
+    int type = 0, sq = 0, white = 0, black = 0;
+
+    for (type = KING; type <= PAWN; type++) {
+        for (sq = 0; sq < 64; sq++) {
+            white = sq ^ 56;
+            black = sq;
+            table[WHITE][type][sq] = PsqtScore {(int16_t) (MG_VALUES[type] + MG_TABLES[type][white]),
+                                                (int16_t) (EG_VALUES[type] + EG_TABLES[type][white])};
+            table[BLACK][type][sq] = PsqtScore {(int16_t) -(MG_VALUES[type] + MG_TABLES[type][black]),
+                                                (int16_t) -(EG_VALUES[type] + EG_TABLES[type][black])};
+        }
+    }
+    return table;
+}();
+
+static int blend(const Position &position, PsqtScore psqt) {
+    int phase = 0, score, type;
+
+    for (type = QUEEN; type <= KNIGHT; type++) {
+        phase += PHASE_WEIGHTS[type] * popcount(position.pieces[WHITE][type] | position.pieces[BLACK][type]);
+    }
+    // promotions can push the phase past the starting material
+    phase = std::min(phase, MAX_PHASE);
+    score = (psqt.mg * phase + psqt.eg * (MAX_PHASE - phase)) / MAX_PHASE;
+    return position.side_to_move == WHITE ? score : -score;
+}
+
+int evaluate(const Position &position) {
+    return blend(position, position.psqt);
+}
+
+int evaluate_from_scratch(const Position &position) {
+    return blend(position, position.compute_psqt());
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "chess.h"
+
+#ifndef CPP_CHESS_EVAL_H
+#define CPP_CHESS_EVAL_H
+
+// centipawns, indexed by PIECE_TYPE. the king is priceless and never traded, so it counts for nothing
+const int PIECE_VALUES[6] = {0, 900, 500, 330, 320, 100};
+
+// game phase: 24 with all minor and major pieces on the board, 0 with none
+const int PHASE_WEIGHTS[6] = {0, 4, 2, 1, 1, 0};
+const int MAX_PHASE = 24;
+
+// material plus piece-square bonus by [color][type][square], black's entries are negated so everything just adds up
+extern const std::array<std::array<std::array<PsqtScore, 64>, 6>, 2> PSQT;
+
+// static score of the position in centipawns from the side to move's point of view. O(1), it only blends the
+// piece-square score Position keeps up to date by game phase
+int evaluate(const Position &position);
+// the same from scratch, for checking the incremental scores
+int evaluate_from_scratch(const Position &position);
+
+#endif //CPP_CHESS_EVAL_H
@@ -0,0 +1,392 @@
+#include "fen.h"
+
+// character -> piece, 0 for characters that aren't pieces, otherwise 1 + color*6 + type
+static constexpr std::array<uint8_t, 128> PIECE_CODES = [] {
+    std::array<uint8_t, 128> codes {};
+    const char white[] = "KQRBNP", black[] = "kqrbnp";
+    int type = 0;
+
+    for (type = 0; type < 6; type++) {
+        codes[white[type]] = (uint8_t) (1 + type);
+        codes[black[type]] = (uint8_t) (7 + type);
+    }
+    return codes;
+}();
+
+static FenResult fail(size_t offset, const char *error) {
+    return FenResult {false, offset, error, 1};
+}
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t';
+}
+
+static size_t skip_spaces(std::string_view text, size_t i) {
+    while (i < text.size() && is_space(text[i])) {
+        i++;
+    }
+    return i;
+}
+
+// parses the four position fields shared by FEN and EPD, i ends up just past the en-passant field
+static FenResult parse_fields(std::string_view text, Position &position, size_t &i) {
+    int row = 7, col = 0, code;
+    bool last_was_digit = false;
+    char c;
+    COLOR us, them;
+
+    position.clear();
+    i = 0;
+
+    // piece placement, from the eighth row down
+    for (; i < text.size() && !is_space(text[i]); i++) {
+        c = text[i];
+        if (c == '/') {
+            if (col != 8) {
+                return fail(i, "row does not add up to 8 squares");
+            }
+            if (row == 0) {
+                return fail(i, "more than 8 rows");
+            }
+            row--;
+            col = 0;
+            last_was_digit = false;
+        } else if ('1' <= c && c <= '8') {
+            if (last_was_digit) {
+                return fail(i, "two digits in a row");
+            }
+            col += c - '0';
+            if (col > 8) {
+                return fail(i, "row is longer than 8 squares");
+            }
+            last_was_digit = true;
+        } else {
+            code = (unsigned char) c < 128 ? PIECE_CODES[(unsigned char) c] : 0;
+            if (!code) {
+                return fail(i, "expected a piece letter, digit or '/'");
+            }
+            if (col > 7) {
+                return fail(i, "row is longer than 8 squares");
+            }
+            if ((code - 1) % 6 == PAWN && (row == 0 || row == 7)) {
+                return fail(i, "pawn on the first or last row");
+            }
+            position.put_piece(static_cast<COLOR>((code - 1) / 6), static_cast<PIECE_TYPE>((code - 1) % 6), make_square(row, col++));
+            last_was_digit = false;
+        }
+    }
+    if (row != 0 || col != 8) {
+        return fail(i, "piece placement ends early");
+    }
+    if (popcount(position.pieces[WHITE][KING]) != 1 || popcount(position.pieces[BLACK][KING]) != 1) {
+        return fail(0, "each side needs exactly one king");
+    }
+
+    // side to move
+    i = skip_spaces(text, i);
+    if (i >= text.size() || (text[i] != 'w' && text[i] != 'b')) {
+        return fail(i, "expected side to move 'w' or 'b'");
+    }
+    position.side_to_move = text[i] == 'w' ? WHITE : BLACK;
+    us = static_cast<COLOR>(position.side_to_move);
+    them = us == WHITE ? BLACK : WHITE;
+    if (position.attackers_to(position.king_square(them), position.occupied()) & position.occupancy[us]) {
+        return fail(i, "the side not to move is in check");
+    }
+    i++;
+    if (i < text.size() && !is_space(text[i])) {
+        return fail(i, "expected a space after the side to move");
+    }
+
+    // castling rights, rights whose king or rook has left its square are dropped
+    i = skip_spaces(text, i);
+    if (i >= text.size()) {
+        return fail(i, "expected castling rights");
+    }
+    if (text[i] == '-') {
+        i++;
+    } else {
+        for (; i < text.size() && !is_space(text[i]); i++) {
+            c = text[i];
+            code = c == 'K' ? WHITE_OO : c == 'Q' ? WHITE_OOO : c == 'k' ? BLACK_OO : c == 'q' ? BLACK_OOO : 0;
+            if (!code) {
+                return fail(i, "expected castling rights from 'KQkq' or '-'");
+            }
+            if (position.castling & code) {
+                return fail(i, "repeated castling right");
+            }
+            position.castling |= code;
+        }
+        if (!(position.pieces[WHITE][KING] & square_bb(4))) position.castling &= ~(WHITE_OO | WHITE_OOO);
+        if (!(position.pieces[WHITE][ROOK] & square_bb(7))) position.castling &= ~WHITE_OO;
+        if (!(position.pieces[WHITE][ROOK] & square_bb(0))) position.castling &= ~WHITE_OOO;
+        if (!(position.pieces[BLACK][KING] & square_bb(60))) position.castling &= ~(BLACK_OO | BLACK_OOO);
+        if (!(position.pieces[BLACK][ROOK] & square_bb(63))) position.castling &= ~BLACK_OO;
+        if (!(position.pieces[BLACK][ROOK] & square_bb(56))) position.castling &= ~BLACK_OOO;
+    }
+    if (i < text.size() && !is_space(text[i])) {
+        return fail(i, "expected a space after the castling rights");
+    }
+
+    // en-passant square, it has to be on the row behind a pawn that just moved two squares
+    i = skip_spaces(text, i);
+    if (i >= text.size()) {
+        return fail(i, "expected an en-passant square or '-'");
+    }
+    if (text[i] == '-') {
+        i++;
+    } else {
+        if (text[i] < 'a' || text[i] > 'h') {
+            return fail(i, "expected an en-passant file 'a'-'h' or '-'");
+        }
+        if (i + 1 >= text.size() || text[i + 1] != (us == WHITE ? '6' : '3')) {
+            return fail(i + 1, us == WHITE ? "expected en-passant row '6'" : "expected en-passant row '3'");
+        }
+        position.ep_square = (int8_t) make_square(text[i + 1] - '1', text[i] - 'a');
+        if (!(position.pieces[them][PAWN] & square_bb(position.ep_square + (us == WHITE ? -8 : 8)))) {
+            return fail(i, "no pawn in front of the en-passant square");
+        }
+        i += 2;
+    }
+    if (i < text.size() && !is_space(text[i]) && text[i] != '\n' && text[i] != '\r') {
+        return fail(i, "expected a space after the en-passant square");
+    }
+
+    position.key = position.compute_key();
+    return FenResult {true, i, nullptr, 1};
+}
+
+// reads an unsigned decimal number no bigger than limit
+static bool parse_number(std::string_view text, size_t &i, int limit, int &value) {
+    size_t start = i;
+
+    value = 0;
+    while (i < text.size() && '0' <= text[i] && text[i] <= '9') {
+        value = value * 10 + (text[i++] - '0');
+        if (value > limit) {
+            return false;
+        }
+    }
+    return i > start;
+}
+
+FenResult parse_fen(std::string_view text, Position &position) {
+    FenResult result;
+    size_t i;
+    int halfmove = 0, fullmove = 1;
+
+    result = parse_fields(text, position, i);
+    if (!result.ok) {
+        return result;
+    }
+
+    // both move counters are optional
+    i = skip_spaces(text, i);
+    if (i < text.size() && !(text[i] == '\n' || text[i] == '\r')) {
+        if (!parse_number(text, i, 9999, halfmove)) {
+            return fail(i, "expected the halfmove clock");
+        }
+        i = skip_spaces(text, i);
+        if (i < text.size() && !(text[i] == '\n' || text[i] == '\r')) {
+            if (!parse_number(text, i, 99999, fullmove)) {
+                return fail(i, "expected the fullmove number");
+            }
+        }
+    }
+    result.offset = i;
+    i = skip_spaces(text, i);
+    while (i < text.size() && (text[i] == '\n' || text[i] == '\r')) {
+        i++;
+    }
+    if (i != text.size()) {
+        return fail(i, "unexpected characters after the FEN");
+    }
+
+    position.halfmove_clock = (uint8_t) std::min(halfmove, 255);
+    result.fullmove_number = std::max(fullmove, 1);
+    return result;
+}
+
+FenResult parse_epd(std::string_view text, Position &position, std::string_view &operations) {
+    FenResult result;
+    std::string_view operand;
+    size_t i, end;
+    int halfmove = 0;
+
+    result = parse_fields(text, position, i);
+    if (!result.ok) {
+        operations = std::string_view();
+        return result;
+    }
+
+    i = skip_spaces(text, i);
+    end = text.size();
+    while (end > i && (is_space(text[end - 1]) || text[end - 1] == '\n' || text[end - 1] == '\r')) {
+        end--;
+    }
+    operations = text.substr(i, end - i);
+    result.offset = end;
+
+    // the move counters travel as the hmvc/fmvn operations
+    if (epd_operation(operations, "hmvc", operand)) {
+        i = 0;
+        if (parse_number(operand, i, 9999, halfmove)) {
+            position.halfmove_clock = (uint8_t) std::min(halfmove, 255);
+        }
+    }
+    if (epd_operation(operations, "fmvn", operand)) {
+        i = 0;
+        if (parse_number(operand, i, 99999, result.fullmove_number)) {
+            result.fullmove_number = std::max(result.fullmove_number, 1);
+        }
+    }
+    return result;
+}
+
+bool epd_operation(std::string_view operations, std::string_view opcode, std::string_view &operand) {
+    size_t i = 0, start, end;
+    bool quoted;
+
+    // operations look like: opcode operand operand; opcode "quoted operand";
+    while (i < operations.size()) {
+        i = skip_spaces(operations, i);
+        start = i;
+        while (i < operations.size() && !is_space(operations[i]) && operations[i] != ';') {
+            i++;
+        }
+        std::string_view name = operations.substr(start, i - start);
+        i = skip_spaces(operations, i);
+        start = i;
+        quoted = false;
+        while (i < operations.size() && (quoted || operations[i] != ';')) {
+            if (operations[i] == '"') {
+                quoted = !quoted;
+            }
+            i++;
+        }
+        end = i;
+        while (end > start && is_space(operations[end - 1])) {
+            end--;
+        }
+        if (name == opcode) {
+            if (end - start >= 2 && operations[start] == '"' && operations[end - 1] == '"') {
+                start++;
+                end--;
+            }
+            operand = operations.substr(start, end - start);
+            return true;
+        }
+        i++;
+    }
+    return false;
+}
+
+// writes value in decimal at out, returns the number of digits
+static size_t write_number(unsigned value, char *out) {
+    char digits[10];
+    size_t count = 0, i;
+
+    do {
+        digits[count++] = (char) ('0' + value % 10);
+        value /= 10;
+    } while (value);
+    for (i = 0; i < count; i++) {
+        out[i] = digits[count - 1 - i];
+    }
+    return count;
+}
+
+size_t write_fen(const Position &position, int fullmove_number, char *out, size_t capacity) {
+    static const char LETTERS[2][6] = {{'K', 'Q', 'R', 'B', 'N', 'P'}, {'k', 'q', 'r', 'b', 'n', 'p'}};
+    char *p = out;
+    int row, col, empty, color, type, sq;
+    char board[64] = {};
+    Bitboard pieces;
+
+    if (capacity < FEN_BUFFER_SIZE) {
+        return 0;
+    }
+
+    // letters by square first, so the placement loop doesn't have to search the bitboards
+    for (color = WHITE; color <= BLACK; color++) {
+        for (type = KING; type <= PAWN; type++) {
+            for (pieces = position.pieces[color][type]; pieces;) {
+                board[pop_lsb(pieces)] = LETTERS[color][type];
+            }
+        }
+    }
+
+    for (row = 7; row >= 0; row--) {
+        empty = 0;
+        for (col = 0; col < 8; col++) {
+            sq = make_square(row, col);
+            if (!board[sq]) {
+                empty++;
+                continue;
+            }
+            if (empty) {
+                *p++ = (char) ('0' + empty);
+                empty = 0;
+            }
+            *p++ = board[sq];
+        }
+        if (empty) {
+            *p++ = (char) ('0' + empty);
+        }
+        if (row) {
+            *p++ = '/';
+        }
+    }
+
+    *p++ = ' ';
+    *p++ = position.side_to_move == WHITE ? 'w' : 'b';
+    *p++ = ' ';
+    if (position.castling & WHITE_OO) *p++ = 'K';
+    if (position.castling & WHITE_OOO) *p++ = 'Q';
+    if (position.castling & BLACK_OO) *p++ = 'k';
+    if (position.castling & BLACK_OOO) *p++ = 'q';
+    if (!position.castling) *p++ = '-';
+    *p++ = ' ';
+    if (position.ep_square != NO_SQUARE) {
+        *p++ = COLUMN_LETTERS[square_col(position.ep_square)];
+        *p++ = (char) ('1' + square_row(position.ep_square));
+    } else {
+        *p++ = '-';
+    }
+    *p++ = ' ';
+    p += write_number(position.halfmove_clock, p);
+    *p++ = ' ';
+    p += write_number((unsigned) std::max(fullmove_number, 1), p);
+    *p = '\0';
+    return (size_t) (p - out);
+}
+
+EpdReader::EpdReader(std::string_view buffer) : buffer(buffer), cursor(0), line(0) {}
+
+bool EpdReader::next(Position &position, std::string_view &operations, FenResult &result) {
+    size_t start, end, first;
+
+    while (cursor < buffer.size()) {
+        start = cursor;
+        end = buffer.find('\n', start);
+        if (end == std::string_view::npos) {
+            end = buffer.size();
+        }
+        cursor = end + 1;
+        line++;
+
+        std::string_view text = buffer.substr(start, end - start);
+        first = skip_spaces(text, 0);
+        if (first == text.size() || text[first] == '#' || text[first] == '\r') {
+            continue;
+        }
+        result = parse_epd(text.substr(first), position, operations);
+        result.offset += start + first;
+        return true;
+    }
+    return false;
+}
+
+size_t EpdReader::line_number() const {
+    return line;
+}
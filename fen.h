@@ -0,0 +1,49 @@
+#pragma once
+
+#include "chess.h"
+
+#include <cstddef>
+#include <string_view>
+
+#ifndef CPP_CHESS_FEN_H
+#define CPP_CHESS_FEN_H
+
+// longest FEN write_fen can produce (71 placement chars, " w KQkq e3 255 65535") plus the terminating NUL
+const size_t FEN_BUFFER_SIZE = 96;
+
+// outcome of a parse. on failure offset points at the offending character of the input and error says what was
+// expected, on success offset is one past the last character consumed
+struct FenResult {
+    bool ok;
+    size_t offset;
+    const char *error;
+    int fullmove_number;
+};
+
+// parses a FEN (the halfmove and fullmove fields may be left out), trailing whitespace is allowed
+FenResult parse_fen(std::string_view text, Position &position);
+// parses the four EPD position fields, operations gets whatever follows them (without copying)
+FenResult parse_epd(std::string_view text, Position &position, std::string_view &operations);
+// finds an EPD operation ("bm", "id", ...) and returns its operands, quotes stripped
+bool epd_operation(std::string_view operations, std::string_view opcode, std::string_view &operand);
+
+// writes the FEN and a NUL into out, returns its length (without the NUL) or 0 when capacity is too small
+size_t write_fen(const Position &position, int fullmove_number, char *out, size_t capacity);
+
+// walks a buffer (typically a MappedFile) one line at a time. nothing is copied, operations point into the buffer.
+// blank lines and lines starting with '#' are skipped
+class EpdReader {
+public:
+    explicit EpdReader(std::string_view buffer);
+    // false once the buffer is exhausted, result.offset is relative to the start of the buffer
+    bool next(Position &position, std::string_view &operations, FenResult &result);
+    // 1 based line number of the line returned last
+    size_t line_number() const;
+
+private:
+    std::string_view buffer;
+    size_t cursor;
+    size_t line;
+};
+
+#endif //CPP_CHESS_FEN_H
@@ -0,0 +1,392 @@
+#include "game_file.h"
+#include "fen.h"
+
+#include <cstring>
+
+static const char GAME_FILE_MAGIC[4] = {'C', 'C', 'G', 'F'};
+static const size_t GAME_HEADER_SIZE = 32;
+// start position, plies, result, reserved
+static const size_t RECORD_HEADER_SIZE = sizeof(PackedPosition) + 4;
+
+// bits needed to tell count moves apart
+static int index_bits(int count) {
+    int bits = 0;
+
+    while ((1 << bits) < count) {
+        bits++;
+    }
+    return bits;
+}
+
+// Begin packed position implementations
+bool pack_position(const Position &position, int fullmove_number, PackedPosition &packed) {
+    Bitboard occupied = position.occupied(), b;
+    int sq, i = 0, code;
+
+    if (popcount(occupied) > 32) {
+        return false;
+    }
+    memset(&packed, 0, sizeof(packed));
+    packed.occupancy = occupied;
+    for (b = occupied; b; i++) {
+        sq = pop_lsb(b);
+        code = position.color_on(sq) << 3 | position.piece_on(sq);
+        packed.pieces[i / 2] |= (uint8_t) (code << (i & 1 ? 4 : 0));
+    }
+    packed.side_to_move = position.side_to_move;
+    packed.castling = position.castling;
+    packed.ep_square = position.ep_square;
+    packed.halfmove_clock = position.halfmove_clock;
+    packed.fullmove_number = (uint16_t) std::min(std::max(fullmove_number, 1), 65535);
+    return true;
+}
+
+bool unpack_position(const PackedPosition &packed, Position &position, int &fullmove_number) {
+    Bitboard b;
+    int sq, i = 0, code, color, type;
+    COLOR us, them;
+
+    if (popcount(packed.occupancy) > 32 || packed.side_to_move > BLACK || packed.castling > ALL_CASTLING ||
+        packed.fullmove_number == 0) {
+        return false;
+    }
+    position.clear();
+    for (b = packed.occupancy; b; i++) {
+        sq = pop_lsb(b);
+        code = packed.pieces[i / 2] >> (i & 1 ? 4 : 0) & 15;
+        color = code >> 3;
+        type = code & 7;
+        if (type > PAWN) {
+            return false;
+        }
+        position.put_piece(static_cast<COLOR>(color), static_cast<PIECE_TYPE>(type), sq);
+    }
+    position.side_to_move = packed.side_to_move;
+    position.castling = packed.castling;
+    position.ep_square = packed.ep_square;
+    position.halfmove_clock = packed.halfmove_clock;
+    us = static_cast<COLOR>(position.side_to_move);
+    them = us == WHITE ? BLACK : WHITE;
+
+    // the same rules parse_fen enforces
+    if (popcount(position.pieces[WHITE][KING]) != 1 || popcount(position.pieces[BLACK][KING]) != 1 ||
+        ((position.pieces[WHITE][PAWN] | position.pieces[BLACK][PAWN]) & (ROW_1 | ROW_8)) ||
+        (position.attackers_to(position.king_square(them), position.occupied()) & position.occupancy[us])) {
+        return false;
+    }
+    if (((position.castling & (WHITE_OO | WHITE_OOO)) && !(position.pieces[WHITE][KING] & square_bb(4))) ||
+        ((position.castling & WHITE_OO) && !(position.pieces[WHITE][ROOK] & square_bb(7))) ||
+        ((position.castling & WHITE_OOO) && !(position.pieces[WHITE][ROOK] & square_bb(0))) ||
+        ((position.castling & (BLACK_OO | BLACK_OOO)) && !(position.pieces[BLACK][KING] & square_bb(60))) ||
+        ((position.castling & BLACK_OO) && !(position.pieces[BLACK][ROOK] & square_bb(63))) ||
+        ((position.castling & BLACK_OOO) && !(position.pieces[BLACK][ROOK] & square_bb(56)))) {
+        return false;
+    }
+    if (position.ep_square != NO_SQUARE &&
+        (position.ep_square < 0 || position.ep_square > 63 || square_row(position.ep_square) != (us == WHITE ? 5 : 2) ||
+         !(position.pieces[them][PAWN] & square_bb(position.ep_square + (us == WHITE ? -8 : 8))))) {
+        return false;
+    }
+    position.key = position.compute_key();
+    fullmove_number = packed.fullmove_number;
+    return true;
+}
+// End packed position implementations
+
+// Begin GameWriter function implementations
+GameWriter::~GameWriter() {
+    if (out.is_open()) {
+        finish();
+    }
+}
+
+bool GameWriter::open(const std::string &path) {
+    char header[GAME_HEADER_SIZE] = {};
+
+    if (out.is_open()) {
+        finish();
+    }
+    offsets.clear();
+    in_game = false;
+    out.open(path, std::ios::binary | std::ios::trunc);
+    // the real header goes in once the index is written
+    out.write(header, sizeof(header));
+    written = sizeof(header);
+    return (bool) out;
+}
+
+bool GameWriter::begin_game(const Position &start, int fullmove_number) {
+    PackedPosition packed;
+
+    if (in_game) {
+        end_game(RESULT_UNKNOWN);
+    }
+    if (!out.is_open() || !pack_position(start, fullmove_number, packed)) {
+        return false;
+    }
+    record.assign(RECORD_HEADER_SIZE, 0);
+    memcpy(record.data(), &packed, sizeof(packed));
+    bit = 0;
+    plies = 0;
+    in_game = true;
+    board.set_position(start, fullmove_number);
+    return true;
+}
+
+bool GameWriter::add_move(PackedMove move) {
+    PackedMove moves[MAX_MOVES];
+    int count, i, bits;
+
+    if (!in_game || plies >= MAX_RECORD_PLIES) {
+        return false;
+    }
+    count = generate_legal_moves(board.get_position(), moves);
+    for (i = 0; i < count && moves[i] != move; i++) {}
+    if (i == count) {
+        return false;
+    }
+    for (bits = index_bits(count); bits > 0; bits--, i >>= 1, bit++) {
+        if ((bit & 7) == 0) {
+            record.push_back(0);
+        }
+        record.back() |= (uint8_t) ((i & 1) << (bit & 7));
+    }
+    plies++;
+    board.push(move);
+    return true;
+}
+
+bool GameWriter::end_game(GAME_RESULT result) {
+    uint16_t count = (uint16_t) plies;
+
+    if (!in_game) {
+        return false;
+    }
+    memcpy(record.data() + sizeof(PackedPosition), &count, sizeof(count));
+    record[sizeof(PackedPosition) + 2] = (uint8_t) result;
+    offsets.push_back(written);
+    out.write((const char *) record.data(), (std::streamsize) record.size());
+    written += record.size();
+    in_game = false;
+    return (bool) out;
+}
+
+bool GameWriter::finish() {
+    char header[GAME_HEADER_SIZE] = {}, padding[8] = {};
+    uint64_t count, index_offset;
+    bool ok;
+
+    if (!out.is_open()) {
+        return false;
+    }
+    if (in_game) {
+        end_game(RESULT_UNKNOWN);
+    }
+    index_offset = (written + 7) & ~(uint64_t) 7;
+    out.write(padding, (std::streamsize) (index_offset - written));
+    out.write((const char *) offsets.data(), (std::streamsize) (offsets.size() * sizeof(uint64_t)));
+    count = offsets.size();
+    memcpy(header, GAME_FILE_MAGIC, 4);
+    memcpy(header + 4, &GAME_FILE_VERSION, 4);
+    memcpy(header + 8, &count, 8);
+    memcpy(header + 16, &index_offset, 8);
+    out.seekp(0);
+    out.write(header, sizeof(header));
+    ok = (bool) out;
+    out.close();
+    return ok && !out.fail();
+}
+
+void GameWriter::discard_game() {
+    in_game = false;
+}
+
+uint64_t GameWriter::game_count() const {
+    return offsets.size();
+}
+
+const Board &GameWriter::current() const {
+    return board;
+}
+// End GameWriter function implementations
+
+// Begin GameReader function implementations
+bool GameReader::open(const std::string &path) {
+    uint32_t version;
+
+    close();
+    if (!file.open(path) || file.size() < GAME_HEADER_SIZE) {
+        close();
+        return false;
+    }
+    memcpy(&version, file.data() + 4, 4);
+    memcpy(&count, file.data() + 8, 8);
+    memcpy(&index_offset, file.data() + 16, 8);
+    if (memcmp(file.data(), GAME_FILE_MAGIC, 4) != 0 || version != GAME_FILE_VERSION || index_offset < GAME_HEADER_SIZE ||
+        index_offset > file.size() || count > (file.size() - index_offset) / sizeof(uint64_t)) {
+        close();
+        return false;
+    }
+    index = (const uint8_t *) file.data() + index_offset;
+    return true;
+}
+
+void GameReader::close() {
+    file.close();
+    index = nullptr;
+    count = 0;
+    index_offset = 0;
+}
+
+uint64_t GameReader::game_count() const {
+    return count;
+}
+
+bool GameReader::game(uint64_t number, GameRecord &game) const {
+    uint64_t begin, end;
+    uint16_t plies;
+    const uint8_t *data = (const uint8_t *) file.data();
+
+    if (number >= count) {
+        return false;
+    }
+    memcpy(&begin, index + number * 8, 8);
+    if (number + 1 < count) {
+        memcpy(&end, index + (number + 1) * 8, 8);
+    } else {
+        end = index_offset;
+    }
+    if (begin < GAME_HEADER_SIZE || end > index_offset || begin > end || end - begin < RECORD_HEADER_SIZE) {
+        return false;
+    }
+    memcpy(&game.start, data + begin, sizeof(PackedPosition));
+    memcpy(&plies, data + begin + sizeof(PackedPosition), 2);
+    game.plies = plies;
+    game.result = static_cast<GAME_RESULT>(data[begin + sizeof(PackedPosition) + 2]);
+    game.moves = data + begin + RECORD_HEADER_SIZE;
+    // the last record also gets the index padding, the decoder stops after plies moves anyway
+    game.move_bytes = end - begin - RECORD_HEADER_SIZE;
+    return game.result <= RESULT_DRAW;
+}
+// End GameReader function implementations
+
+// Begin GameDecoder function implementations
+bool GameDecoder::start(const GameRecord &record, Board &board) {
+    Position position;
+    int fullmove_number;
+
+    data = record.moves;
+    bits = record.move_bytes * 8;
+    bit = 0;
+    remaining = record.plies;
+    if (!unpack_position(record.start, position, fullmove_number)) {
+        remaining = 0;
+        return false;
+    }
+    board.set_position(position, fullmove_number);
+    return true;
+}
+
+bool GameDecoder::next(Board &board, PackedMove &move) {
+    PackedMove moves[MAX_MOVES];
+    int count, i = 0, width, j;
+
+    if (remaining <= 0) {
+        return false;
+    }
+    count = generate_legal_moves(board.get_position(), moves);
+    width = index_bits(count);
+    if (count == 0 || bit + width > bits) {
+        remaining = 0;
+        return false;
+    }
+    for (j = 0; j < width; j++, bit++) {
+        i |= (data[bit >> 3] >> (bit & 7) & 1) << j;
+    }
+    if (i >= count) {
+        remaining = 0;
+        return false;
+    }
+    move = moves[i];
+    board.push(move);
+    remaining--;
+    return true;
+}
+
+int GameDecoder::plies_left() const {
+    return remaining;
+}
+// End GameDecoder function implementations
+
+// Begin converter implementations
+static bool convert_line(std::string_view line, GameWriter &writer) {
+    std::string_view word = next_token(line), fen;
+    GAME_RESULT result = RESULT_UNKNOWN;
+    Position start;
+    FenResult parsed;
+    PackedMove move;
+    size_t moves;
+
+    if (word == "startpos") {
+        start.set_startpos();
+        parsed.fullmove_number = 1;
+    } else if (word == "fen") {
+        moves = line.find(" moves");
+        fen = line.substr(0, moves);
+        line = moves == std::string_view::npos ? std::string_view() : line.substr(moves);
+        parsed = parse_fen(fen.substr(std::min(fen.find_first_not_of(" \t"), fen.size())), start);
+        if (!parsed.ok) {
+            return false;
+        }
+    } else {
+        return false;
+    }
+    if (!writer.begin_game(start, parsed.fullmove_number)) {
+        return false;
+    }
+
+    word = next_token(line);
+    if (word == "moves") {
+        word = next_token(line);
+    }
+    for (; !word.empty(); word = next_token(line)) {
+        if (word == "1-0" || word == "0-1" || word == "1/2-1/2" || word == "*") {
+            result = word == "1-0" ? RESULT_WHITE_WINS : word == "0-1" ? RESULT_BLACK_WINS : word == "*" ? RESULT_UNKNOWN : RESULT_DRAW;
+            if (!next_token(line).empty()) {
+                return false;
+            }
+            break;
+        }
+        move = parse_uci(writer.current().get_position(), word);
+        if (move == NULL_MOVE || !writer.add_move(move)) {
+            return false;
+        }
+    }
+    return writer.end_game(result);
+}
+
+ConvertResult convert_uci_games(std::string_view text, GameWriter &writer) {
+    ConvertResult result = {true, 0, 0};
+    std::string_view line;
+    size_t end;
+
+    while (!text.empty()) {
+        end = text.find('\n');
+        line = text.substr(0, end);
+        text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+        result.line++;
+        line.remove_prefix(std::min(line.find_first_not_of(" \t\r"), line.size()));
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        if (!convert_line(line, writer)) {
+            writer.discard_game();
+            result.ok = false;
+            return result;
+        }
+        result.games++;
+    }
+    result.line = 0;
+    return result;
+}
+// End converter implementations
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "chess.h"
+#include "mapped_file.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifndef CPP_CHESS_GAME_FILE_H
+#define CPP_CHESS_GAME_FILE_H
+
+// 32 byte position: the occupied squares, then one nibble per occupied square in square order (color << 3 | type,
+// low nibble first). everything else a FEN holds follows, the key and psqt are recomputed when unpacking
+struct PackedPosition {
+    uint64_t occupancy;
+    uint8_t pieces[16];
+    uint8_t side_to_move;
+    uint8_t castling;
+    int8_t ep_square;
+    uint8_t halfmove_clock;
+    uint16_t fullmove_number;
+    uint8_t reserved[2];
+};
+
+static_assert(sizeof(PackedPosition) == 32, "PackedPosition is meant to be 32 bytes");
+
+// false if the position has more than 32 pieces
+bool pack_position(const Position &position, int fullmove_number, PackedPosition &packed);
+// false if the bytes don't describe a position parse_fen would accept
+bool unpack_position(const PackedPosition &packed, Position &position, int &fullmove_number);
+
+// game files hold games as a packed start position plus one index into the legal move list per ply, written in
+// just enough bits for that list (a forced move takes none). layout, little endian:
+//   header (32 bytes): "CCGF", uint32 version, uint64 game count, uint64 offset of the index, uint64 0
+//   records: PackedPosition start, uint16 plies, uint8 GAME_RESULT, uint8 0, the move bits (low bit first)
+//   index: uint64 offset of every record, 8 byte aligned
+const uint32_t GAME_FILE_VERSION = 1;
+// a record holds at most this many plies
+const int MAX_RECORD_PLIES = 65535;
+
+class GameWriter {
+public:
+    GameWriter() = default;
+    // finishes the file if that hasn't happened yet
+    ~GameWriter();
+    GameWriter(const GameWriter &) = delete;
+    GameWriter &operator=(const GameWriter &) = delete;
+
+    bool open(const std::string &path);
+    // an unfinished game is ended with RESULT_UNKNOWN first
+    bool begin_game(const Position &start, int fullmove_number);
+    // false (with nothing written) if the move isn't legal or the game has reached MAX_RECORD_PLIES
+    bool add_move(PackedMove move);
+    bool end_game(GAME_RESULT result);
+    // drops the game being written
+    void discard_game();
+    // writes the index and the header and closes the file, false if anything went wrong on the way
+    bool finish();
+    uint64_t game_count() const;
+    // the game being written, at its current position
+    const Board &current() const;
+
+private:
+    std::ofstream out;
+    std::vector<uint64_t> offsets;
+    // the record being built, moves are appended bit by bit
+    std::vector<uint8_t> record;
+    size_t bit = 0;
+    int plies = 0;
+    bool in_game = false;
+    uint64_t written = 0;
+    Board board;
+};
+
+// one record, pointing into the mapped file
+struct GameRecord {
+    PackedPosition start;
+    int plies;
+    GAME_RESULT result;
+    const uint8_t *moves;
+    size_t move_bytes;
+};
+
+// zero-copy reader over a mapped game file, games can be read in any order and from any number of threads
+class GameReader {
+public:
+    // false if the file is missing or its header or index don't add up
+    bool open(const std::string &path);
+    void close();
+    uint64_t game_count() const;
+    // false if index is out of range or the record is malformed
+    bool game(uint64_t index, GameRecord &record) const;
+
+private:
+    MappedFile file;
+    const uint8_t *index = nullptr;
+    uint64_t count = 0;
+    uint64_t index_offset = 0;
+};
+
+// replays a record on a Board, allocation free
+class GameDecoder {
+public:
+    // sets the board to the start position, false if it doesn't unpack
+    bool start(const GameRecord &record, Board &board);
+    // decodes and pushes the next move, false at the end of the game or if the record is corrupt
+    bool next(Board &board, PackedMove &move);
+    int plies_left() const;
+
+private:
+    const uint8_t *data = nullptr;
+    size_t bits = 0;
+    size_t bit = 0;
+    int remaining = 0;
+};
+
+// what convert_uci_games (or convert_pgn_games in pgn.h) got through
+struct ConvertResult {
+    bool ok;
+    uint64_t games;
+    // 1 based line that failed, when !ok. the 1 based game for PGN, whose games span many lines
+    uint64_t line;
+};
+
+// converts a text with one game per line, written like the arguments of UCI's position command and optionally
+// followed by a PGN result: "startpos moves e2e4 e7e5 1-0" or "fen <FEN> moves ...". blank lines and lines
+// starting with '#' are skipped, conversion stops at the first malformed line
+ConvertResult convert_uci_games(std::string_view text, GameWriter &writer);
+
+#endif //CPP_CHESS_GAME_FILE_H
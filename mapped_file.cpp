@@ -0,0 +1,84 @@
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <utility>
+
+MappedFile::MappedFile(const std::string &path) {
+    open(path);
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept {
+    *this = std::move(other);
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+    if (this != &other) {
+        close();
+        std::swap(bytes, other.bytes);
+        std::swap(length, other.length);
+    }
+    return *this;
+}
+
+bool MappedFile::open(const std::string &path) {
+    struct stat info;
+    void *memory;
+    int fd;
+
+    close();
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    if (fstat(fd, &info) != 0) {
+        ::close(fd);
+        return false;
+    }
+    // an empty file is a valid (empty) mapping
+    if (info.st_size == 0) {
+        ::close(fd);
+        bytes = "";
+        return true;
+    }
+    memory = mmap(nullptr, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (memory == MAP_FAILED) {
+        return false;
+    }
+    madvise(memory, (size_t) info.st_size, MADV_SEQUENTIAL);
+    bytes = static_cast<const char *>(memory);
+    length = (size_t) info.st_size;
+    return true;
+}
+
+void MappedFile::close() {
+    if (bytes && length) {
+        munmap(const_cast<char *>(bytes), length);
+    }
+    bytes = nullptr;
+    length = 0;
+}
+
+bool MappedFile::is_open() const {
+    return bytes != nullptr;
+}
+
+const char *MappedFile::data() const {
+    return bytes;
+}
+
+size_t MappedFile::size() const {
+    return length;
+}
+
+std::string_view MappedFile::view() const {
+    return std::string_view(bytes ? bytes : "", length);
+}
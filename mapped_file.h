@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#ifndef CPP_CHESS_MAPPED_FILE_H
+#define CPP_CHESS_MAPPED_FILE_H
+
+// read-only memory mapping of a whole file, the contents stay valid until the object is destroyed
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string &path);
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+
+    // false if the file can't be opened or mapped, the previous mapping (if any) is released either way
+    bool open(const std::string &path);
+    void close();
+    bool is_open() const;
+    const char *data() const;
+    size_t size() const;
+    std::string_view view() const;
+
+private:
+    const char *bytes = nullptr;
+    size_t length = 0;
+};
+
+#endif //CPP_CHESS_MAPPED_FILE_H
@@ -0,0 +1,413 @@
+#include "nnue.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CPP_CHESS_NNUE_X86
+#endif
+
+static constexpr size_t align64(size_t size) {
+    return (size + 63) & ~(size_t) 63;
+}
+
+// byte offsets of the blocks in a network file, see Network in nnue.h
+static const size_t HEADER_SIZE = 64;
+static const size_t FEATURE_WEIGHTS_OFFSET = HEADER_SIZE;
+static const size_t FEATURE_BIASES_OFFSET = FEATURE_WEIGHTS_OFFSET + align64(NNUE_INPUTS * NNUE_HIDDEN * sizeof(int16_t));
+static const size_t L1_WEIGHTS_OFFSET = FEATURE_BIASES_OFFSET + align64(NNUE_HIDDEN * sizeof(int16_t));
+static const size_t L1_BIASES_OFFSET = L1_WEIGHTS_OFFSET + align64(NNUE_L1 * 2 * NNUE_HIDDEN);
+static const size_t L2_WEIGHTS_OFFSET = L1_BIASES_OFFSET + align64(NNUE_L1 * sizeof(int32_t));
+static const size_t L2_BIAS_OFFSET = L2_WEIGHTS_OFFSET + align64(NNUE_L1);
+static const size_t NETWORK_SIZE = L2_BIAS_OFFSET + 64;
+
+// the hot loops, one set per instruction set
+struct Kernels {
+    // dst = src + the added rows - the removed rows, every row NNUE_HIDDEN long
+    void (*update)(int16_t *dst, const int16_t *src, const int16_t *const *added, int add_count,
+                   const int16_t *const *removed, int remove_count);
+    // clips both accumulator halves to [0, NNUE_CLIP] and packs them into 2 * NNUE_HIDDEN bytes
+    void (*activate)(const int16_t *us, const int16_t *them, uint8_t *out);
+    // out[i] = biases[i] + sum of input[j] * weights[i][j], NNUE_L1 outputs from 2 * NNUE_HIDDEN inputs
+    void (*dense)(const uint8_t *input, const int8_t *weights, const int32_t *biases, int32_t *out);
+};
+
+// Begin scalar kernel implementations
+static void update_scalar(int16_t *dst, const int16_t *src, const int16_t *const *added, int add_count,
+                          const int16_t *const *removed, int remove_count) {
+    int i, j, sum;
+
+    for (i = 0; i < NNUE_HIDDEN; i++) {
+        sum = src[i];
+        for (j = 0; j < add_count; j++) {
+            sum += added[j][i];
+        }
+        for (j = 0; j < remove_count; j++) {
+            sum -= removed[j][i];
+        }
+        dst[i] = (int16_t) sum;
+    }
+}
+
+static void activate_scalar(const int16_t *us, const int16_t *them, uint8_t *out) {
+    int i;
+
+    for (i = 0; i < NNUE_HIDDEN; i++) {
+        out[i] = (uint8_t) std::min(std::max((int) us[i], 0), NNUE_CLIP);
+        out[NNUE_HIDDEN + i] = (uint8_t) std::min(std::max((int) them[i], 0), NNUE_CLIP);
+    }
+}
+
+static void dense_scalar(const uint8_t *input, const int8_t *weights, const int32_t *biases, int32_t *out) {
+    int i, j, sum;
+
+    for (i = 0; i < NNUE_L1; i++) {
+        sum = biases[i];
+        for (j = 0; j < 2 * NNUE_HIDDEN; j++) {
+            sum += input[j] * weights[i * 2 * NNUE_HIDDEN + j];
+        }
+        out[i] = sum;
+    }
+}
+// End scalar kernel implementations
+
+#ifdef CPP_CHESS_NNUE_X86
+// Begin SSE4.1 kernel implementations
+__attribute__((target("sse4.1")))
+static void update_sse41(int16_t *dst, const int16_t *src, const int16_t *const *added, int add_count,
+                         const int16_t *const *removed, int remove_count) {
+    __m128i sum;
+    int i, j;
+
+    for (i = 0; i < NNUE_HIDDEN; i += 8) {
+        sum = _mm_loadu_si128((const __m128i *) (src + i));
+        for (j = 0; j < add_count; j++) {
+            sum = _mm_add_epi16(sum, _mm_loadu_si128((const __m128i *) (added[j] + i)));
+        }
+        for (j = 0; j < remove_count; j++) {
+            sum = _mm_sub_epi16(sum, _mm_loadu_si128((const __m128i *) (removed[j] + i)));
+        }
+        _mm_storeu_si128((__m128i *) (dst + i), sum);
+    }
+}
+
+__attribute__((target("sse4.1")))
+static void activate_sse41(const int16_t *us, const int16_t *them, uint8_t *out) {
+    const __m128i clip = _mm_set1_epi8(NNUE_CLIP);
+    __m128i packed;
+    int i;
+
+    // packus saturates to [0, 255], the min takes care of the top
+    for (i = 0; i < NNUE_HIDDEN; i += 16) {
+        packed = _mm_packus_epi16(_mm_loadu_si128((const __m128i *) (us + i)), _mm_loadu_si128((const __m128i *) (us + i + 8)));
+        _mm_storeu_si128((__m128i *) (out + i), _mm_min_epu8(packed, clip));
+        packed = _mm_packus_epi16(_mm_loadu_si128((const __m128i *) (them + i)), _mm_loadu_si128((const __m128i *) (them + i + 8)));
+        _mm_storeu_si128((__m128i *) (out + NNUE_HIDDEN + i), _mm_min_epu8(packed, clip));
+    }
+}
+
+__attribute__((target("sse4.1")))
+static void dense_sse41(const uint8_t *input, const int8_t *weights, const int32_t *biases, int32_t *out) {
+    const __m128i ones = _mm_set1_epi16(1);
+    const int8_t *row;
+    __m128i sum, product;
+    int i, j;
+
+    for (i = 0; i < NNUE_L1; i++) {
+        row = weights + i * 2 * NNUE_HIDDEN;
+        sum = _mm_setzero_si128();
+        for (j = 0; j < 2 * NNUE_HIDDEN; j += 16) {
+            // u8 * i8 pairs summed to i16, then pairs of those to i32. 2 * 127 * 128 can't saturate
+            product = _mm_maddubs_epi16(_mm_loadu_si128((const __m128i *) (input + j)), _mm_loadu_si128((const __m128i *) (row + j)));
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(product, ones));
+        }
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+        out[i] = biases[i] + _mm_cvtsi128_si32(sum);
+    }
+}
+// End SSE4.1 kernel implementations
+
+// Begin AVX2 kernel implementations
+__attribute__((target("avx2")))
+static void update_avx2(int16_t *dst, const int16_t *src, const int16_t *const *added, int add_count,
+                        const int16_t *const *removed, int remove_count) {
+    __m256i sum;
+    int i, j;
+
+    for (i = 0; i < NNUE_HIDDEN; i += 16) {
+        sum = _mm256_loadu_si256((const __m256i *) (src + i));
+        for (j = 0; j < add_count; j++) {
+            sum = _mm256_add_epi16(sum, _mm256_loadu_si256((const __m256i *) (added[j] + i)));
+        }
+        for (j = 0; j < remove_count; j++) {
+            sum = _mm256_sub_epi16(sum, _mm256_loadu_si256((const __m256i *) (removed[j] + i)));
+        }
+        _mm256_storeu_si256((__m256i *) (dst + i), sum);
+    }
+}
+
+__attribute__((target("avx2")))
+static void activate_avx2(const int16_t *us, const int16_t *them, uint8_t *out) {
+    const __m256i clip = _mm256_set1_epi8(NNUE_CLIP);
+    __m256i packed;
+    int i;
+
+    // packus works within 128 bit lanes, the permute puts the quarters back in order
+    for (i = 0; i < NNUE_HIDDEN; i += 32) {
+        packed = _mm256_packus_epi16(_mm256_loadu_si256((const __m256i *) (us + i)), _mm256_loadu_si256((const __m256i *) (us + i + 16)));
+        packed = _mm256_permute4x64_epi64(_mm256_min_epu8(packed, clip), 0xD8);
+        _mm256_storeu_si256((__m256i *) (out + i), packed);
+        packed = _mm256_packus_epi16(_mm256_loadu_si256((const __m256i *) (them + i)), _mm256_loadu_si256((const __m256i *) (them + i + 16)));
+        packed = _mm256_permute4x64_epi64(_mm256_min_epu8(packed, clip), 0xD8);
+        _mm256_storeu_si256((__m256i *) (out + NNUE_HIDDEN + i), packed);
+    }
+}
+
+__attribute__((target("avx2")))
+static void dense_avx2(const uint8_t *input, const int8_t *weights, const int32_t *biases, int32_t *out) {
+    const __m256i ones = _mm256_set1_epi16(1);
+    const int8_t *row;
+    __m256i sum, product;
+    __m128i half;
+    int i, j;
+
+    for (i = 0; i < NNUE_L1; i++) {
+        row = weights + i * 2 * NNUE_HIDDEN;
+        sum = _mm256_setzero_si256();
+        for (j = 0; j < 2 * NNUE_HIDDEN; j += 32) {
+            product = _mm256_maddubs_epi16(_mm256_loadu_si256((const __m256i *) (input + j)), _mm256_loadu_si256((const __m256i *) (row + j)));
+            sum = _mm256_add_epi32(sum, _mm256_madd_epi16(product, ones));
+        }
+        half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+        half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4E));
+        half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xB1));
+        out[i] = biases[i] + _mm_cvtsi128_si32(half);
+    }
+}
+// End AVX2 kernel implementations
+#endif
+
+// indexed by NNUE_KERNEL, kernels the build can't provide fall back to scalar and are never selected
+static const Kernels KERNELS[3] = {
+        {update_scalar, activate_scalar, dense_scalar},
+#ifdef CPP_CHESS_NNUE_X86
+        {update_sse41, activate_sse41, dense_sse41},
+        {update_avx2, activate_avx2, dense_avx2},
+#else
+        {update_scalar, activate_scalar, dense_scalar},
+        {update_scalar, activate_scalar, dense_scalar},
+#endif
+};
+
+static bool kernel_supported(NNUE_KERNEL kernel) {
+#ifdef CPP_CHESS_NNUE_X86
+    __builtin_cpu_init();
+    return kernel == NNUE_SCALAR || (kernel == NNUE_SSE41 && __builtin_cpu_supports("sse4.1")) ||
+           (kernel == NNUE_AVX2 && __builtin_cpu_supports("avx2"));
+#else
+    return kernel == NNUE_SCALAR;
+#endif
+}
+
+NNUE_KERNEL nnue_best_kernel() {
+    static const NNUE_KERNEL best = kernel_supported(NNUE_AVX2) ? NNUE_AVX2 : kernel_supported(NNUE_SSE41) ? NNUE_SSE41 : NNUE_SCALAR;
+    return best;
+}
+
+static NNUE_KERNEL active_kernel = nnue_best_kernel();
+
+bool nnue_set_kernel(NNUE_KERNEL kernel) {
+    if (!kernel_supported(kernel)) {
+        return false;
+    }
+    active_kernel = kernel;
+    return true;
+}
+
+NNUE_KERNEL nnue_kernel() {
+    return active_kernel;
+}
+
+const char *nnue_kernel_name(NNUE_KERNEL kernel) {
+    return kernel == NNUE_AVX2 ? "avx2" : kernel == NNUE_SSE41 ? "sse4.1" : "scalar";
+}
+
+// Begin Network function implementations
+bool Network::attach(const uint8_t *data, size_t size) {
+    uint32_t header[5];
+
+    feature_weights = nullptr;
+    if (size < NETWORK_SIZE) {
+        return false;
+    }
+    memcpy(header, data, sizeof(header));
+    if (memcmp(data, "CCNN", 4) != 0 || header[1] != VERSION || header[2] != (uint32_t) NNUE_INPUTS ||
+        header[3] != (uint32_t) NNUE_HIDDEN || header[4] != (uint32_t) NNUE_L1) {
+        return false;
+    }
+    feature_weights = (const int16_t *) (data + FEATURE_WEIGHTS_OFFSET);
+    feature_biases = (const int16_t *) (data + FEATURE_BIASES_OFFSET);
+    l1_weights = (const int8_t *) (data + L1_WEIGHTS_OFFSET);
+    l1_biases = (const int32_t *) (data + L1_BIASES_OFFSET);
+    l2_weights = (const int8_t *) (data + L2_WEIGHTS_OFFSET);
+    memcpy(&l2_bias, data + L2_BIAS_OFFSET, sizeof(l2_bias));
+    return true;
+}
+
+bool Network::load(const std::string &path) {
+    owned.clear();
+    if (!file.open(path) || !attach((const uint8_t *) file.data(), file.size())) {
+        file.close();
+        feature_weights = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool Network::save(const std::string &path) const {
+    std::vector<uint8_t> data(NETWORK_SIZE, 0);
+    uint32_t header[5] = {0, VERSION, (uint32_t) NNUE_INPUTS, (uint32_t) NNUE_HIDDEN, (uint32_t) NNUE_L1};
+
+    if (!is_loaded()) {
+        return false;
+    }
+    memcpy(header, "CCNN", 4);
+    memcpy(data.data(), header, sizeof(header));
+    memcpy(data.data() + FEATURE_WEIGHTS_OFFSET, feature_weights, NNUE_INPUTS * NNUE_HIDDEN * sizeof(int16_t));
+    memcpy(data.data() + FEATURE_BIASES_OFFSET, feature_biases, NNUE_HIDDEN * sizeof(int16_t));
+    memcpy(data.data() + L1_WEIGHTS_OFFSET, l1_weights, NNUE_L1 * 2 * NNUE_HIDDEN);
+    memcpy(data.data() + L1_BIASES_OFFSET, l1_biases, NNUE_L1 * sizeof(int32_t));
+    memcpy(data.data() + L2_WEIGHTS_OFFSET, l2_weights, NNUE_L1);
+    memcpy(data.data() + L2_BIAS_OFFSET, &l2_bias, sizeof(l2_bias));
+
+    std::ofstream out(path, std::ios::binary);
+    out.write((const char *) data.data(), (std::streamsize) data.size());
+    return (bool) out;
+}
+
+void Network::randomize(uint64_t seed) {
+    uint64_t state = seed | 1;
+    uint32_t header[5] = {0, VERSION, (uint32_t) NNUE_INPUTS, (uint32_t) NNUE_HIDDEN, (uint32_t) NNUE_L1};
+    size_t i;
+    // xorshift64, uniform in [-range, range]
+    auto next = [&state](int range) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return (int) (state % (uint64_t) (2 * range + 1)) - range;
+    };
+
+    file.close();
+    owned.assign(NETWORK_SIZE, 0);
+    memcpy(header, "CCNN", 4);
+    memcpy(owned.data(), header, sizeof(header));
+    for (i = 0; i < (size_t) NNUE_INPUTS * NNUE_HIDDEN; i++) {
+        ((int16_t *) (owned.data() + FEATURE_WEIGHTS_OFFSET))[i] = (int16_t) next(24);
+    }
+    for (i = 0; i < (size_t) NNUE_HIDDEN; i++) {
+        ((int16_t *) (owned.data() + FEATURE_BIASES_OFFSET))[i] = (int16_t) next(64);
+    }
+    for (i = 0; i < (size_t) NNUE_L1 * 2 * NNUE_HIDDEN; i++) {
+        ((int8_t *) (owned.data() + L1_WEIGHTS_OFFSET))[i] = (int8_t) next(48);
+    }
+    for (i = 0; i < (size_t) NNUE_L1; i++) {
+        ((int32_t *) (owned.data() + L1_BIASES_OFFSET))[i] = next(2048);
+        ((int8_t *) (owned.data() + L2_WEIGHTS_OFFSET))[i] = (int8_t) next(64);
+    }
+    attach(owned.data(), owned.size());
+}
+
+bool Network::is_loaded() const {
+    return feature_weights != nullptr;
+}
+// End Network function implementations
+
+// Begin NnueEvaluator function implementations
+NnueEvaluator::NnueEvaluator(const Network &network) : network(network), stack(MAX_GAME_PLY / 4) {}
+
+void NnueEvaluator::reset(const Position &position) {
+    const int16_t *rows[32];
+    Bitboard b;
+    int perspective, color, type, count, sq;
+
+    top = 0;
+    for (perspective = WHITE; perspective <= BLACK; perspective++) {
+        count = 0;
+        for (color = WHITE; color <= BLACK; color++) {
+            for (type = KING; type <= PAWN; type++) {
+                for (b = position.pieces[color][type]; b && count < 32;) {
+                    sq = pop_lsb(b);
+                    rows[count++] = network.feature_weights +
+                                    nnue_feature(static_cast<COLOR>(perspective), static_cast<COLOR>(color), static_cast<PIECE_TYPE>(type), sq) * NNUE_HIDDEN;
+                }
+            }
+        }
+        KERNELS[active_kernel].update(stack[0].values[perspective], network.feature_biases, rows, count, nullptr, 0);
+    }
+}
+
+void NnueEvaluator::push(const Board &board) {
+    const UndoState &undo = board.last_undo();
+    PackedMove move = undo.move;
+    COLOR them = static_cast<COLOR>(board.get_position().side_to_move);
+    COLOR us = them == WHITE ? BLACK : WHITE;
+    PIECE_TYPE moved = static_cast<PIECE_TYPE>(undo.moved_piece);
+    PIECE_TYPE captured = static_cast<PIECE_TYPE>(undo.captured_piece);
+    const int16_t *added[2], *removed[2];
+    int from = move.from(), to = move.to(), home, perspective, add_count, remove_count;
+    COLOR view;
+
+    if (++top == stack.size()) {
+        stack.emplace_back();
+    }
+    // a null move changes nothing but the side to move
+    if (move == NULL_MOVE) {
+        stack[top] = stack[top - 1];
+        return;
+    }
+
+    for (perspective = WHITE; perspective <= BLACK; perspective++) {
+        view = static_cast<COLOR>(perspective);
+        add_count = remove_count = 0;
+        removed[remove_count++] = network.feature_weights + nnue_feature(view, us, moved, from) * NNUE_HIDDEN;
+        added[add_count++] = network.feature_weights +
+                             nnue_feature(view, us, move.is_promotion() ? move.promotion_piece() : moved, to) * NNUE_HIDDEN;
+        if (move.is_castle()) {
+            home = make_square(square_row(from), to > from ? 7 : 0);
+            removed[remove_count++] = network.feature_weights + nnue_feature(view, us, ROOK, home) * NNUE_HIDDEN;
+            added[add_count++] = network.feature_weights + nnue_feature(view, us, ROOK, (from + to) / 2) * NNUE_HIDDEN;
+        } else if (captured != EMPTY) {
+            removed[remove_count++] = network.feature_weights +
+                                      nnue_feature(view, them, captured, move.flags() == EP_CAPTURE ? make_square(square_row(from), square_col(to)) : to) * NNUE_HIDDEN;
+        }
+        KERNELS[active_kernel].update(stack[top].values[perspective], stack[top - 1].values[perspective], added, add_count, removed, remove_count);
+    }
+}
+
+void NnueEvaluator::pop() {
+    top--;
+}
+
+int NnueEvaluator::evaluate(const Position &position) const {
+    alignas(64) uint8_t input[2 * NNUE_HIDDEN];
+    int32_t hidden[NNUE_L1];
+    const Accumulator &accumulator = stack[top];
+    int us = position.side_to_move, i, output;
+
+    // the side to move's half always comes first
+    KERNELS[active_kernel].activate(accumulator.values[us], accumulator.values[us ^ 1], input);
+    KERNELS[active_kernel].dense(input, network.l1_weights, network.l1_biases, hidden);
+    output = network.l2_bias;
+    for (i = 0; i < NNUE_L1; i++) {
+        output += std::min(std::max(hidden[i] >> NNUE_L1_SHIFT, 0), NNUE_CLIP) * network.l2_weights[i];
+    }
+    return output / NNUE_OUTPUT_SCALE;
+}
+
+const Accumulator &NnueEvaluator::current() const {
+    return stack[top];
+}
+// End NnueEvaluator function implementations
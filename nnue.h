@@ -0,0 +1,98 @@
+#pragma once
+
+#include "chess.h"
+#include "mapped_file.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifndef CPP_CHESS_NNUE_H
+#define CPP_CHESS_NNUE_H
+
+// efficiently updatable network: 768 piece-square inputs seen from each side -> NNUE_HIDDEN accumulator per side
+// -> NNUE_L1 -> 1. everything after the accumulator is integer arithmetic on clipped 8 bit activations
+const int NNUE_INPUTS = 768;
+const int NNUE_HIDDEN = 128;
+const int NNUE_L1 = 32;
+// activations are clipped to [0, NNUE_CLIP], the first dense layer's sums are shifted down by NNUE_L1_SHIFT
+const int NNUE_CLIP = 127;
+const int NNUE_L1_SHIFT = 6;
+// the output is divided by this to give centipawns
+const int NNUE_OUTPUT_SCALE = 16;
+
+typedef enum {NNUE_SCALAR, NNUE_SSE41, NNUE_AVX2} NNUE_KERNEL;
+
+// the best kernel this CPU can run, decided once at startup
+NNUE_KERNEL nnue_best_kernel();
+// false if the CPU can't run it. applies to every evaluator in the process
+bool nnue_set_kernel(NNUE_KERNEL kernel);
+NNUE_KERNEL nnue_kernel();
+const char *nnue_kernel_name(NNUE_KERNEL kernel);
+
+// the weights, either mapped straight from a file or owned (for generated networks). file layout, little endian,
+// every block starting on a 64 byte boundary:
+//   header (64 bytes): "CCNN", uint32 version, uint32 inputs, hidden, l1, then zeros
+//   int16 feature_weights[NNUE_INPUTS][NNUE_HIDDEN], int16 feature_biases[NNUE_HIDDEN]
+//   int8 l1_weights[NNUE_L1][2 * NNUE_HIDDEN], int32 l1_biases[NNUE_L1]
+//   int8 l2_weights[NNUE_L1], int32 l2_bias
+class Network {
+public:
+    static const uint32_t VERSION = 1;
+
+    Network() = default;
+    Network(const Network &) = delete;
+    Network &operator=(const Network &) = delete;
+
+    // false (and the network left empty) if the file is missing, truncated or built for other dimensions
+    bool load(const std::string &path);
+    bool save(const std::string &path) const;
+    // random weights in a sensible range, for tests and benchmarks
+    void randomize(uint64_t seed);
+    bool is_loaded() const;
+
+    const int16_t *feature_weights = nullptr;
+    const int16_t *feature_biases = nullptr;
+    const int8_t *l1_weights = nullptr;
+    const int32_t *l1_biases = nullptr;
+    const int8_t *l2_weights = nullptr;
+    int32_t l2_bias = 0;
+
+private:
+    bool attach(const uint8_t *data, size_t size);
+
+    MappedFile file;
+    std::vector<uint8_t> owned;
+};
+
+// first layer output for both perspectives, indexed by COLOR
+struct alignas(64) Accumulator {
+    int16_t values[2][NNUE_HIDDEN];
+};
+
+// accumulators for the positions along a line of play. push() reads the feature deltas of the last move off the
+// board's undo record, so keeping in step costs a few vector additions per move instead of a refresh
+class NnueEvaluator {
+public:
+    explicit NnueEvaluator(const Network &network);
+
+    // rebuilds the accumulator from scratch and forgets the line
+    void reset(const Position &position);
+    // call right after board.push() or board.push_null()
+    void push(const Board &board);
+    void pop();
+    int evaluate(const Position &position) const;
+    const Accumulator &current() const;
+
+private:
+    const Network &network;
+    std::vector<Accumulator> stack;
+    size_t top = 0;
+};
+
+// feature index of a piece as seen by perspective, the board is flipped for black so both sides see "their" pieces
+inline int nnue_feature(COLOR perspective, COLOR color, PIECE_TYPE type, int sq) {
+    return perspective == WHITE ? (color == WHITE ? 0 : 384) + type * 64 + sq : (color == BLACK ? 0 : 384) + type * 64 + (sq ^ 56);
+}
+
+#endif //CPP_CHESS_NNUE_H
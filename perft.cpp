@@ -0,0 +1,191 @@
+#include "perft.h"
+
+#include <chrono>
+
+const std::vector<PerftPosition> PERFT_SUITE = {
+        {"start position", "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+                {1, 20, 400, 8902, 197281, 4865609, 119060324, 3195901860ULL}},
+        {"kiwipete", "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+                {1, 48, 2039, 97862, 4085603, 193690690, 8031647685ULL, 0}},
+        {"position 3", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+                {1, 14, 191, 2812, 43238, 674624, 11030083, 178633661}},
+        {"position 4", "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+                {1, 6, 264, 9467, 422333, 15833292, 706045033, 0}},
+        {"position 5", "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+                {1, 44, 1486, 62379, 2103487, 89941194, 0, 0}},
+        {"position 6", "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+                {1, 46, 2079, 89890, 3894594, 164075551, 6923051137ULL, 0}},
+        {"illegal en-passant 1", "3k4/3p4/8/K1P4r/8/8/8/8 b - - 0 1",
+                {1, 0, 0, 0, 0, 0, 1134888, 0}},
+        {"illegal en-passant 2", "8/8/4k3/8/2p5/8/B2P2K1/8 w - - 0 1",
+                {1, 0, 0, 0, 0, 0, 1015133, 0}},
+        {"en-passant gives check", "8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1",
+                {1, 0, 0, 0, 0, 0, 1440467, 0}},
+        {"short castle gives check", "5k2/8/8/8/8/8/8/4K2R w K - 0 1",
+                {1, 0, 0, 0, 0, 0, 661072, 0}},
+        {"long castle gives check", "3k4/8/8/8/8/8/8/R3K3 w Q - 0 1",
+                {1, 0, 0, 0, 0, 0, 803711, 0}},
+        {"castling rights", "r3k2r/1b4bq/8/8/8/8/7B/R3K2R w KQkq - 0 1",
+                {1, 0, 0, 0, 1274206, 0, 0, 0}},
+        {"castling prevented", "r3k2r/8/3Q4/8/8/5q2/8/R3K2R b KQkq - 0 1",
+                {1, 0, 0, 0, 1720476, 0, 0, 0}},
+        {"promote out of check", "2K2r2/4P3/8/8/8/8/8/3k4 w - - 0 1",
+                {1, 0, 0, 0, 0, 0, 3821001, 0}},
+        {"discovered check", "8/8/1P2K3/8/2n5/1q6/8/5k2 b - - 0 1",
+                {1, 0, 0, 0, 0, 1004658, 0, 0}},
+        {"promote to give check", "4k3/1P6/8/8/8/8/K7/8 w - - 0 1",
+                {1, 0, 0, 0, 0, 0, 217342, 0}},
+        {"underpromote to give check", "8/P1k5/K7/8/8/8/8/8 w - - 0 1",
+                {1, 0, 0, 0, 0, 0, 92683, 0}},
+        {"self stalemate", "K1k5/8/P7/8/8/8/8/8 w - - 0 1",
+                {1, 0, 0, 0, 0, 0, 2217, 0}},
+        {"stalemate and checkmate 1", "8/k1P5/8/1K6/8/8/8/8 w - - 0 1",
+                {1, 0, 0, 0, 0, 0, 0, 567584}},
+        {"stalemate and checkmate 2", "8/8/2k5/5q2/5n2/8/5K2/8 b - - 0 1",
+                {1, 0, 0, 0, 23527, 0, 0, 0}},
+};
+
+uint64_t perft(Board &board, int depth) {
+    MoveList list;
+    uint64_t nodes = 0;
+
+    if (depth == 0) {
+        return 1;
+    }
+    board.legal_moves(list);
+    if (depth == 1) {
+        return list.size;
+    }
+    for (PackedMove move : list) {
+        board.push(move);
+        nodes += perft(board, depth - 1);
+        board.pop();
+    }
+    return nodes;
+}
+
+uint64_t perft_full(Board &board, int depth) {
+    MoveList list;
+    uint64_t nodes = 0;
+
+    if (depth == 0) {
+        return 1;
+    }
+    board.legal_moves(list);
+    for (PackedMove move : list) {
+        board.push(move);
+        nodes += perft_full(board, depth - 1);
+        board.pop();
+    }
+    return nodes;
+}
+
+// counts above 48 bits don't fit an entry's payload and are simply not stored
+static const uint64_t MAX_STORED_NODES = (1ULL << 48) - 1;
+
+uint64_t perft_hashed(Board &board, int depth, TranspositionTable &table) {
+    MoveList list;
+    TTHit hit;
+    uint64_t key, nodes = 0;
+
+    if (depth <= 1) {
+        return perft(board, depth);
+    }
+    key = board.key() ^ (0x9E3779B97F4A7C15ULL * (uint64_t) depth);
+    if (table.probe(key, hit) && hit.depth == depth) {
+        return hit.payload;
+    }
+
+    board.legal_moves(list);
+    for (PackedMove move : list) {
+        board.push(move);
+        nodes += perft_hashed(board, depth - 1, table);
+        board.pop();
+    }
+    if (nodes <= MAX_STORED_NODES) {
+        table.store(key, depth, 0, nodes);
+    }
+    return nodes;
+}
+
+std::vector<PerftDivide> perft_divide(Board &board, int depth, bool bulk) {
+    std::vector<PerftDivide> divide;
+    MoveList list;
+
+    board.legal_moves(list);
+    for (PackedMove move : list) {
+        board.push(move);
+        divide.push_back({move, bulk ? perft(board, depth - 1) : perft_full(board, depth - 1)});
+        board.pop();
+    }
+    return divide;
+}
+
+// subtrees shallower than this are never split, the task overhead would outweigh the work
+static const int SPLIT_DEPTH = 4;
+
+struct PerftJob {
+    ThreadPool *pool;
+    bool bulk;
+    TranspositionTable *table;
+    std::vector<Board> boards;
+    std::vector<PerftThreadStats> stats;
+};
+
+static void perft_task(PerftJob &job, const Position &position, int depth, int worker) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    Board &board = job.boards[worker];
+    MoveList list;
+    Position child;
+
+    board.set_position(position);
+    if (depth >= SPLIT_DEPTH && job.pool->idle_workers() > 0) {
+        board.legal_moves(list);
+        for (PackedMove move : list) {
+            child = position.after(move);
+            job.pool->submit([&job, child, depth](int w) { perft_task(job, child, depth - 1, w); });
+        }
+    } else {
+        if (job.table) {
+            job.stats[worker].nodes += perft_hashed(board, depth, *job.table);
+        } else {
+            job.stats[worker].nodes += job.bulk ? perft(board, depth) : perft_full(board, depth);
+        }
+    }
+    job.stats[worker].tasks++;
+    job.stats[worker].busy_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+uint64_t perft_parallel(const Board &board, int depth, ThreadPool &pool, bool bulk, std::vector<PerftThreadStats> *stats,
+                        TranspositionTable *table) {
+    PerftJob job {&pool, bulk, table, std::vector<Board>(pool.size()), std::vector<PerftThreadStats>(pool.size())};
+    Board root;
+    MoveList list;
+    Position child;
+    uint64_t nodes = 0;
+    int i;
+
+    board.fork(root);
+    if (depth <= 1) {
+        // counted on the calling thread, the workers report nothing but there is still a line per worker
+        if (stats) {
+            *stats = job.stats;
+        }
+        return bulk ? perft(root, depth) : perft_full(root, depth);
+    }
+    root.legal_moves(list);
+    for (PackedMove move : list) {
+        child = root.get_position().after(move);
+        pool.submit([&job, child, depth](int worker) { perft_task(job, child, depth - 1, worker); });
+    }
+    pool.wait();
+
+    for (i = 0; i < pool.size(); i++) {
+        nodes += job.stats[i].nodes;
+        job.stats[i].steals = pool.steals(i);
+    }
+    if (stats) {
+        *stats = job.stats;
+    }
+    return nodes;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "chess.h"
+#include "thread_pool.h"
+#include "tt.h"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#ifndef CPP_CHESS_PERFT_H
+#define CPP_CHESS_PERFT_H
+
+// reference position with its known leaf counts, nodes[d] is the count at depth d (0 where it isn't listed)
+struct PerftPosition {
+    const char *name;
+    const char *fen;
+    std::array<uint64_t, 8> nodes;
+};
+
+// the usual reference positions plus the en-passant/castling/promotion edge cases collected on talkchess
+extern const std::vector<PerftPosition> PERFT_SUITE;
+
+struct PerftDivide {
+    PackedMove move;
+    uint64_t nodes;
+};
+
+// what one worker did during a parallel perft, padded to a cache line so the workers never share one
+struct alignas(64) PerftThreadStats {
+    uint64_t nodes = 0;
+    uint64_t tasks = 0;
+    uint64_t steals = 0;
+    double busy_seconds = 0;
+};
+
+// leaf nodes at the given depth, the last ply is counted straight from the move list (bulk counting)
+uint64_t perft(Board &board, int depth);
+// same count, but every leaf is pushed and popped, which is what a search pays for
+uint64_t perft_full(Board &board, int depth);
+// bulk counted perft that memoises subtree counts in the table, the key is salted with the depth
+uint64_t perft_hashed(Board &board, int depth, TranspositionTable &table);
+// the leaf count below each root move
+std::vector<PerftDivide> perft_divide(Board &board, int depth, bool bulk = true);
+// perft spread over the pool: one task per root move, and a task big enough to be worth it splits into its
+// children whenever a worker is idle. every worker searches on its own Board, stats (if given) gets one entry each.
+// with a table the workers share it and count with perft_hashed
+uint64_t perft_parallel(const Board &board, int depth, ThreadPool &pool, bool bulk = true,
+                        std::vector<PerftThreadStats> *stats = nullptr, TranspositionTable *table = nullptr);
+
+#endif //CPP_CHESS_PERFT_H
@@ -0,0 +1,190 @@
+//
+// Command line perft: counts leaf nodes from a FEN, with a divide mode and the reference suite.
+//
+// usage: perft [--fen FEN] [--depth N] [--divide] [--no-bulk] [--threads N] [--hash MB] [--huge-pages]
+//              [--profile] [--profile-json FILE] [--profile-csv FILE]
+//        perft --suite [--depth N]     (checks every reference position at its deepest listed depth <= N,
+//                                      or without --depth the deepest one under SUITE_NODE_LIMIT nodes)
+//        the profile options print or save the instrumentation counters (see profile.h), which are only
+//        collected when the library was configured with -DCPP_CHESS_PROFILE=ON
+//
+
+#include "perft.h"
+#include "profile.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+static const uint64_t SUITE_NODE_LIMIT = 200000000;
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void report(uint64_t nodes, double seconds) {
+    std::cout << "nodes " << nodes << " time " << seconds << "s nps " << (uint64_t) (nodes / std::max(seconds, 1e-9)) << std::endl;
+}
+
+static void report_table(const TranspositionTable &table) {
+    TTStats stats = table.stats();
+    size_t huge = table.huge_page_bytes();
+
+    std::cout << "hash " << table.size_bytes() / (1024 * 1024) << "MB";
+    if (huge > 0) {
+        std::cout << " (" << huge / (1024 * 1024) << "MB in huge pages)";
+    }
+    std::cout << " probes " << stats.probes << " hits " << stats.hits << " misses " << stats.misses << " hit rate "
+              << (stats.probes ? 100.0 * stats.hits / stats.probes : 0) << "% stores " << stats.stores
+              << " collisions " << stats.collisions << std::endl;
+}
+
+static uint64_t run_parallel(const Board &board, int depth, bool bulk, int threads, TranspositionTable *table) {
+    ThreadPool pool(threads);
+    std::vector<PerftThreadStats> stats;
+    uint64_t nodes;
+    int i;
+
+    nodes = perft_parallel(board, depth, pool, bulk, &stats, table);
+    for (i = 0; i < pool.size(); i++) {
+        std::cout << "thread " << i << ": nodes " << stats[i].nodes << " tasks " << stats[i].tasks << " steals "
+                  << stats[i].steals << " busy " << stats[i].busy_seconds << "s nps "
+                  << (uint64_t) (stats[i].nodes / std::max(stats[i].busy_seconds, 1e-9)) << std::endl;
+    }
+    return nodes;
+}
+
+// max_depth 0 means no explicit depth was given
+static int run_suite(int max_depth, bool bulk) {
+    Board board = Board();
+    std::chrono::steady_clock::time_point start;
+    uint64_t nodes, total_nodes = 0;
+    double seconds, total_seconds = 0;
+    int depth, failures = 0;
+
+    for (const PerftPosition &position : PERFT_SUITE) {
+        for (depth = max_depth ? std::min(max_depth, 7) : 7; depth > 0; depth--) {
+            if (position.nodes[depth] && (max_depth || position.nodes[depth] <= SUITE_NODE_LIMIT)) {
+                break;
+            }
+        }
+        if (depth == 0) {
+            continue;
+        }
+        board.set_fen(position.fen);
+        start = std::chrono::steady_clock::now();
+        nodes = bulk ? perft(board, depth) : perft_full(board, depth);
+        seconds = seconds_since(start);
+        total_nodes += nodes;
+        total_seconds += seconds;
+
+        std::cout << (nodes == position.nodes[depth] ? "ok   " : "FAIL ") << position.name << " depth " << depth << ": ";
+        report(nodes, seconds);
+        if (nodes != position.nodes[depth]) {
+            std::cout << "     expected " << position.nodes[depth] << std::endl;
+            failures++;
+        }
+    }
+    std::cout << "total: ";
+    report(total_nodes, total_seconds);
+    return failures ? 1 : 0;
+}
+
+// the profile goes to stdout as a table and to the files named (if any) as JSON and CSV, false if one can't be written
+static bool write_profile(bool print, const std::string &json_path, const std::string &csv_path) {
+    ProfileReport report = profile_report();
+    std::ofstream json, csv;
+
+    if (print) {
+        write_profile_report(std::cout, report);
+    }
+    if (!json_path.empty()) {
+        json.open(json_path);
+        write_profile_json(json, report);
+    }
+    if (!csv_path.empty()) {
+        csv.open(csv_path);
+        write_profile_csv(csv, report);
+    }
+    return (json_path.empty() || json.good()) && (csv_path.empty() || csv.good());
+}
+
+int main(int argc, char **argv) {
+    Board board = Board();
+    std::string fen = STARTING_FEN, profile_json, profile_csv;
+    std::chrono::steady_clock::time_point start;
+    uint64_t nodes = 0;
+    int i, depth = 0, threads = 1, hash_megabytes = 0;
+    bool divide = false, bulk = true, suite = false, huge_pages = false, profile = false;
+    std::unique_ptr<TranspositionTable> table;
+    char uci[6];
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--fen") && i + 1 < argc) {
+            fen = argv[++i];
+        } else if (!strcmp(argv[i], "--depth") && i + 1 < argc) {
+            depth = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--divide")) {
+            divide = true;
+        } else if (!strcmp(argv[i], "--no-bulk")) {
+            bulk = false;
+        } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--hash") && i + 1 < argc) {
+            hash_megabytes = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--huge-pages")) {
+            huge_pages = true;
+        } else if (!strcmp(argv[i], "--suite")) {
+            suite = true;
+        } else if (!strcmp(argv[i], "--profile")) {
+            profile = true;
+        } else if (!strcmp(argv[i], "--profile-json") && i + 1 < argc) {
+            profile_json = argv[++i];
+        } else if (!strcmp(argv[i], "--profile-csv") && i + 1 < argc) {
+            profile_csv = argv[++i];
+        } else {
+            std::cerr << "unknown argument " << argv[i] << std::endl;
+            return 2;
+        }
+    }
+
+    profile_reset();
+    if (suite) {
+        i = run_suite(depth, bulk);
+        return write_profile(profile, profile_json, profile_csv) ? i : 2;
+    }
+    if (!depth) {
+        depth = 5;
+    }
+    if (!board.set_fen(fen)) {
+        std::cerr << "invalid fen: " << fen << std::endl;
+        return 2;
+    }
+
+    if (hash_megabytes > 0) {
+        table = std::make_unique<TranspositionTable>(hash_megabytes, huge_pages);
+    }
+
+    start = std::chrono::steady_clock::now();
+    if (divide && depth > 0) {
+        for (const PerftDivide &entry : perft_divide(board, depth, bulk)) {
+            format_uci(entry.move, uci);
+            std::cout << uci << ": " << entry.nodes << std::endl;
+            nodes += entry.nodes;
+        }
+    } else if (threads != 1) {
+        nodes = run_parallel(board, depth, bulk, threads, table.get());
+    } else if (table) {
+        nodes = perft_hashed(board, depth, *table);
+    } else {
+        nodes = bulk ? perft(board, depth) : perft_full(board, depth);
+    }
+    report(nodes, seconds_since(start));
+    if (table) {
+        report_table(*table);
+    }
+    return write_profile(profile, profile_json, profile_csv) ? 0 : 2;
+}
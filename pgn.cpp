@@ -0,0 +1,522 @@
+#include "pgn.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// characters that end a SAN or move number token
+static bool ends_token(char c) {
+    return is_space(c) || c == '{' || c == '}' || c == '(' || c == ')' || c == ';' || c == '$';
+}
+
+// Begin SAN implementations
+static bool is_piece_letter(char c) {
+    return c == 'K' || c == 'Q' || c == 'R' || c == 'B' || c == 'N';
+}
+
+// the move from `from` to `to` if it is legal, with the flags the position implies
+static bool legal_candidate(const Position &position, int from, int to, int promotion, PackedMove &move) {
+    COLOR them = position.side_to_move == WHITE ? BLACK : WHITE;
+    int flags = QUIET;
+
+    if (position.piece_on(from) == PAWN && to == position.ep_square && square_col(from) != square_col(to)) {
+        flags = EP_CAPTURE;
+    } else if (position.piece_on(from) == PAWN && abs(to - from) == 16) {
+        flags = DOUBLE_PUSH;
+    } else {
+        if (position.occupancy[them] & square_bb(to)) {
+            flags = CAPTURE;
+        }
+        if (promotion != EMPTY) {
+            flags |= KNIGHT_PROMOTION | (KNIGHT - promotion);
+        }
+    }
+    move = PackedMove(from, to, flags);
+    return is_legal(position, move);
+}
+
+PackedMove parse_san(const Position &position, std::string_view san) {
+    COLOR us = static_cast<COLOR>(position.side_to_move);
+    int type = PAWN, promotion = EMPTY, from, to, from_col = -1, from_row = -1, forward = us == WHITE ? 8 : -8, matches = 0;
+    Bitboard candidates;
+    PackedMove move, found = NULL_MOVE;
+    size_t i = 0;
+
+    while (!san.empty() && (san.back() == '+' || san.back() == '#' || san.back() == '!' || san.back() == '?')) {
+        san.remove_suffix(1);
+    }
+    if (san == "O-O" || san == "0-0" || san == "O-O-O" || san == "0-0-0") {
+        from = position.king_square(us);
+        move = PackedMove(from, san.size() == 3 ? from + 2 : from - 2, san.size() == 3 ? KING_CASTLE : QUEEN_CASTLE);
+        return is_legal(position, move) ? move : NULL_MOVE;
+    }
+
+    if (!san.empty() && is_piece_letter(san[0])) {
+        type = piece_from_char((char) (san[0] - 'A' + 'a'));
+        i = 1;
+    }
+    // promotion suffix, "e8=Q" or "e8Q"
+    if (san.size() >= 2 && is_piece_letter(san.back()) && san.back() != 'K') {
+        promotion = piece_from_char((char) (san.back() - 'A' + 'a'));
+        san.remove_suffix(san[san.size() - 2] == '=' ? 2 : 1);
+    }
+    if (san.size() < i + 2 || index(san[san.size() - 2]) > 7 || san.back() < '1' || san.back() > '8' ||
+        (promotion != EMPTY && type != PAWN)) {
+        return NULL_MOVE;
+    }
+    to = make_square(san.back() - '1', san[san.size() - 2] - 'a');
+
+    // whatever is left between the piece and the destination: a file, a rank or both, and the capture mark
+    for (san.remove_suffix(2); i < san.size(); i++) {
+        if (index(san[i]) <= 7) {
+            from_col = index(san[i]);
+        } else if ('1' <= san[i] && san[i] <= '8') {
+            from_row = san[i] - '1';
+        } else if (san[i] != 'x' && san[i] != ':' && san[i] != '-') {
+            return NULL_MOVE;
+        }
+    }
+
+    if (type == PAWN) {
+        // a pawn names its file when it captures, otherwise it came straight from behind
+        if (from_col >= 0 && from_col != square_col(to)) {
+            if (abs(from_col - square_col(to)) != 1 || to - forward < 0 || to - forward > 63) {
+                return NULL_MOVE;
+            }
+            return legal_candidate(position, make_square(square_row(to - forward), from_col), to, promotion, move) ? move : NULL_MOVE;
+        }
+        if (to - forward < 0 || to - forward > 63) {
+            return NULL_MOVE;
+        }
+        if (position.pieces[us][PAWN] & square_bb(to - forward)) {
+            return legal_candidate(position, to - forward, to, promotion, move) ? move : NULL_MOVE;
+        }
+        if (to - 2 * forward >= 0 && to - 2 * forward <= 63 && (position.pieces[us][PAWN] & square_bb(to - 2 * forward))) {
+            return legal_candidate(position, to - 2 * forward, to, promotion, move) ? move : NULL_MOVE;
+        }
+        return NULL_MOVE;
+    }
+
+    candidates = position.attackers_to(to, position.occupied()) & position.pieces[us][type];
+    while (candidates) {
+        from = pop_lsb(candidates);
+        if ((from_col < 0 || square_col(from) == from_col) && (from_row < 0 || square_row(from) == from_row) &&
+            legal_candidate(position, from, to, EMPTY, move)) {
+            found = move;
+            matches++;
+        }
+    }
+    return matches == 1 ? found : NULL_MOVE;
+}
+
+size_t format_san(Board &board, PackedMove move, char *out) {
+    const Position &position = board.get_position();
+    COLOR us = static_cast<COLOR>(position.side_to_move);
+    PIECE_TYPE type = position.piece_on(move.from());
+    Bitboard others;
+    PackedMove other;
+    MoveList list;
+    bool same_col = false, same_row = false, ambiguous = false;
+    int from = move.from(), to = move.to(), sq;
+    char *p = out;
+
+    if (move.is_castle()) {
+        memcpy(p, move.flags() == KING_CASTLE ? "O-O" : "O-O-O", move.flags() == KING_CASTLE ? 3 : 5);
+        p += move.flags() == KING_CASTLE ? 3 : 5;
+    } else {
+        if (type == PAWN) {
+            if (move.is_capture()) {
+                *p++ = COLUMN_LETTERS[square_col(from)];
+            }
+        } else {
+            *p++ = NAME_TABLE[7 + type];
+            // the other pieces of the same kind that could go there decide how much of the origin is needed
+            others = position.attackers_to(to, position.occupied()) & position.pieces[us][type] & ~square_bb(from);
+            while (others) {
+                sq = pop_lsb(others);
+                if (legal_candidate(position, sq, to, EMPTY, other)) {
+                    ambiguous = true;
+                    same_col |= square_col(sq) == square_col(from);
+                    same_row |= square_row(sq) == square_row(from);
+                }
+            }
+            if (ambiguous && (!same_col || same_row)) {
+                *p++ = COLUMN_LETTERS[square_col(from)];
+            }
+            if (ambiguous && same_col) {
+                *p++ = (char) ('1' + square_row(from));
+            }
+        }
+        if (move.is_capture()) {
+            *p++ = 'x';
+        }
+        *p++ = COLUMN_LETTERS[square_col(to)];
+        *p++ = (char) ('1' + square_row(to));
+        if (move.is_promotion()) {
+            *p++ = '=';
+            *p++ = NAME_TABLE[7 + move.promotion_piece()];
+        }
+    }
+
+    board.push(move);
+    if (board.in_check()) {
+        board.legal_moves(list);
+        *p++ = list.size == 0 ? '#' : '+';
+    }
+    board.pop();
+    *p = '\0';
+    return (size_t) (p - out);
+}
+// End SAN implementations
+
+// Begin PgnGame function implementations
+std::string_view PgnGame::tag(std::string_view name) const {
+    std::string_view rest = tags, line;
+    size_t end, quote, close;
+
+    while (!rest.empty()) {
+        end = rest.find('\n');
+        line = rest.substr(0, end);
+        rest.remove_prefix(end == std::string_view::npos ? rest.size() : end + 1);
+        line.remove_prefix(std::min(line.find_first_not_of(" \t"), line.size()));
+        if (line.size() < name.size() + 2 || line[0] != '[' || line.substr(1, name.size()) != name || !is_space(line[name.size() + 1])) {
+            continue;
+        }
+        quote = line.find('"', name.size() + 1);
+        if (quote == std::string_view::npos) {
+            return std::string_view();
+        }
+        // the closing quote is the first one not escaped by a backslash
+        for (close = quote + 1; close < line.size() && line[close] != '"'; close++) {
+            close += line[close] == '\\';
+        }
+        return line.substr(quote + 1, std::min(close, line.size()) - quote - 1);
+    }
+    return std::string_view();
+}
+
+GAME_RESULT PgnGame::result() const {
+    std::string_view value = tag("Result");
+
+    return value == "1-0" ? RESULT_WHITE_WINS : value == "0-1" ? RESULT_BLACK_WINS : value == "1/2-1/2" ? RESULT_DRAW : RESULT_UNKNOWN;
+}
+// End PgnGame function implementations
+
+// Begin PgnReader function implementations
+PgnReader::PgnReader(size_t chunk_size) : chunk_size(std::max<size_t>(chunk_size, 64)) {}
+
+bool PgnReader::open(const std::string &path) {
+    in.close();
+    in.clear();
+    in.open(path, std::ios::binary);
+    begin = end = 0;
+    consumed = 0;
+    at_eof = !in.is_open();
+    return in.is_open();
+}
+
+// moves the unread bytes to the front and appends the next chunk, false once the file has nothing more
+bool PgnReader::fill() {
+    size_t got;
+
+    if (at_eof) {
+        return false;
+    }
+    if (begin > 0) {
+        memmove(buffer.data(), buffer.data() + begin, end - begin);
+        consumed += begin;
+        end -= begin;
+        begin = 0;
+    }
+    if (buffer.size() < end + chunk_size) {
+        buffer.resize(end + chunk_size);
+    }
+    in.read(buffer.data() + end, (std::streamsize) chunk_size);
+    got = (size_t) in.gcount();
+    end += got;
+    if (got < chunk_size) {
+        at_eof = true;
+    }
+    return got > 0;
+}
+
+bool PgnReader::next(PgnGame &game) {
+    const char *data;
+    size_t pos, line_end, first, tags_end, movetext_begin, game_end;
+    bool in_movetext, in_comment, complete;
+    const void *newline;
+    char c;
+
+    while (true) {
+        data = buffer.data();
+        while (begin < end && is_space(data[begin])) {
+            begin++;
+        }
+        if (begin == end) {
+            if (!fill()) {
+                return false;
+            }
+            continue;
+        }
+
+        // walk the game line by line. a line that starts with '[' outside a comment ends the movetext
+        in_movetext = in_comment = false;
+        complete = false;
+        tags_end = movetext_begin = game_end = begin;
+        for (pos = begin; pos < end;) {
+            newline = memchr(data + pos, '\n', end - pos);
+            if (!newline && !at_eof) {
+                break;
+            }
+            line_end = newline ? (size_t) ((const char *) newline - data) : end;
+            for (first = pos; first < line_end && (data[first] == ' ' || data[first] == '\t' || data[first] == '\r'); first++) {}
+            if (!in_comment && first < line_end && data[first] == '[') {
+                if (in_movetext) {
+                    complete = true;
+                    break;
+                }
+                tags_end = line_end;
+            } else if (first < line_end && data[first] != '%') {
+                if (!in_movetext) {
+                    in_movetext = true;
+                    movetext_begin = first;
+                }
+                for (; first < line_end; first++) {
+                    c = data[first];
+                    if (in_comment) {
+                        in_comment = c != '}';
+                    } else if (c == '{') {
+                        in_comment = true;
+                    } else if (c == ';') {
+                        break;
+                    }
+                }
+            }
+            pos = line_end + 1;
+            game_end = line_end;
+        }
+        if (!complete && !at_eof) {
+            // the game may run past the buffer, read on and walk it again
+            fill();
+            continue;
+        }
+
+        game.text = std::string_view(data + begin, game_end - begin);
+        game.tags = std::string_view(data + begin, tags_end - begin);
+        game.movetext = in_movetext ? std::string_view(data + movetext_begin, game_end - movetext_begin) : std::string_view();
+        begin = std::min(pos, end);
+        return true;
+    }
+}
+
+uint64_t PgnReader::offset() const {
+    return consumed + begin;
+}
+// End PgnReader function implementations
+
+// Begin replay implementations
+PgnReplay replay_pgn_game(const PgnGame &game, Board &board, uint64_t game_number, int worker, const PgnCallback &callback) {
+    std::string_view text = game.movetext, token, fen = game.tag("FEN");
+    PgnReplay replay = {true, false, 0, 0};
+    PgnPosition position = {game_number, worker, game.result(), &board, NULL_MOVE};
+    PackedMove move;
+    size_t i = 0, start;
+    int depth;
+
+    if (fen.empty()) {
+        board.reset();
+    } else if (!board.set_fen(fen)) {
+        replay.ok = false;
+        return replay;
+    }
+    replay.started = true;
+    if (callback) {
+        callback(position);
+    }
+
+    while (i < text.size()) {
+        if (is_space(text[i])) {
+            i++;
+        } else if (text[i] == '{') {
+            for (; i < text.size() && text[i] != '}'; i++) {}
+            i++;
+        } else if (text[i] == ';' || text[i] == '%') {
+            for (; i < text.size() && text[i] != '\n'; i++) {}
+        } else if (text[i] == '(') {
+            // variations nest, and may hold comments with parentheses of their own
+            for (depth = 0; i < text.size(); i++) {
+                if (text[i] == '{') {
+                    for (; i < text.size() && text[i] != '}'; i++) {}
+                } else if (text[i] == '(') {
+                    depth++;
+                } else if (text[i] == ')' && --depth == 0) {
+                    i++;
+                    break;
+                }
+            }
+        } else if (text[i] == '$') {
+            for (i++; i < text.size() && '0' <= text[i] && text[i] <= '9'; i++) {}
+        } else {
+            for (start = i; i < text.size() && !ends_token(text[i]); i++) {}
+            token = text.substr(start, i - start);
+            if (token == "1-0" || token == "0-1" || token == "1/2-1/2" || token == "*") {
+                break;
+            }
+            // move numbers, "12." or "12...", possibly glued to the move ("12.e4")
+            if ('1' <= token[0] && token[0] <= '9') {
+                start = token.find_first_not_of("0123456789");
+                if (start == std::string_view::npos || token[start] != '.') {
+                    replay.ok = false;
+                    replay.error_offset = i - token.size();
+                    return replay;
+                }
+                token.remove_prefix(std::min(token.find_first_not_of('.', start), token.size()));
+                if (token.empty()) {
+                    continue;
+                }
+            }
+            move = parse_san(board.get_position(), token);
+            if (move == NULL_MOVE) {
+                replay.ok = false;
+                replay.error_offset = i - token.size();
+                return replay;
+            }
+            board.push(move);
+            replay.plies++;
+            if (callback) {
+                position.move = move;
+                callback(position);
+            }
+        }
+    }
+    return replay;
+}
+
+// a batch is about this many bytes of whole games
+static const size_t PGN_BATCH_BYTES = 256 * 1024;
+
+struct PgnBatch {
+    std::string text;
+    // where each game's text, tags and movetext start within text, and how long they are
+    std::vector<size_t> spans;
+    uint64_t first_game;
+};
+
+struct alignas(64) PgnWorkerStats {
+    uint64_t positions = 0;
+    uint64_t failed_games = 0;
+};
+
+PgnStats replay_pgn_parallel(const std::string &path, ThreadPool &pool, const PgnCallback &callback) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    PgnStats stats = {0, 0, 0, 0};
+    PgnReader reader;
+    PgnGame game;
+    std::vector<Board> boards(pool.size());
+    std::vector<PgnWorkerStats> worker_stats(pool.size());
+    // batches are recycled, at most two per worker are read ahead
+    std::vector<std::unique_ptr<PgnBatch>> batches;
+    std::vector<PgnBatch *> free_batches;
+    std::mutex lock;
+    std::condition_variable returned;
+    PgnBatch *batch;
+    size_t i;
+
+    if (!reader.open(path)) {
+        return stats;
+    }
+    for (i = 0; i < (size_t) pool.size() * 2; i++) {
+        batches.emplace_back(new PgnBatch());
+        free_batches.push_back(batches.back().get());
+    }
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            returned.wait(guard, [&free_batches] { return !free_batches.empty(); });
+            batch = free_batches.back();
+            free_batches.pop_back();
+        }
+        batch->text.clear();
+        batch->spans.clear();
+        batch->first_game = stats.games;
+        while (batch->text.size() < PGN_BATCH_BYTES && reader.next(game)) {
+            batch->spans.push_back(batch->text.size());
+            batch->spans.push_back(game.tags.size());
+            batch->spans.push_back(game.movetext.empty() ? 0 : (size_t) (game.movetext.data() - game.text.data()));
+            batch->spans.push_back(game.movetext.size());
+            batch->text.append(game.text);
+            stats.games++;
+        }
+        if (batch->spans.empty()) {
+            break;
+        }
+        pool.submit([&, batch](int worker) {
+            PgnGame replayed;
+            PgnReplay replay;
+            size_t j;
+
+            for (j = 0; j < batch->spans.size(); j += 4) {
+                replayed.text = std::string_view(batch->text).substr(batch->spans[j]);
+                replayed.tags = replayed.text.substr(0, batch->spans[j + 1]);
+                replayed.movetext = replayed.text.substr(batch->spans[j + 2], batch->spans[j + 3]);
+                replay = replay_pgn_game(replayed, boards[worker], batch->first_game + j / 4, worker, callback);
+                worker_stats[worker].positions += replay.plies + replay.started;
+                worker_stats[worker].failed_games += !replay.ok;
+            }
+            std::lock_guard<std::mutex> guard(lock);
+            free_batches.push_back(batch);
+            returned.notify_one();
+        });
+    }
+    pool.wait();
+
+    for (const PgnWorkerStats &worker : worker_stats) {
+        stats.positions += worker.positions;
+        stats.failed_games += worker.failed_games;
+    }
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
+// End replay implementations
+
+// Begin converter implementations
+ConvertResult convert_pgn_games(const std::string &path, GameWriter &writer) {
+    ConvertResult result = {true, 0, 0};
+    PgnReader reader;
+    PgnGame game;
+    PgnReplay replay;
+    Board board;
+    bool written = false;
+
+    if (!reader.open(path)) {
+        result.ok = false;
+        return result;
+    }
+    while (reader.next(game)) {
+        result.line++;
+        written = false;
+        replay = replay_pgn_game(game, board, result.line - 1, 0, [&](const PgnPosition &position) {
+            if (position.move == NULL_MOVE) {
+                written = writer.begin_game(position.board->get_position(), position.board->fullmove_number());
+            } else {
+                written = written && writer.add_move(position.move);
+            }
+        });
+        if (!replay.ok || !written || !writer.end_game(game.result())) {
+            writer.discard_game();
+            result.ok = false;
+            return result;
+        }
+        result.games++;
+    }
+    result.line = 0;
+    return result;
+}
+// End converter implementations
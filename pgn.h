@@ -0,0 +1,109 @@
+#pragma once
+
+#include "chess.h"
+#include "game_file.h"
+#include "thread_pool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifndef CPP_CHESS_PGN_H
+#define CPP_CHESS_PGN_H
+
+// longest SAN format_san can produce ("Qa1xb2#" or "exd8=Q+") plus the NUL
+const size_t SAN_BUFFER_SIZE = 8;
+
+// the legal move written in standard algebraic notation, NULL_MOVE if there is none or it is ambiguous.
+// check marks and annotations ("+", "#", "!?") are ignored, castling may be written with zeros too
+PackedMove parse_san(const Position &position, std::string_view san);
+// writes the move (which must be legal) as SAN with a NUL, returns its length. the board is used to find out
+// whether the move gives check or mate and is left as it was
+size_t format_san(Board &board, PackedMove move, char *out);
+
+// one game as it stands in the file, the views stay valid until the reader moves on
+struct PgnGame {
+    // the whole game, tags and movetext
+    std::string_view text;
+    std::string_view tags;
+    std::string_view movetext;
+
+    // the value of a tag ("Event", "FEN", ...) with escapes left in, empty if the game doesn't have it
+    std::string_view tag(std::string_view name) const;
+    // the Result tag, RESULT_UNKNOWN without one
+    GAME_RESULT result() const;
+};
+
+// reads a PGN file in fixed size chunks, so files of any size go through in constant memory (as long as no single
+// game is bigger than the buffer, which then grows to fit). games are split at the first tag after the movetext
+class PgnReader {
+public:
+    static const size_t DEFAULT_CHUNK_SIZE = 1 << 20;
+
+    explicit PgnReader(size_t chunk_size = DEFAULT_CHUNK_SIZE);
+    bool open(const std::string &path);
+    // false at the end of the file
+    bool next(PgnGame &game);
+    // bytes consumed so far
+    uint64_t offset() const;
+
+private:
+    bool fill();
+
+    std::ifstream in;
+    std::vector<char> buffer;
+    size_t chunk_size;
+    size_t begin = 0;
+    size_t end = 0;
+    uint64_t consumed = 0;
+    bool at_eof = true;
+};
+
+// what replay_pgn_game got through
+struct PgnReplay {
+    bool ok;
+    // false if the start position couldn't be set up, nothing was played then
+    bool started;
+    int plies;
+    // offset into the movetext of the token that didn't parse, when !ok
+    size_t error_offset;
+};
+
+// the position reached after every move of a game, and the start position (with move NULL_MOVE)
+struct PgnPosition {
+    // games are numbered from 0 in file order
+    uint64_t game;
+    int worker;
+    GAME_RESULT result;
+    const Board *board;
+    PackedMove move;
+};
+
+typedef std::function<void(const PgnPosition &)> PgnCallback;
+
+// plays the game's moves on board from its start position (the FEN tag if there is one, the standard position
+// otherwise) and calls back for each position. comments, variations, NAGs and move numbers are skipped, replay
+// stops at the first move that isn't legal
+PgnReplay replay_pgn_game(const PgnGame &game, Board &board, uint64_t game_number, int worker, const PgnCallback &callback);
+
+struct PgnStats {
+    uint64_t games;
+    uint64_t positions;
+    // games with a move that didn't parse or a FEN tag that didn't, they are replayed up to that point
+    uint64_t failed_games;
+    double seconds;
+};
+
+// reads the file on the calling thread and replays batches of whole games on the pool, every worker on its own
+// Board. callbacks come from the pool's threads, the positions of one game in order, games in any order
+PgnStats replay_pgn_parallel(const std::string &path, ThreadPool &pool, const PgnCallback &callback);
+
+// streams the games of a PGN file into the writer, each from its FEN tag or the standard position and ending with
+// its Result tag. conversion stops at the first game that doesn't replay in full, line is then that game's number
+ConvertResult convert_pgn_games(const std::string &path, GameWriter &writer);
+
+#endif //CPP_CHESS_PGN_H
@@ -0,0 +1,210 @@
+#include "profile.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <mutex>
+#include <new>
+#include <vector>
+
+const std::array<const char *, PROFILE_COUNTER_COUNT> PROFILE_COUNTER_NAMES = {
+        "nodes", "make_moves", "unmake_moves", "null_moves", "generate_calls", "generated_moves",
+        "generated_captures", "generated_castles", "generated_ep", "generated_promotions", "allocations"
+};
+
+const std::array<const char *, PROFILE_TIMER_COUNT> PROFILE_TIMER_NAMES = {
+        "make_move", "unmake_move", "generate_moves", "evaluate", "tt_probe", "search"
+};
+
+// Begin registry implementations
+// every live thread's counters, plus what the threads that have exited since the last reset left behind
+struct ProfileRegistry {
+    std::mutex lock;
+    std::vector<ProfileCounters *> live;
+    std::array<uint64_t, PROFILE_COUNTER_COUNT> retired_counters {};
+    std::array<ProfileTimerStats, PROFILE_TIMER_COUNT> retired_timers {};
+    int retired_threads = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t start_ticks = profile_ticks();
+};
+
+// never destroyed, threads may still exit while static destructors run
+static ProfileRegistry &registry() {
+    static ProfileRegistry *instance = new ProfileRegistry();
+    return *instance;
+}
+
+static thread_local ProfileCounters *current = nullptr;
+
+// folds the thread's counts into the retired ones when the thread exits
+struct ProfileThreadExit {
+    ~ProfileThreadExit() {
+        ProfileRegistry &reg = registry();
+        std::lock_guard<std::mutex> guard(reg.lock);
+        int i;
+
+        if (!current) {
+            return;
+        }
+        for (i = 0; i < PROFILE_COUNTER_COUNT; i++) {
+            reg.retired_counters[i] += current->counters[i].load(std::memory_order_relaxed);
+        }
+        for (i = 0; i < PROFILE_TIMER_COUNT; i++) {
+            reg.retired_timers[i].calls += current->timer_calls[i].load(std::memory_order_relaxed);
+            reg.retired_timers[i].ticks += current->timer_ticks[i].load(std::memory_order_relaxed);
+        }
+        reg.retired_threads++;
+        reg.live.erase(std::find(reg.live.begin(), reg.live.end(), current));
+        delete current;
+        current = nullptr;
+    }
+};
+
+static thread_local ProfileThreadExit thread_exit;
+
+ProfileCounters &profile_counters() {
+    ProfileCounters *counters;
+
+    if (!current) {
+        // allocated before it is published, so the allocation it makes isn't counted against a half made entry
+        counters = new ProfileCounters();
+        (void) &thread_exit;
+        std::lock_guard<std::mutex> guard(registry().lock);
+        registry().live.push_back(counters);
+        current = counters;
+    }
+    return *current;
+}
+// End registry implementations
+
+void profile_reset() {
+    ProfileRegistry &reg = registry();
+    std::lock_guard<std::mutex> guard(reg.lock);
+    int i;
+
+    for (ProfileCounters *counters : reg.live) {
+        for (i = 0; i < PROFILE_COUNTER_COUNT; i++) {
+            counters->counters[i].store(0, std::memory_order_relaxed);
+        }
+        for (i = 0; i < PROFILE_TIMER_COUNT; i++) {
+            counters->timer_calls[i].store(0, std::memory_order_relaxed);
+            counters->timer_ticks[i].store(0, std::memory_order_relaxed);
+        }
+    }
+    reg.retired_counters.fill(0);
+    reg.retired_timers.fill({0, 0});
+    reg.retired_threads = 0;
+    reg.start = std::chrono::steady_clock::now();
+    reg.start_ticks = profile_ticks();
+}
+
+ProfileReport profile_report() {
+    ProfileRegistry &reg = registry();
+    std::lock_guard<std::mutex> guard(reg.lock);
+    ProfileReport report;
+    int i;
+
+    report.enabled = PROFILE_ENABLED;
+    report.threads = reg.retired_threads + (int) reg.live.size();
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - reg.start).count();
+    report.ticks_per_second = report.seconds > 0 ? (double) (profile_ticks() - reg.start_ticks) / report.seconds : 0;
+    report.counters = reg.retired_counters;
+    report.timers = reg.retired_timers;
+    for (ProfileCounters *counters : reg.live) {
+        for (i = 0; i < PROFILE_COUNTER_COUNT; i++) {
+            report.counters[i] += counters->counters[i].load(std::memory_order_relaxed);
+        }
+        for (i = 0; i < PROFILE_TIMER_COUNT; i++) {
+            report.timers[i].calls += counters->timer_calls[i].load(std::memory_order_relaxed);
+            report.timers[i].ticks += counters->timer_ticks[i].load(std::memory_order_relaxed);
+        }
+    }
+    return report;
+}
+
+uint64_t profile_thread_count(PROFILE_COUNTER counter) {
+    return current ? current->counters[counter].load(std::memory_order_relaxed) : 0;
+}
+
+// Begin report implementations
+static double timer_nanoseconds(const ProfileReport &report, const ProfileTimerStats &timer) {
+    return report.ticks_per_second > 0 ? timer.ticks * 1e9 / report.ticks_per_second : 0;
+}
+
+void write_profile_report(std::ostream &out, const ProfileReport &report) {
+    int i;
+
+    if (!report.enabled) {
+        out << "profiling not compiled in (configure with -DCPP_CHESS_PROFILE=ON)" << std::endl;
+        return;
+    }
+    out << "profile over " << report.seconds << "s, " << report.threads << " thread(s)" << std::endl;
+    for (i = 0; i < PROFILE_COUNTER_COUNT; i++) {
+        out << "  " << std::left << std::setw(22) << PROFILE_COUNTER_NAMES[i] << std::right << std::setw(16)
+            << report.counters[i] << std::endl;
+    }
+    for (i = 0; i < PROFILE_TIMER_COUNT; i++) {
+        out << "  " << std::left << std::setw(22) << PROFILE_TIMER_NAMES[i] << std::right << std::setw(16)
+            << report.timers[i].calls << " calls " << std::setw(12) << timer_nanoseconds(report, report.timers[i]) / 1e6
+            << " ms " << std::setw(10)
+            << (report.timers[i].calls ? timer_nanoseconds(report, report.timers[i]) / report.timers[i].calls : 0)
+            << " ns/call" << std::endl;
+    }
+}
+
+void write_profile_json(std::ostream &out, const ProfileReport &report) {
+    int i;
+
+    out << "{\"enabled\": " << (report.enabled ? "true" : "false") << ", \"threads\": " << report.threads
+        << ", \"seconds\": " << report.seconds << ", \"ticks_per_second\": " << report.ticks_per_second
+        << ", \"counters\": {";
+    for (i = 0; i < PROFILE_COUNTER_COUNT; i++) {
+        out << (i ? ", " : "") << "\"" << PROFILE_COUNTER_NAMES[i] << "\": " << report.counters[i];
+    }
+    out << "}, \"timers\": {";
+    for (i = 0; i < PROFILE_TIMER_COUNT; i++) {
+        out << (i ? ", " : "") << "\"" << PROFILE_TIMER_NAMES[i] << "\": {\"calls\": " << report.timers[i].calls
+            << ", \"ticks\": " << report.timers[i].ticks << ", \"ns\": " << timer_nanoseconds(report, report.timers[i])
+            << "}";
+    }
+    out << "}}" << std::endl;
+}
+
+void write_profile_csv(std::ostream &out, const ProfileReport &report) {
+    int i;
+
+    out << "kind,name,calls,value,ns" << std::endl;
+    for (i = 0; i < PROFILE_COUNTER_COUNT; i++) {
+        out << "counter," << PROFILE_COUNTER_NAMES[i] << ",," << report.counters[i] << "," << std::endl;
+    }
+    for (i = 0; i < PROFILE_TIMER_COUNT; i++) {
+        out << "timer," << PROFILE_TIMER_NAMES[i] << "," << report.timers[i].calls << "," << report.timers[i].ticks
+            << "," << timer_nanoseconds(report, report.timers[i]) << std::endl;
+    }
+}
+// End report implementations
+
+#ifdef CPP_CHESS_PROFILE
+// Begin allocation counting implementations
+// only threads that are already registered count, registering allocates and would recurse
+void *operator new(size_t size) {
+    void *ptr = malloc(size ? size : 1);
+
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    if (current) {
+        profile_add(current->counters[PROFILE_ALLOCATIONS], 1);
+    }
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    free(ptr);
+}
+// End allocation counting implementations
+#endif
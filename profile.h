@@ -0,0 +1,118 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+#ifndef CPP_CHESS_PROFILE_H
+#define CPP_CHESS_PROFILE_H
+
+// instrumentation of the hot paths, compiled in with -DCPP_CHESS_PROFILE=ON (which defines CPP_CHESS_PROFILE).
+// without it PROFILE_COUNT and PROFILE_SCOPE expand to nothing, the functions below still exist and report zeros
+#ifdef CPP_CHESS_PROFILE
+const bool PROFILE_ENABLED = true;
+#else
+const bool PROFILE_ENABLED = false;
+#endif
+
+typedef enum {
+    PROFILE_NODES,
+    PROFILE_MAKE_MOVES, PROFILE_UNMAKE_MOVES, PROFILE_NULL_MOVES,
+    PROFILE_GENERATE_CALLS, PROFILE_GENERATED_MOVES,
+    PROFILE_GENERATED_CAPTURES, PROFILE_GENERATED_CASTLES, PROFILE_GENERATED_EP, PROFILE_GENERATED_PROMOTIONS,
+    // every heap allocation of the process, the profiling build replaces operator new to count them
+    PROFILE_ALLOCATIONS,
+    PROFILE_COUNTER_COUNT
+} PROFILE_COUNTER;
+
+typedef enum {
+    TIMER_MAKE_MOVE, TIMER_UNMAKE_MOVE, TIMER_GENERATE_MOVES, TIMER_EVALUATE, TIMER_TT_PROBE, TIMER_SEARCH,
+    PROFILE_TIMER_COUNT
+} PROFILE_TIMER;
+
+// lower case names as they appear in the reports
+extern const std::array<const char *, PROFILE_COUNTER_COUNT> PROFILE_COUNTER_NAMES;
+extern const std::array<const char *, PROFILE_TIMER_COUNT> PROFILE_TIMER_NAMES;
+
+struct ProfileTimerStats {
+    uint64_t calls;
+    uint64_t ticks;
+};
+
+// one thread's counts. only the owning thread writes them (a relaxed load and store, no locked add), any thread may
+// read them for a report. padded so two threads never share a line
+struct alignas(64) ProfileCounters {
+    std::array<std::atomic<uint64_t>, PROFILE_COUNTER_COUNT> counters {};
+    std::array<std::atomic<uint64_t>, PROFILE_TIMER_COUNT> timer_calls {};
+    std::array<std::atomic<uint64_t>, PROFILE_TIMER_COUNT> timer_ticks {};
+};
+
+// sums over every thread that counted anything since the last reset, threads that have exited included
+struct ProfileReport {
+    bool enabled;
+    int threads;
+    double seconds;
+    // timer ticks per second, measured against the steady clock over the report's interval
+    double ticks_per_second;
+    std::array<uint64_t, PROFILE_COUNTER_COUNT> counters;
+    std::array<ProfileTimerStats, PROFILE_TIMER_COUNT> timers;
+};
+
+// the calling thread's counters, registered on first use
+ProfileCounters &profile_counters();
+// zeroes every thread's counts and restarts the clock. counts racing with a reset may land on either side of it
+void profile_reset();
+ProfileReport profile_report();
+// the calling thread's count of one counter, for measuring a stretch of code on one thread
+uint64_t profile_thread_count(PROFILE_COUNTER counter);
+
+// a table for people, and the same numbers as one JSON object or as CSV lines of kind,name,calls,value,ns
+void write_profile_report(std::ostream &out, const ProfileReport &report);
+void write_profile_json(std::ostream &out, const ProfileReport &report);
+void write_profile_csv(std::ostream &out, const ProfileReport &report);
+
+// the cycle counter where there is one, steady clock nanoseconds elsewhere
+inline uint64_t profile_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+inline void profile_add(std::atomic<uint64_t> &counter, uint64_t n) {
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// times its own lifetime, nested scopes each count their inclusive time
+class ProfileScope {
+public:
+    explicit ProfileScope(PROFILE_TIMER timer) : timer(timer), start(profile_ticks()) {}
+    ~ProfileScope() {
+        ProfileCounters &counters = profile_counters();
+        profile_add(counters.timer_calls[timer], 1);
+        profile_add(counters.timer_ticks[timer], profile_ticks() - start);
+    }
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+    PROFILE_TIMER timer;
+    uint64_t start;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#ifdef CPP_CHESS_PROFILE
+#define PROFILE_COUNT(counter, n) profile_add(profile_counters().counters[counter], (uint64_t) (n))
+#define PROFILE_SCOPE(timer) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(timer)
+#else
+#define PROFILE_COUNT(counter, n) ((void) 0)
+#define PROFILE_SCOPE(timer) ((void) 0)
+#endif
+
+#endif //CPP_CHESS_PROFILE_H
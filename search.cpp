@@ -0,0 +1,587 @@
+#include "search.h"
+#include "eval.h"
+#include "nnue.h"
+#include "profile.h"
+#include "tablebase.h"
+#include "thread_pool.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+// the two spare flag bits of a table entry say how the stored score relates to the true one
+typedef enum {BOUND_NONE = 0, BOUND_UPPER = 1, BOUND_LOWER = 2, BOUND_EXACT = 3} BOUND;
+
+// move ordering: hash move, then captures and promotions by MVV-LVA, then killers, then quiet moves by history
+const int HASH_MOVE_SCORE = 1 << 30;
+const int CAPTURE_SCORE = 1 << 28;
+const int KILLER_SCORE = 1 << 27;
+// history scores stay within +-HISTORY_LIMIT, well below KILLER_SCORE
+const int HISTORY_LIMIT = 16384;
+
+const int ASPIRATION_WINDOW = 25;
+// milliseconds kept back from every time limit for the GUI round trip
+const int64_t MOVE_OVERHEAD = 5;
+
+// table payload: bits 0-15 the best move, bits 16-31 the score
+static uint64_t pack_entry(PackedMove move, int score) {
+    return (uint64_t) move.data | ((uint64_t) (uint16_t) (int16_t) score << 16);
+}
+
+static PackedMove entry_move(uint64_t payload) {
+    PackedMove move;
+    move.data = (uint16_t) payload;
+    return move;
+}
+
+static int entry_score(uint64_t payload) {
+    return (int16_t) (uint16_t) (payload >> 16);
+}
+
+// mate scores are stored relative to the node, not the root, so they stay right wherever the position turns up
+static int score_to_table(int score, int ply) {
+    return score > MATE_BOUND ? score + ply : score < -MATE_BOUND ? score - ply : score;
+}
+
+static int score_from_table(int score, int ply) {
+    return score > MATE_BOUND ? score - ply : score < -MATE_BOUND ? score + ply : score;
+}
+
+// tablebase mates too long for the mate range still score as sure wins
+static int tablebase_score(const TbProbe &probe, int ply) {
+    int score = ply + probe.dtm < MAX_PLY ? MATE_SCORE - ply - probe.dtm : MATE_BOUND - 1;
+
+    return probe.wdl == WDL_WIN ? score : probe.wdl == WDL_LOSS ? -score : 0;
+}
+
+// per thread search state, only the transposition table is shared between threads
+struct SearchWorker {
+    Search &search;
+    int index;
+    Board board;
+    // written by this worker only, read by the main worker for the node count it reports
+    std::atomic<uint64_t> nodes {0};
+    std::atomic<uint64_t> tb_hits {0};
+    int seldepth = 0;
+    // result of the last iteration this worker completed
+    int completed_depth = 0;
+    int completed_score = 0;
+    PackedMove completed_move = NULL_MOVE;
+    PackedMove killers[MAX_PLY][2];
+    int history[2][64][64];
+    // triangular principal variation table, pv[ply] holds the line from ply onwards
+    PackedMove pv[MAX_PLY][MAX_PLY];
+    int pv_length[MAX_PLY];
+    // kept in step with board when the search has a network, evaluate() is used otherwise
+    std::unique_ptr<NnueEvaluator> nnue;
+
+    SearchWorker(Search &search, int index) : search(search), index(index) {
+        if (search.network) {
+            nnue.reset(new NnueEvaluator(*search.network));
+        }
+        clear();
+    }
+
+    void clear() {
+        memset(killers, 0, sizeof(killers));
+        memset(history, 0, sizeof(history));
+        memset(pv_length, 0, sizeof(pv_length));
+    }
+
+    void iterate(int max_depth, const SearchLimits &limits, const Search::InfoCallback &info);
+    int negamax(int alpha, int beta, int depth, int ply, bool null_allowed);
+    int quiesce(int alpha, int beta, int ply);
+    void score_moves(const MoveList &list, int *scores, PackedMove hash_move, int ply) const;
+    void update_pv(PackedMove move, int ply);
+    void update_history(PackedMove move, int bonus);
+
+    void make_move(PackedMove move) {
+        board.push(move);
+        if (nnue) {
+            nnue->push(board);
+        }
+    }
+
+    void unmake_move() {
+        board.pop();
+        if (nnue) {
+            nnue->pop();
+        }
+    }
+
+    void make_null() {
+        board.push_null();
+        if (nnue) {
+            nnue->push(board);
+        }
+    }
+
+    void unmake_null() {
+        board.pop_null();
+        if (nnue) {
+            nnue->pop();
+        }
+    }
+
+    // network scores are kept clear of the mate range
+    int static_eval() const {
+        PROFILE_SCOPE(TIMER_EVALUATE);
+        if (nnue) {
+            return std::min(std::max(nnue->evaluate(board.get_position()), -MATE_BOUND + 1), MATE_BOUND - 1);
+        }
+        return evaluate(board.get_position());
+    }
+};
+
+// brings the best remaining move to position i, a selection sort done lazily since most nodes cut off early
+static PackedMove pick_move(MoveList &list, int *scores, int i) {
+    int best = i, j;
+
+    for (j = i + 1; j < list.size; j++) {
+        if (scores[j] > scores[best]) {
+            best = j;
+        }
+    }
+    std::swap(list.moves[i], list.moves[best]);
+    std::swap(scores[i], scores[best]);
+    return list.moves[i];
+}
+
+void SearchWorker::score_moves(const MoveList &list, int *scores, PackedMove hash_move, int ply) const {
+    const Position &position = board.get_position();
+    PackedMove move;
+    PIECE_TYPE victim;
+    int i;
+
+    for (i = 0; i < list.size; i++) {
+        move = list.moves[i];
+        if (move == hash_move) {
+            scores[i] = HASH_MOVE_SCORE;
+        } else if (move.is_capture() || move.is_promotion()) {
+            victim = move.flags() == EP_CAPTURE ? PAWN : position.piece_on(move.to());
+            scores[i] = CAPTURE_SCORE + (victim == EMPTY ? 0 : PIECE_VALUES[victim] * 8) +
+                        (move.is_promotion() ? PIECE_VALUES[move.promotion_piece()] * 8 : 0) -
+                        PIECE_VALUES[position.piece_on(move.from())] / 10;
+        } else if (move == killers[ply][0]) {
+            scores[i] = KILLER_SCORE;
+        } else if (move == killers[ply][1]) {
+            scores[i] = KILLER_SCORE - 1;
+        } else {
+            scores[i] = history[position.side_to_move][move.from()][move.to()];
+        }
+    }
+}
+
+void SearchWorker::update_pv(PackedMove move, int ply) {
+    int i;
+
+    pv[ply][ply] = move;
+    for (i = ply + 1; i < pv_length[ply + 1]; i++) {
+        pv[ply][i] = pv[ply + 1][i];
+    }
+    pv_length[ply] = std::max(pv_length[ply + 1], ply + 1);
+}
+
+// the entry moves towards +-HISTORY_LIMIT by a fraction of the distance, so it never overflows and old news fades
+void SearchWorker::update_history(PackedMove move, int bonus) {
+    int &entry = history[board.get_position().side_to_move][move.from()][move.to()];
+    entry += bonus - entry * abs(bonus) / HISTORY_LIMIT;
+}
+
+int SearchWorker::quiesce(int alpha, int beta, int ply) {
+    MoveList list;
+    int scores[MAX_MOVES];
+    int best, score, i;
+    bool in_check;
+    PackedMove move;
+
+    pv_length[ply] = ply;
+    if (search.should_stop(*this)) {
+        return 0;
+    }
+    seldepth = std::max(seldepth, ply);
+    if (ply >= MAX_PLY - 1) {
+        return static_eval();
+    }
+
+    // standing pat is only allowed when not in check, in check every evasion gets searched
+    in_check = board.in_check();
+    best = -INFINITE_SCORE;
+    if (!in_check) {
+        best = static_eval();
+        if (best >= beta) {
+            return best;
+        }
+        alpha = std::max(alpha, best);
+    }
+
+    board.legal_moves(list);
+    if (list.size == 0) {
+        // stalemate is a draw whatever the standing pat said
+        return in_check ? -MATE_SCORE + ply : 0;
+    }
+    if (!in_check) {
+        for (i = 0; i < list.size;) {
+            if (list.moves[i].is_capture() || list.moves[i].is_promotion()) {
+                i++;
+            } else {
+                list.moves[i] = list.moves[--list.size];
+            }
+        }
+    }
+    score_moves(list, scores, NULL_MOVE, ply);
+
+    for (i = 0; i < list.size; i++) {
+        move = pick_move(list, scores, i);
+        make_move(move);
+        score = -quiesce(-beta, -alpha, ply + 1);
+        unmake_move();
+        if (search.stopped.load(std::memory_order_relaxed)) {
+            return 0;
+        }
+        if (score > best) {
+            best = score;
+            if (score > alpha) {
+                alpha = score;
+                update_pv(move, ply);
+                if (alpha >= beta) {
+                    break;
+                }
+            }
+        }
+    }
+    return best;
+}
+
+int SearchWorker::negamax(int alpha, int beta, int depth, int ply, bool null_allowed) {
+    const Position &position = board.get_position();
+    COLOR us = static_cast<COLOR>(position.side_to_move);
+    MoveList list;
+    int scores[MAX_MOVES];
+    int best, score, i, reduction, original_alpha = alpha, flags, extension;
+    bool in_check, pv_node = beta - alpha > 1;
+    PackedMove move, best_move = NULL_MOVE, hash_move = NULL_MOVE;
+    uint64_t key = board.key();
+    TTHit hit;
+    TbProbe probe;
+
+    if (depth <= 0) {
+        return quiesce(alpha, beta, ply);
+    }
+    pv_length[ply] = ply;
+    if (search.should_stop(*this)) {
+        return 0;
+    }
+    seldepth = std::max(seldepth, ply);
+    // repeating a position (the game's or the search's own) is as good as a draw, so is the fifty move rule
+    if (ply > 0 && board.is_draw()) {
+        return 0;
+    }
+    if (ply >= MAX_PLY - 1) {
+        return static_eval();
+    }
+    // the tables know the answer, mates come back exact
+    if (ply > 0 && search.tablebases && popcount(position.occupied()) <= search.tablebases->max_pieces() &&
+        search.tablebases->probe(position, probe)) {
+        tb_hits.store(tb_hits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return tablebase_score(probe, ply);
+    }
+
+    if (search.table.probe(key, hit)) {
+        hash_move = entry_move(hit.payload);
+        score = score_from_table(entry_score(hit.payload), ply);
+        if (!pv_node && hit.depth >= depth &&
+            (hit.flags == BOUND_EXACT || (hit.flags == BOUND_LOWER && score >= beta) || (hit.flags == BOUND_UPPER && score <= alpha))) {
+            return score;
+        }
+    }
+
+    // null move: if passing still fails high, a real move will too. not with only pawns left, where zugzwang is common
+    in_check = board.in_check();
+    if (null_allowed && !pv_node && !in_check && depth >= 3 &&
+        (position.occupancy[us] & ~position.pieces[us][PAWN] & ~position.pieces[us][KING]) && static_eval() >= beta) {
+        reduction = 2 + depth / 6;
+        make_null();
+        score = -negamax(-beta, -beta + 1, depth - 1 - reduction, ply + 1, false);
+        unmake_null();
+        if (search.stopped.load(std::memory_order_relaxed)) {
+            return 0;
+        }
+        if (score >= beta) {
+            return score > MATE_BOUND ? beta : score;
+        }
+    }
+
+    board.legal_moves(list);
+    if (list.size == 0) {
+        return in_check ? -MATE_SCORE + ply : 0;
+    }
+    score_moves(list, scores, hash_move, ply);
+    extension = in_check ? 1 : 0;
+
+    best = -INFINITE_SCORE;
+    for (i = 0; i < list.size; i++) {
+        move = pick_move(list, scores, i);
+        make_move(move);
+        // principal variation search: the first move gets the full window, the rest only have to prove they're worse
+        if (i == 0) {
+            score = -negamax(-beta, -alpha, depth - 1 + extension, ply + 1, true);
+        } else {
+            score = -negamax(-alpha - 1, -alpha, depth - 1 + extension, ply + 1, true);
+            if (score > alpha && score < beta) {
+                score = -negamax(-beta, -alpha, depth - 1 + extension, ply + 1, true);
+            }
+        }
+        unmake_move();
+        if (search.stopped.load(std::memory_order_relaxed)) {
+            return 0;
+        }
+
+        if (score > best) {
+            best = score;
+            best_move = move;
+            if (score > alpha) {
+                alpha = score;
+                update_pv(move, ply);
+            }
+        }
+        if (alpha >= beta) {
+            if (!move.is_capture() && !move.is_promotion()) {
+                if (killers[ply][0] != move) {
+                    killers[ply][1] = killers[ply][0];
+                    killers[ply][0] = move;
+                }
+                update_history(move, depth * depth);
+                // the quiet moves tried before this one didn't cut, make them a little less attractive
+                while (--i >= 0) {
+                    if (!list.moves[i].is_capture() && !list.moves[i].is_promotion()) {
+                        update_history(list.moves[i], -depth * depth);
+                    }
+                }
+            }
+            break;
+        }
+    }
+
+    flags = best >= beta ? BOUND_LOWER : best > original_alpha ? BOUND_EXACT : BOUND_UPPER;
+    search.table.store(key, depth, flags, pack_entry(best_move, score_to_table(best, ply)));
+    return best;
+}
+
+// iterative deepening. helpers with an odd index run one ply ahead of the rest, so the threads don't all
+// search the same tree in the same order and the table fills with results the others can use
+void SearchWorker::iterate(int max_depth, const SearchLimits &limits, const Search::InfoCallback &info) {
+    PROFILE_SCOPE(TIMER_SEARCH);
+    SearchInfo report;
+    int depth, result = 0, alpha, beta, window;
+    double seconds;
+
+    for (depth = 1 + (index & 1); depth <= max_depth; depth++) {
+        // aspiration: expect the score of the last iteration and widen the window whenever that's wrong
+        window = ASPIRATION_WINDOW;
+        alpha = depth >= 5 ? std::max(completed_score - window, -INFINITE_SCORE) : -INFINITE_SCORE;
+        beta = depth >= 5 ? std::min(completed_score + window, INFINITE_SCORE) : INFINITE_SCORE;
+        while (true) {
+            seldepth = 0;
+            result = negamax(alpha, beta, depth, 0, false);
+            if (search.stopped.load(std::memory_order_relaxed)) {
+                break;
+            }
+            window *= 2;
+            if (result <= alpha) {
+                alpha = std::max(result - window, -INFINITE_SCORE);
+            } else if (result >= beta) {
+                beta = std::min(result + window, INFINITE_SCORE);
+            } else {
+                break;
+            }
+        }
+        // an unfinished iteration is thrown away
+        if (search.stopped.load(std::memory_order_relaxed)) {
+            break;
+        }
+
+        completed_depth = depth;
+        completed_score = result;
+        completed_move = pv[0][0];
+        // the helpers only feed the table, timing and reporting are the main worker's business
+        if (index != 0) {
+            continue;
+        }
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - search.start).count();
+        if (info) {
+            report = {depth, seldepth, result, search.total_nodes(), search.total_tb_hits(), seconds, search.table.hashfull(),
+                      pv_length[0], pv[0]};
+            info(report);
+        }
+        if (!limits.infinite && ((search.soft_limit > 0 && seconds >= search.soft_limit) || MATE_SCORE - abs(result) <= depth)) {
+            break;
+        }
+    }
+}
+
+Search::Search(TranspositionTable &table) : table(table) {
+    set_threads(1);
+}
+
+Search::~Search() = default;
+
+void Search::set_threads(int count) {
+    int i;
+
+    count = std::max(count, 1);
+    pool.reset(count > 1 ? new ThreadPool(count - 1) : nullptr);
+    workers.clear();
+    for (i = 0; i < count; i++) {
+        workers.emplace_back(new SearchWorker(*this, i));
+    }
+}
+
+void Search::set_network(const Network *new_network) {
+    network = new_network && new_network->is_loaded() ? new_network : nullptr;
+    set_threads(threads());
+}
+
+void Search::set_tablebases(const Tablebases *new_tablebases) {
+    tablebases = new_tablebases;
+}
+
+int Search::threads() const {
+    return (int) workers.size();
+}
+
+void Search::stop() {
+    stopped.store(true, std::memory_order_relaxed);
+}
+
+void Search::clear() {
+    for (std::unique_ptr<SearchWorker> &worker : workers) {
+        worker->clear();
+    }
+}
+
+uint64_t Search::total_nodes() const {
+    uint64_t nodes = 0;
+
+    for (const std::unique_ptr<SearchWorker> &worker : workers) {
+        nodes += worker->nodes.load(std::memory_order_relaxed);
+    }
+    return nodes;
+}
+
+uint64_t Search::total_tb_hits() const {
+    uint64_t hits = 0;
+
+    for (const std::unique_ptr<SearchWorker> &worker : workers) {
+        hits += worker->tb_hits.load(std::memory_order_relaxed);
+    }
+    return hits;
+}
+
+bool Search::should_stop(SearchWorker &worker) {
+    uint64_t nodes = worker.nodes.load(std::memory_order_relaxed) + 1;
+
+    worker.nodes.store(nodes, std::memory_order_relaxed);
+    PROFILE_COUNT(PROFILE_NODES, 1);
+    if (stopped.load(std::memory_order_relaxed)) {
+        return true;
+    }
+    // each thread gets an even share of the node budget, only the main thread watches the clock
+    if ((node_limit && nodes >= node_limit) ||
+        (worker.index == 0 && hard_limit > 0 && (nodes & 1023) == 0 &&
+         std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() >= hard_limit)) {
+        stopped.store(true, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+void Search::plan_time(const Board &board, const SearchLimits &limits) {
+    COLOR us = static_cast<COLOR>(board.get_position().side_to_move);
+    int64_t left = limits.time[us], increment = limits.increment[us], moves_left, soft, hard;
+
+    soft_limit = hard_limit = 0;
+    node_limit = limits.nodes ? std::max<uint64_t>(limits.nodes / workers.size(), 1) : 0;
+    if (limits.infinite) {
+        return;
+    }
+    if (limits.movetime > 0) {
+        soft_limit = hard_limit = std::max<int64_t>(limits.movetime - MOVE_OVERHEAD, 1) / 1000.0;
+    } else if (left > 0) {
+        // an even share of what's left, plus most of the increment. an iteration may run on to four times that
+        moves_left = limits.movestogo > 0 ? std::min(limits.movestogo, 40) : 30;
+        soft = left / moves_left + increment * 3 / 4;
+        hard = std::min(soft * 4, left / 2 + increment);
+        hard = std::max<int64_t>(std::min(hard, left - MOVE_OVERHEAD), 1);
+        soft_limit = std::min(soft, hard) / 1000.0;
+        hard_limit = hard / 1000.0;
+    }
+}
+
+SearchResult Search::run(const Board &board, const SearchLimits &limits, InfoCallback info) {
+    SearchResult result = {NULL_MOVE, 0, 0, 0, 0, 0};
+    SearchWorker *best;
+    MoveList list;
+    int max_depth;
+    size_t i;
+
+    start = std::chrono::steady_clock::now();
+    stopped.store(false, std::memory_order_relaxed);
+    plan_time(board, limits);
+    table.new_generation();
+
+    board.legal_moves(list);
+    if (list.size == 0) {
+        result.score = board.in_check() ? -MATE_SCORE : 0;
+        return result;
+    }
+    for (std::unique_ptr<SearchWorker> &worker : workers) {
+        board.fork(worker->board);
+        if (worker->nnue) {
+            worker->nnue->reset(board.get_position());
+        }
+        worker->nodes.store(0, std::memory_order_relaxed);
+        worker->tb_hits.store(0, std::memory_order_relaxed);
+        worker->completed_depth = 0;
+        worker->completed_score = 0;
+        // there is always a move to play, even if the first iteration gets cut off
+        worker->completed_move = list.moves[0];
+    }
+
+    // lazy SMP: the helpers search the same root on their own, sharing nothing but the table
+    max_depth = limits.depth > 0 ? std::min(limits.depth, MAX_PLY - 1) : MAX_PLY - 1;
+    for (i = 1; i < workers.size(); i++) {
+        pool->submit([this, i, max_depth, &limits](int) { workers[i]->iterate(max_depth, limits, nullptr); });
+    }
+    workers[0]->iterate(max_depth, limits, info);
+    stopped.store(true, std::memory_order_relaxed);
+    if (pool) {
+        pool->wait();
+    }
+
+    // the deepest completed iteration wins, ties go to the better score
+    best = workers[0].get();
+    for (i = 1; i < workers.size(); i++) {
+        if (workers[i]->completed_depth > best->completed_depth ||
+            (workers[i]->completed_depth == best->completed_depth && workers[i]->completed_score > best->completed_score)) {
+            best = workers[i].get();
+        }
+    }
+    result.best_move = best->completed_move;
+    result.score = best->completed_score;
+    result.depth = best->completed_depth;
+    result.nodes = total_nodes();
+    result.tb_hits = total_tb_hits();
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+std::string format_score(int score) {
+    if (score > MATE_BOUND) {
+        return "mate " + std::to_string((MATE_SCORE - score + 1) / 2);
+    }
+    if (score < -MATE_BOUND) {
+        return "mate -" + std::to_string((MATE_SCORE + score) / 2);
+    }
+    return "cp " + std::to_string(score);
+}
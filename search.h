@@ -0,0 +1,113 @@
+#pragma once
+
+#include "chess.h"
+#include "tt.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#ifndef CPP_CHESS_SEARCH_H
+#define CPP_CHESS_SEARCH_H
+
+// deepest ply the search ever reaches, quiescence included
+const int MAX_PLY = 128;
+// a mate in n plies scores MATE_SCORE - n, anything beyond MATE_BOUND is a mate score
+const int MATE_SCORE = 32000;
+const int MATE_BOUND = MATE_SCORE - MAX_PLY;
+const int INFINITE_SCORE = 32001;
+
+// what to stop at, 0 means no limit. times are in milliseconds and indexed by COLOR
+struct SearchLimits {
+    int depth = 0;
+    uint64_t nodes = 0;
+    int64_t movetime = 0;
+    int64_t time[2] = {0, 0};
+    int64_t increment[2] = {0, 0};
+    int movestogo = 0;
+    // search until stop() no matter what else is set
+    bool infinite = false;
+};
+
+// reported after every completed iteration
+struct SearchInfo {
+    int depth;
+    int seldepth;
+    int score;
+    uint64_t nodes;
+    uint64_t tb_hits;
+    double seconds;
+    int hashfull;
+    int pv_length;
+    const PackedMove *pv;
+};
+
+struct SearchResult {
+    PackedMove best_move;
+    int score;
+    int depth;
+    uint64_t nodes;
+    uint64_t tb_hits;
+    double seconds;
+};
+
+struct SearchWorker;
+class ThreadPool;
+class Network;
+class Tablebases;
+
+// iterative deepening alpha-beta on top of Board. run() blocks, stop() may be called from any thread.
+// with more than one thread the search is lazy SMP: helpers search the same root and share the table
+class Search {
+public:
+    typedef std::function<void(const SearchInfo &)> InfoCallback;
+
+    explicit Search(TranspositionTable &table);
+    ~Search();
+    Search(const Search &) = delete;
+    Search &operator=(const Search &) = delete;
+
+    SearchResult run(const Board &board, const SearchLimits &limits, InfoCallback info = nullptr);
+    void stop();
+    // not while a search is running. clears the move ordering statistics
+    void set_threads(int count);
+    int threads() const;
+    // evaluate with the network instead of the hand written evaluation, nullptr goes back to the latter.
+    // the network has to outlive the search. not while a search is running, clears like set_threads
+    void set_network(const Network *new_network);
+    // probe the tables at every node with few enough pieces, nullptr to stop. they have to outlive the search,
+    // not while a search is running
+    void set_tablebases(const Tablebases *new_tablebases);
+    // forgets the move ordering statistics, for a new game
+    void clear();
+
+private:
+    friend struct SearchWorker;
+
+    // counts the node. the clock is only read every thousand nodes, stop requests are seen on the next node
+    bool should_stop(SearchWorker &worker);
+    void plan_time(const Board &board, const SearchLimits &limits);
+    uint64_t total_nodes() const;
+    uint64_t total_tb_hits() const;
+
+    TranspositionTable &table;
+    const Network *network = nullptr;
+    const Tablebases *tablebases = nullptr;
+    std::vector<std::unique_ptr<SearchWorker>> workers;
+    // helpers 1..n-1 run here, the main worker runs on the thread that called run()
+    std::unique_ptr<ThreadPool> pool;
+    std::atomic<bool> stopped {false};
+    std::chrono::steady_clock::time_point start;
+    // no new iteration starts after soft_limit, the search is cut off at hard_limit
+    double soft_limit = 0;
+    double hard_limit = 0;
+    uint64_t node_limit = 0;
+};
+
+// "cp 35" or "mate -3" (in moves, as UCI wants them)
+std::string format_score(int score);
+
+#endif //CPP_CHESS_SEARCH_H
@@ -0,0 +1,779 @@
+#include "tablebase.h"
+#include "mapped_file.h"
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+
+static const char TABLEBASE_MAGIC[4] = {'C', 'C', 'T', 'B'};
+static const size_t TABLEBASE_HEADER_SIZE = 48;
+static const size_t SIGNATURE_SIZE = 16;
+// the block cache is split into this many shards, each with its own lock, so probes of different blocks rarely wait
+static const size_t CACHE_SHARDS = 16;
+// index entries for positions that can't occur, only while generating
+static const uint8_t TB_INVALID = 255;
+// the longest mate a table can hold, in plies
+static const int TB_MAX_DTM = 253;
+// generator counters of positions that are settled
+static const uint8_t TB_DONE = 255;
+static const std::array<int, 6> PIECE_VALUES = {0, 9, 5, 3, 3, 1};
+
+// pieces of a signature in index order: the white king, the black king, then white's other pieces and black's,
+// queens to pawns. like pieces follow one another and are indexed in square order
+struct TbMaterial {
+    std::array<std::array<int, 6>, 2> counts;
+    int count;
+    std::array<COLOR, TB_MAX_PIECES> colors;
+    std::array<PIECE_TYPE, TB_MAX_PIECES> types;
+    // true if the piece before is of the same colour and type
+    std::array<bool, TB_MAX_PIECES> repeats;
+    bool pawns;
+    // the white king is kept to the a1-d4 quarter by symmetry, to the a-d files once there are pawns
+    int king_squares;
+    uint64_t entries;
+};
+
+static TbMaterial make_material(const std::array<std::array<int, 6>, 2> &counts) {
+    TbMaterial material;
+    int color, type, i;
+
+    material.counts = counts;
+    material.count = 0;
+    material.pawns = counts[WHITE][PAWN] || counts[BLACK][PAWN];
+    material.colors[material.count] = WHITE;
+    material.types[material.count++] = KING;
+    material.colors[material.count] = BLACK;
+    material.types[material.count++] = KING;
+    for (color = WHITE; color <= BLACK; color++) {
+        for (type = QUEEN; type <= PAWN; type++) {
+            for (i = 0; i < counts[color][type] && material.count < TB_MAX_PIECES; i++) {
+                material.colors[material.count] = static_cast<COLOR>(color);
+                material.types[material.count++] = static_cast<PIECE_TYPE>(type);
+            }
+        }
+    }
+    material.repeats[0] = false;
+    for (i = 1; i < material.count; i++) {
+        material.repeats[i] = material.colors[i] == material.colors[i-1] && material.types[i] == material.types[i-1];
+    }
+    material.king_squares = material.pawns ? 32 : 16;
+    material.entries = 2 * (uint64_t) material.king_squares;
+    for (i = 1; i < material.count; i++) {
+        material.entries *= 64;
+    }
+    return material;
+}
+
+// 3 bits per (colour, piece type) count, kings left out
+static uint32_t material_key(const std::array<std::array<int, 6>, 2> &counts, bool swap) {
+    uint32_t key = 0;
+    int color, type;
+
+    for (color = WHITE; color <= BLACK; color++) {
+        for (type = QUEEN; type <= PAWN; type++) {
+            key |= (uint32_t) counts[color ^ swap][type] << (3 * (color * 5 + type - 1));
+        }
+    }
+    return key;
+}
+
+static uint32_t material_key(const Position &position) {
+    std::array<std::array<int, 6>, 2> counts;
+    int color, type;
+
+    for (color = WHITE; color <= BLACK; color++) {
+        for (type = KING; type <= PAWN; type++) {
+            counts[color][type] = std::min(popcount(position.pieces[color][type]), 7);
+        }
+    }
+    return material_key(counts, false);
+}
+
+static std::string signature_name(const std::array<std::array<int, 6>, 2> &counts) {
+    std::string name;
+    int color, type, i;
+
+    for (color = WHITE; color <= BLACK; color++) {
+        name += color == WHITE ? "K" : "vK";
+        for (type = QUEEN; type <= PAWN; type++) {
+            for (i = 0; i < counts[color][type]; i++) {
+                name.push_back(NAME_TABLE[7 + type]);
+            }
+        }
+    }
+    return name;
+}
+
+// tables are built with the stronger side as white: more pieces, then more material, then the better pieces
+static bool stronger_is_black(const std::array<std::array<int, 6>, 2> &counts) {
+    int pieces[2] = {0, 0}, value[2] = {0, 0}, color, type;
+
+    for (color = WHITE; color <= BLACK; color++) {
+        for (type = QUEEN; type <= PAWN; type++) {
+            pieces[color] += counts[color][type];
+            value[color] += counts[color][type] * PIECE_VALUES[type];
+        }
+    }
+    if (pieces[WHITE] != pieces[BLACK]) {
+        return pieces[BLACK] > pieces[WHITE];
+    }
+    if (value[WHITE] != value[BLACK]) {
+        return value[BLACK] > value[WHITE];
+    }
+    return counts[BLACK] > counts[WHITE];
+}
+
+static bool parse_signature(const std::string &signature, std::array<std::array<int, 6>, 2> &counts) {
+    size_t i;
+    int color = -1, total = 0;
+    PIECE_TYPE type;
+
+    for (std::array<int, 6> &side : counts) {
+        side.fill(0);
+    }
+    for (i = 0; i < signature.size(); i++) {
+        if (signature[i] == 'v') {
+            if (color != WHITE || signature[i+1] != 'K') {
+                return false;
+            }
+            continue;
+        }
+        type = piece_from_char((char) (signature[i] - 'A' + 'a'));
+        // every side starts with its king, and there are exactly two kings
+        if (type == KING && (i == 0 || signature[i-1] == 'v')) {
+            color++;
+        } else if (type == EMPTY || type == KING || color < 0) {
+            return false;
+        }
+        counts[color][type]++;
+        total++;
+    }
+    return color == BLACK && total <= TB_MAX_PIECES && !(counts[WHITE][PAWN] && counts[BLACK][PAWN]);
+}
+
+// the entry of a position in a table of this material, colours swapped (and the board turned over) if the table has
+// them the other way round
+static uint64_t encode(const TbMaterial &material, const Position &position, bool swap) {
+    int squares[TB_MAX_PIECES], i, j, flip = 0, turn = swap ? 56 : 0;
+    Bitboard b;
+    uint64_t entry;
+
+    for (i = 0; i < material.count; i = j) {
+        b = position.pieces[material.colors[i] ^ swap][material.types[i]];
+        for (j = i; j < material.count && (j == i || material.repeats[j]); j++) {
+            squares[j] = pop_lsb(b) ^ turn;
+        }
+    }
+    if (square_col(squares[0]) >= 4) {
+        flip ^= 7;
+    }
+    if (!material.pawns && square_row(squares[0]) >= 4) {
+        flip ^= 56;
+    }
+    // the symmetry may have put like pieces out of order
+    for (i = 0; i < material.count; i++) {
+        squares[i] ^= flip;
+        for (j = i; j > 0 && material.repeats[j] && squares[j-1] > squares[j]; j--) {
+            std::swap(squares[j-1], squares[j]);
+        }
+    }
+    entry = (uint64_t) (position.side_to_move ^ swap) * material.king_squares + square_row(squares[0]) * 4 + square_col(squares[0]);
+    for (i = 1; i < material.count; i++) {
+        entry = entry * 64 + squares[i];
+    }
+    return entry;
+}
+
+// false for entries that are no position: pieces on top of each other or out of order, pawns on the back ranks,
+// the side that isn't to move in check
+static bool decode(const TbMaterial &material, uint64_t entry, Position &position) {
+    int squares[TB_MAX_PIECES], i, king;
+    COLOR us, them;
+
+    for (i = material.count - 1; i >= 1; i--) {
+        squares[i] = (int) (entry % 64);
+        entry /= 64;
+    }
+    king = (int) (entry % material.king_squares);
+    squares[0] = make_square(king / 4, king % 4);
+    position.clear();
+    for (i = 0; i < material.count; i++) {
+        if ((position.occupied() & square_bb(squares[i])) || (material.repeats[i] && squares[i-1] > squares[i]) ||
+            (material.types[i] == PAWN && (square_bb(squares[i]) & (ROW_1 | ROW_8)))) {
+            return false;
+        }
+        position.put_piece(material.colors[i], material.types[i], squares[i]);
+    }
+    position.side_to_move = (uint8_t) (entry / material.king_squares);
+    us = static_cast<COLOR>(position.side_to_move);
+    them = us == WHITE ? BLACK : WHITE;
+    if (position.attackers_to(position.king_square(them), position.occupied()) & position.occupancy[us]) {
+        return false;
+    }
+    position.key = position.compute_key();
+    return true;
+}
+
+// Begin generator implementations
+struct GeneratedTable {
+    TbMaterial material;
+    std::vector<uint8_t> values;
+};
+
+// builds tables in memory, the ones a table converts into first
+class TablebaseGenerator {
+public:
+    bool generate(const std::array<std::array<int, 6>, 2> &counts);
+    bool write(const std::string &directory, TbGenerateStats &stats) const;
+
+private:
+    bool build(GeneratedTable &table);
+    uint8_t lookup(const Position &position) const;
+
+    std::map<std::string, GeneratedTable> tables;
+    std::unordered_map<uint32_t, std::pair<const GeneratedTable *, bool>> by_material;
+};
+
+bool TablebaseGenerator::generate(const std::array<std::array<int, 6>, 2> &wanted) {
+    std::array<std::array<int, 6>, 2> counts = wanted, sub;
+    std::string name;
+    int color, type, promotion;
+    GeneratedTable *table;
+
+    if (stronger_is_black(counts)) {
+        std::swap(counts[WHITE], counts[BLACK]);
+    }
+    name = signature_name(counts);
+    if (tables.count(name)) {
+        return true;
+    }
+    // captures take a piece off, promotions turn a pawn into something else. captures that promote are
+    // a promotion followed by a capture, so they are covered by the promoted table
+    for (color = WHITE; color <= BLACK; color++) {
+        for (type = QUEEN; type <= PAWN; type++) {
+            if (!counts[color][type]) {
+                continue;
+            }
+            sub = counts;
+            sub[color][type]--;
+            if (!generate(sub)) {
+                return false;
+            }
+            for (promotion = QUEEN; type == PAWN && promotion <= KNIGHT; promotion++) {
+                sub = counts;
+                sub[color][PAWN]--;
+                sub[color][promotion]++;
+                if (!generate(sub)) {
+                    return false;
+                }
+            }
+        }
+    }
+
+    table = &tables[name];
+    table->material = make_material(counts);
+    if (!build(*table)) {
+        return false;
+    }
+    by_material.emplace(material_key(counts, false), std::make_pair(table, false));
+    by_material.emplace(material_key(counts, true), std::make_pair(table, true));
+    return true;
+}
+
+uint8_t TablebaseGenerator::lookup(const Position &position) const {
+    const std::pair<const GeneratedTable *, bool> &found = by_material.at(material_key(position));
+
+    return found.first->values[encode(found.first->material, position, found.second)];
+}
+
+// retrograde analysis. a first pass over every entry finds the mates and stalemates, settles the captures and
+// promotions from the smaller tables and counts the moves that stay in the table. the positions are then settled
+// in order of their distance to mate: a position one move before a loss is a win, a position whose moves all lead
+// to wins for the other side is a loss once the last of them is settled. whatever is left is a draw
+bool TablebaseGenerator::build(GeneratedTable &table) {
+    const TbMaterial &material = table.material;
+    std::vector<uint8_t> &values = table.values;
+    std::vector<uint8_t> counts(material.entries, 0), longest(material.entries, 0);
+    std::vector<std::vector<uint32_t>> levels(TB_MAX_DTM + 2);
+    PackedMove moves[MAX_MOVES];
+    Position position, parent;
+    Bitboard pieces, origins, occupied;
+    uint64_t entry, before;
+    uint8_t value;
+    int i, n, dtm, win, to, from, type;
+    COLOR us, them;
+    size_t k;
+
+    values.assign(material.entries, 0);
+    for (entry = 0; entry < material.entries; entry++) {
+        if (!decode(material, entry, position)) {
+            values[entry] = TB_INVALID;
+            counts[entry] = TB_DONE;
+            continue;
+        }
+        n = generate_legal_moves(position, moves);
+        if (n == 0) {
+            if (position.in_check()) {
+                values[entry] = 1;
+                levels[0].push_back((uint32_t) entry);
+            } else {
+                counts[entry] = TB_DONE;
+            }
+            continue;
+        }
+        win = TB_MAX_DTM + 1;
+        for (i = 0; i < n; i++) {
+            if (!moves[i].is_capture() && !moves[i].is_promotion()) {
+                counts[entry]++;
+                continue;
+            }
+            value = lookup(position.after(moves[i]));
+            dtm = value - 1;
+            if (value == 0) {
+                // a drawn way out keeps the position from ever being lost
+                counts[entry]++;
+            } else if (dtm % 2 == 0) {
+                win = std::min(win, dtm + 1);
+            } else {
+                longest[entry] = (uint8_t) std::max<int>(longest[entry], dtm);
+            }
+        }
+        if (win <= TB_MAX_DTM) {
+            values[entry] = (uint8_t) (win + 1);
+            levels[win].push_back((uint32_t) entry);
+        } else if (counts[entry] == 0) {
+            values[entry] = (uint8_t) (longest[entry] + 2);
+            levels[longest[entry] + 1].push_back((uint32_t) entry);
+        }
+    }
+
+    for (dtm = 0; dtm <= TB_MAX_DTM; dtm++) {
+        for (k = 0; k < levels[dtm].size(); k++) {
+            entry = levels[dtm][k];
+            // a win can be found again at a shorter distance, the old one is skipped
+            if (counts[entry] == TB_DONE || values[entry] != dtm + 1) {
+                continue;
+            }
+            counts[entry] = TB_DONE;
+            decode(material, entry, position);
+            them = static_cast<COLOR>(position.side_to_move);
+            us = them == WHITE ? BLACK : WHITE;
+            occupied = position.occupied();
+
+            // every non-capturing move of the side that just moved, taken back
+            for (type = KING; type <= PAWN; type++) {
+                for (pieces = position.pieces[us][type]; pieces; ) {
+                    to = pop_lsb(pieces);
+                    if (type == PAWN) {
+                        from = us == WHITE ? to - 8 : to + 8;
+                        origins = square_row(to) != (us == WHITE ? 1 : 6) && !(occupied & square_bb(from)) ? square_bb(from) : 0;
+                        if (origins && square_row(to) == (us == WHITE ? 3 : 4) && !(occupied & square_bb(us == WHITE ? to - 16 : to + 16))) {
+                            origins |= square_bb(us == WHITE ? to - 16 : to + 16);
+                        }
+                    } else if (type == KING) {
+                        origins = king_attacks(to) & ~occupied;
+                    } else if (type == KNIGHT) {
+                        origins = knight_attacks(to) & ~occupied;
+                    } else {
+                        origins = (type == QUEEN ? queen_attacks(to, occupied) : type == ROOK ? rook_attacks(to, occupied) :
+                                   bishop_attacks(to, occupied)) & ~occupied;
+                    }
+                    while (origins) {
+                        from = pop_lsb(origins);
+                        parent = position;
+                        parent.move_piece(us, static_cast<PIECE_TYPE>(type), to, from);
+                        parent.side_to_move = us;
+                        if (parent.attackers_to(parent.king_square(them), parent.occupied()) & parent.occupancy[us]) {
+                            continue;
+                        }
+                        before = encode(material, parent, false);
+                        if (counts[before] == TB_DONE) {
+                            continue;
+                        }
+                        if (dtm % 2 == 0) {
+                            if (values[before] == 0 || values[before] > dtm + 2) {
+                                values[before] = (uint8_t) (dtm + 2);
+                                levels[dtm + 1].push_back((uint32_t) before);
+                            }
+                        } else if (values[before] == 0) {
+                            longest[before] = (uint8_t) std::max<int>(longest[before], dtm);
+                            if (--counts[before] == 0) {
+                                if (longest[before] + 1 > TB_MAX_DTM) {
+                                    return false;
+                                }
+                                values[before] = (uint8_t) (longest[before] + 2);
+                                levels[longest[before] + 1].push_back((uint32_t) before);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        std::vector<uint32_t>().swap(levels[dtm]);
+    }
+    // anything still waiting is further from mate than a table can say
+    return levels[TB_MAX_DTM + 1].empty();
+}
+
+// length of the run of equal values starting at values[i]
+static size_t run_length(const std::vector<uint8_t> &values, size_t i) {
+    size_t run = 1;
+
+    while (i + run < values.size() && values[i + run] == values[i]) {
+        run++;
+    }
+    return run;
+}
+
+// invalid entries take the value before them, they are never probed and that way they only lengthen runs
+static void compress_block(const uint8_t *values, size_t count, std::vector<uint8_t> &out) {
+    std::vector<uint8_t> filled(values, values + count);
+    size_t i, run, start, rest;
+
+    for (i = 0; i < count; i++) {
+        if (filled[i] == TB_INVALID) {
+            filled[i] = i ? filled[i-1] : 0;
+        }
+    }
+    for (i = 0; i < count; ) {
+        run = run_length(filled, i);
+        if (run >= 3) {
+            out.push_back((uint8_t) (0x80 | std::min<size_t>(run - 3, 0x7F)));
+            if (run - 3 >= 0x7F) {
+                for (rest = run - 3 - 0x7F; rest >= 0x80; rest >>= 7) {
+                    out.push_back((uint8_t) (rest | 0x80));
+                }
+                out.push_back((uint8_t) rest);
+            }
+            out.push_back(filled[i]);
+            i += run;
+            continue;
+        }
+        // literals up to the next run worth a token of its own
+        for (start = i; i < count && i - start < 0x80 && run_length(filled, i) < 3; i++) {
+        }
+        out.push_back((uint8_t) (i - start - 1));
+        out.insert(out.end(), filled.begin() + start, filled.begin() + i);
+    }
+}
+
+bool TablebaseGenerator::write(const std::string &directory, TbGenerateStats &stats) const {
+    char header[TABLEBASE_HEADER_SIZE];
+    std::vector<uint8_t> data;
+    std::vector<uint64_t> offsets;
+    std::ofstream out;
+    uint64_t block, blocks, begin;
+    uint32_t block_entries = TB_BLOCK_ENTRIES, block_count;
+
+    for (const std::pair<const std::string, GeneratedTable> &named : tables) {
+        const GeneratedTable &table = named.second;
+
+        blocks = (table.material.entries + TB_BLOCK_ENTRIES - 1) / TB_BLOCK_ENTRIES;
+        block_count = (uint32_t) blocks;
+        begin = TABLEBASE_HEADER_SIZE + (blocks + 1) * sizeof(uint64_t);
+        data.clear();
+        offsets.clear();
+        for (block = 0; block < blocks; block++) {
+            offsets.push_back(begin + data.size());
+            compress_block(table.values.data() + block * TB_BLOCK_ENTRIES,
+                           std::min<uint64_t>(TB_BLOCK_ENTRIES, table.material.entries - block * TB_BLOCK_ENTRIES), data);
+        }
+        offsets.push_back(begin + data.size());
+
+        memset(header, 0, sizeof(header));
+        memcpy(header, TABLEBASE_MAGIC, 4);
+        memcpy(header + 4, &TABLEBASE_VERSION, 4);
+        memcpy(header + 8, named.first.data(), std::min(named.first.size(), SIGNATURE_SIZE - 1));
+        memcpy(header + 24, &table.material.entries, 8);
+        memcpy(header + 32, &block_entries, 4);
+        memcpy(header + 36, &block_count, 4);
+        out.open(directory + "/" + named.first + ".cctb", std::ios::binary | std::ios::trunc);
+        out.write(header, sizeof(header));
+        out.write((const char *) offsets.data(), (std::streamsize) (offsets.size() * sizeof(uint64_t)));
+        out.write((const char *) data.data(), (std::streamsize) data.size());
+        out.close();
+        if (out.fail()) {
+            return false;
+        }
+        stats.tables++;
+        stats.positions += table.material.entries;
+        stats.bytes_written += offsets.back();
+    }
+    return true;
+}
+// End generator implementations
+
+bool generate_tablebases(const std::string &signature, const std::string &directory, TbGenerateStats *stats) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::array<std::array<int, 6>, 2> counts;
+    TablebaseGenerator generator;
+    TbGenerateStats written = {0, 0, 0, 0};
+    bool ok;
+
+    if (!parse_signature(signature, counts)) {
+        return false;
+    }
+    mkdir(directory.c_str(), 0755);
+    ok = generator.generate(counts) && generator.write(directory, written);
+    written.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (stats) {
+        *stats = written;
+    }
+    return ok;
+}
+
+// Begin Tablebases function implementations
+struct Tablebases::Table {
+    MappedFile file;
+    TbMaterial material;
+    const uint8_t *offsets;
+    uint32_t block_count;
+    // tells the table's blocks apart in the cache
+    uint32_t id;
+};
+
+// one shard of the cache. blocks live in slots kept in a doubly linked list, most recently used first, and are found
+// through a hash map
+struct Tablebases::BlockCache {
+    struct Slot {
+        uint64_t key;
+        int prev;
+        int next;
+        std::vector<uint8_t> values;
+    };
+
+    std::mutex lock;
+    std::vector<Slot> slots;
+    std::unordered_map<uint64_t, int> by_block;
+    int head = -1;
+    int tail = -1;
+    TbCacheStats stats = {0, 0, 0};
+
+    explicit BlockCache(size_t size) : slots(std::max<size_t>(size, 1)) {
+        clear();
+    }
+
+    void clear() {
+        int i, size = (int) slots.size();
+
+        by_block.clear();
+        for (i = 0; i < size; i++) {
+            slots[i].key = UINT64_MAX;
+            slots[i].prev = i - 1;
+            slots[i].next = i + 1 < size ? i + 1 : -1;
+        }
+        head = 0;
+        tail = size - 1;
+    }
+
+    void unlink(int i) {
+        (slots[i].prev >= 0 ? slots[slots[i].prev].next : head) = slots[i].next;
+        (slots[i].next >= 0 ? slots[slots[i].next].prev : tail) = slots[i].prev;
+    }
+
+    void push_front(int i) {
+        slots[i].prev = -1;
+        slots[i].next = head;
+        (head >= 0 ? slots[head].prev : tail) = i;
+        head = i;
+    }
+};
+
+// a block that doesn't decode to the right size reads as draws
+static void decompress_block(const uint8_t *data, size_t size, size_t count, std::vector<uint8_t> &values) {
+    size_t i = 0, filled = 0, run, extra;
+    int shift;
+
+    values.assign(count, 0);
+    while (i < size && filled < count) {
+        if (data[i] & 0x80) {
+            run = (data[i] & 0x7F) + 3;
+            if ((data[i++] & 0x7F) == 0x7F) {
+                extra = 0;
+                for (shift = 0; i < size && shift < 64; shift += 7) {
+                    extra |= (size_t) (data[i] & 0x7F) << shift;
+                    if (!(data[i++] & 0x80)) {
+                        break;
+                    }
+                }
+                run += extra;
+            }
+            if (i >= size || run > count - filled) {
+                break;
+            }
+            memset(values.data() + filled, data[i++], run);
+        } else {
+            run = data[i++] + 1;
+            if (run > size - i || run > count - filled) {
+                break;
+            }
+            memcpy(values.data() + filled, data + i, run);
+            i += run;
+        }
+        filled += run;
+    }
+    if (filled != count) {
+        values.assign(count, 0);
+    }
+}
+
+Tablebases::Tablebases(size_t cache_blocks) {
+    size_t i, shards = std::min(CACHE_SHARDS, std::max<size_t>(cache_blocks, 1));
+
+    // the shards share out cache_blocks between them
+    for (i = 0; i < shards; i++) {
+        cache.emplace_back(new BlockCache((cache_blocks + shards - 1 - i) / shards));
+    }
+}
+
+Tablebases::~Tablebases() = default;
+
+int Tablebases::open(const std::string &directory) {
+    DIR *dir = opendir(directory.c_str());
+    struct dirent *item;
+    std::string name, signature;
+    std::array<std::array<int, 6>, 2> counts;
+    std::unique_ptr<Table> table;
+    const char *data;
+    uint64_t entries, first, last;
+    uint32_t version, block_entries;
+    int added = 0;
+
+    if (!dir) {
+        return 0;
+    }
+    while ((item = readdir(dir)) != nullptr) {
+        name = item->d_name;
+        if (name.size() <= 5 || name.compare(name.size() - 5, 5, ".cctb") != 0) {
+            continue;
+        }
+        table.reset(new Table());
+        if (!table->file.open(directory + "/" + name) || table->file.size() < TABLEBASE_HEADER_SIZE) {
+            continue;
+        }
+        data = table->file.data();
+        signature.assign(data + 8, strnlen(data + 8, SIGNATURE_SIZE));
+        memcpy(&version, data + 4, 4);
+        memcpy(&entries, data + 24, 8);
+        memcpy(&block_entries, data + 32, 4);
+        memcpy(&table->block_count, data + 36, 4);
+        if (memcmp(data, TABLEBASE_MAGIC, 4) != 0 || version != TABLEBASE_VERSION || block_entries != TB_BLOCK_ENTRIES ||
+            !parse_signature(signature, counts) || stronger_is_black(counts) ||
+            by_material.count(material_key(counts, false))) {
+            continue;
+        }
+        table->material = make_material(counts);
+        if (entries != table->material.entries || table->block_count != (entries + TB_BLOCK_ENTRIES - 1) / TB_BLOCK_ENTRIES ||
+            table->file.size() < TABLEBASE_HEADER_SIZE + (table->block_count + 1) * sizeof(uint64_t)) {
+            continue;
+        }
+        table->offsets = (const uint8_t *) data + TABLEBASE_HEADER_SIZE;
+        memcpy(&first, table->offsets, 8);
+        memcpy(&last, table->offsets + table->block_count * sizeof(uint64_t), 8);
+        if (first != TABLEBASE_HEADER_SIZE + (table->block_count + 1) * sizeof(uint64_t) || last > table->file.size() ||
+            first > last) {
+            continue;
+        }
+        table->id = (uint32_t) tables.size();
+        by_material.emplace(material_key(counts, false), std::make_pair(table.get(), false));
+        by_material.emplace(material_key(counts, true), std::make_pair(table.get(), true));
+        largest = std::max(largest, table->material.count);
+        tables.push_back(std::move(table));
+        added++;
+    }
+    closedir(dir);
+    return added;
+}
+
+void Tablebases::close() {
+    for (std::unique_ptr<BlockCache> &shard : cache) {
+        std::lock_guard<std::mutex> guard(shard->lock);
+        shard->clear();
+    }
+    by_material.clear();
+    tables.clear();
+    largest = 0;
+}
+
+int Tablebases::max_pieces() const {
+    return largest;
+}
+
+uint8_t Tablebases::read(const Table &table, uint64_t entry) const {
+    // misses decompress into the thread's spare buffer without holding the lock, it then swaps with the evicted block
+    static thread_local std::vector<uint8_t> spare;
+    uint64_t block = entry / TB_BLOCK_ENTRIES, key = (uint64_t) table.id << 32 | block, begin, end;
+    BlockCache &shard = *cache[(block ^ table.id) % cache.size()];
+    std::unique_lock<std::mutex> guard(shard.lock);
+    std::unordered_map<uint64_t, int>::iterator found = shard.by_block.find(key);
+    int slot;
+
+    shard.stats.probes++;
+    if (found != shard.by_block.end()) {
+        shard.stats.hits++;
+        slot = found->second;
+    } else {
+        shard.stats.misses++;
+        guard.unlock();
+        memcpy(&begin, table.offsets + block * sizeof(uint64_t), 8);
+        memcpy(&end, table.offsets + (block + 1) * sizeof(uint64_t), 8);
+        if (end < begin || end > table.file.size()) {
+            end = begin;
+        }
+        decompress_block((const uint8_t *) table.file.data() + begin, end - begin,
+                         std::min<uint64_t>(TB_BLOCK_ENTRIES, table.material.entries - block * TB_BLOCK_ENTRIES), spare);
+        guard.lock();
+        // another thread may have brought the block in while this one decompressed it
+        found = shard.by_block.find(key);
+        if (found != shard.by_block.end()) {
+            slot = found->second;
+        } else {
+            // the least recently used block makes room
+            slot = shard.tail;
+            shard.by_block.erase(shard.slots[slot].key);
+            shard.slots[slot].values.swap(spare);
+            shard.slots[slot].key = key;
+            shard.by_block[key] = slot;
+        }
+    }
+    if (slot != shard.head) {
+        shard.unlink(slot);
+        shard.push_front(slot);
+    }
+    return shard.slots[slot].values[entry % TB_BLOCK_ENTRIES];
+}
+
+bool Tablebases::probe(const Position &position, TbProbe &result) const {
+    std::unordered_map<uint32_t, std::pair<const Table *, bool>>::const_iterator found;
+    uint8_t value;
+
+    if (position.castling != NO_CASTLING || popcount(position.occupied()) > largest) {
+        return false;
+    }
+    found = by_material.find(material_key(position));
+    if (found == by_material.end()) {
+        return false;
+    }
+    value = read(*found->second.first, encode(found->second.first->material, position, found->second.second));
+    result.dtm = value ? value - 1 : 0;
+    result.wdl = value == 0 ? WDL_DRAW : result.dtm % 2 ? WDL_WIN : WDL_LOSS;
+    return true;
+}
+
+TbCacheStats Tablebases::cache_stats() const {
+    TbCacheStats stats = {0, 0, 0};
+
+    for (const std::unique_ptr<BlockCache> &shard : cache) {
+        std::lock_guard<std::mutex> guard(shard->lock);
+        stats.probes += shard->stats.probes;
+        stats.hits += shard->stats.hits;
+        stats.misses += shard->stats.misses;
+    }
+    return stats;
+}
+// End Tablebases function implementations
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "chess.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifndef CPP_CHESS_TABLEBASE_H
+#define CPP_CHESS_TABLEBASE_H
+
+// kings included. the file format and the prober go this far, generating a five piece table needs a few GB though
+const int TB_MAX_PIECES = 5;
+
+typedef enum {WDL_LOSS = -1, WDL_DRAW = 0, WDL_WIN = 1} WDL;
+
+// what a position is worth to the side to move with perfect play, the fifty move rule left out
+struct TbProbe {
+    WDL wdl;
+    // plies to mate, 0 for draws and for a side that is already mated
+    int dtm;
+};
+
+struct TbGenerateStats {
+    // the table asked for and every table a capture or promotion leads to
+    int tables;
+    // index entries, including the ones that can't happen in a game
+    uint64_t positions;
+    uint64_t bytes_written;
+    double seconds;
+};
+
+// builds the table for a material signature ("KQvK", "KRvKP": white's pieces then black's, kings first) by
+// retrograde analysis, along with the tables of every signature it converts into by a capture or promotion, and
+// writes them to directory as <signature>.cctb. signatures with pawns on both sides (where en-passant would come
+// in) are turned down, so is anything over TB_MAX_PIECES. false if the signature is no good or a file can't be written
+bool generate_tablebases(const std::string &signature, const std::string &directory, TbGenerateStats *stats = nullptr);
+
+// table files hold one byte per index entry: 0 for a draw, otherwise 1 + plies to mate, which are odd for a win
+// of the side to move and even for a loss. the entries are cut into blocks compressed on their own, little endian:
+//   header (48 bytes): "CCTB", uint32 version, char[16] signature, uint64 entries, uint32 entries per block,
+//   uint32 block count, uint64 0
+//   block offsets: uint64 per block plus one for the end of the last, from the start of the file
+//   blocks: tokens, a byte c < 128 followed by c + 1 literal values, or a byte c >= 128 for a run of (c & 127) + 3
+//   equal values (plus a varint if c is 255) followed by the value
+const uint32_t TABLEBASE_VERSION = 1;
+const uint32_t TB_BLOCK_ENTRIES = 8192;
+
+struct TbCacheStats {
+    uint64_t probes;
+    uint64_t hits;
+    uint64_t misses;
+};
+
+// the tables of a directory, mapped and decompressed a block at a time into an LRU cache of fixed size. probes may
+// come from any number of threads, the cache is sharded by block with a lock per shard and misses decompress unlocked
+class Tablebases {
+public:
+    static const size_t DEFAULT_CACHE_BLOCKS = 1024;
+
+    explicit Tablebases(size_t cache_blocks = DEFAULT_CACHE_BLOCKS);
+    ~Tablebases();
+    Tablebases(const Tablebases &) = delete;
+    Tablebases &operator=(const Tablebases &) = delete;
+
+    // maps every .cctb file of the directory next to the tables already open, returns how many were added.
+    // files that don't validate are skipped
+    int open(const std::string &directory);
+    void close();
+    // most pieces of any open table, 0 with none open
+    int max_pieces() const;
+    // false if no table has the position's material or the position still has castling rights
+    bool probe(const Position &position, TbProbe &result) const;
+    TbCacheStats cache_stats() const;
+
+private:
+    struct Table;
+    struct BlockCache;
+
+    uint8_t read(const Table &table, uint64_t entry) const;
+
+    std::vector<std::unique_ptr<Table>> tables;
+    // material key (see tablebase.cpp) to the table, and whether its colours are the other way round
+    std::unordered_map<uint32_t, std::pair<const Table *, bool>> by_material;
+    int largest = 0;
+    std::vector<std::unique_ptr<BlockCache>> cache;
+};
+
+#endif //CPP_CHESS_TABLEBASE_H
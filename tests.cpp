@@ -2,7 +2,26 @@
 // Created by Cristian Bicheru on 12/8/2019.
 //
 
-#include "chess.cpp"
+#include "batch.h"
+#include "chess.h"
+#include "perft.h"
+#include "pgn.h"
+#include "profile.h"
+#include "fen.h"
+#include "game_file.h"
+#include "search.h"
+#include "tablebase.h"
+#include "eval.h"
+#include "nnue.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <type_traits>
 
 /**
  * Required Checks:
@@ -10,12 +29,1271 @@
  * PUSH/POP MOVES (INCLUDING EN-PASSANT AND CASTLING)
 **/
 
+static int failures = 0;
+
+static void check(bool condition, const char *name) {
+    if (!condition) {
+        std::cout << "FAILED: " << name << std::endl;
+        failures++;
+    }
+}
+
+static bool same_position(const Position &a, const Position &b) {
+    return a.pieces == b.pieces && a.occupancy == b.occupancy && a.side_to_move == b.side_to_move &&
+           a.castling == b.castling && a.ep_square == b.ep_square && a.halfmove_clock == b.halfmove_clock;
+}
+
+static void push_uci(Board &board, const char *uci) {
+    board.push(move_from_uci(std::unique_ptr<std::string>(new std::string(uci))));
+}
+
+static void test_uci() {
+    check(*move_from_uci(std::unique_ptr<std::string>(new std::string("e2e4")))->get_uci() == "e2e4", "uci round trip");
+    check(*move_from_uci(std::unique_ptr<std::string>(new std::string("a7a8q")))->get_uci() == "a7a8q", "uci promotion round trip");
+
+    Board board = Board();
+    MoveList list;
+    char uci[6];
+    bool round_trip = true;
+
+    check(board.parse_uci("e2e4").flags() == DOUBLE_PUSH, "parsed double push");
+    check(board.parse_uci("e2e5") == NULL_MOVE, "illegal uci move");
+    check(board.parse_uci("e7e5") == NULL_MOVE, "uci move of the wrong side");
+    check(board.parse_uci("e2e4x") == NULL_MOVE && board.parse_uci("i2i4") == NULL_MOVE && board.parse_uci("e2") == NULL_MOVE &&
+          board.parse_uci("e2e4q") == NULL_MOVE && board.parse_uci("g1f3n") == NULL_MOVE, "malformed uci moves");
+    std::string_view rest = "  moves e2e4\te7e5 \r";
+    check(next_token(rest) == "moves" && next_token(rest) == "e2e4" && next_token(rest) == "e7e5" && next_token(rest).empty() &&
+          rest.empty(), "next_token");
+
+    board.set_fen("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+    check(board.parse_uci("e1g1").flags() == KING_CASTLE && board.parse_uci("e1c1").flags() == QUEEN_CASTLE, "parsed castles");
+    check(board.parse_uci("e1g1q") == NULL_MOVE && board.parse_uci("e1c1r") == NULL_MOVE, "malformed uci castles");
+    board.push_uci("a2a4");
+    check(board.parse_uci("b4a3").flags() == EP_CAPTURE, "parsed en-passant capture");
+    check(board.parse_uci("b4a3q") == NULL_MOVE, "malformed uci en-passant capture");
+    board.legal_moves(list);
+    for (PackedMove move : list) {
+        format_uci(move, uci);
+        round_trip &= board.parse_uci(uci) == move;
+    }
+    check(round_trip, "format_uci and parse_uci round trip");
+
+    board.set_fen("1r2k3/P7/8/8/8/8/8/4K3 w - - 0 1");
+    check(board.parse_uci("a7b8r").flags() == ROOK_PROMO_CAPTURE, "parsed promotion capture");
+    check(board.parse_uci("a7a8n").flags() == KNIGHT_PROMOTION, "parsed underpromotion");
+    check(board.parse_uci("a7a8") == NULL_MOVE && board.parse_uci("a7a8k") == NULL_MOVE, "promotion needs a piece");
+    check(!board.push_uci("a7a6") && board.get_ply() == 0, "push_uci refuses illegal moves");
+}
+
+static void test_push_pop() {
+    Board board = Board();
+    Position start = board.get_position();
+
+    push_uci(board, "e2e4");
+    check(board.get_position().piece_on(make_square(3, 4)) == PAWN, "e2e4 moves the pawn");
+    check(board.get_position().ep_square == make_square(2, 4), "e2e4 sets the en-passant square");
+    check(board.get_position().side_to_move == BLACK, "black to move after e2e4");
+    board.pop();
+    check(same_position(board.get_position(), start), "e2e4 pop restores the start position");
+
+    // en-passant
+    push_uci(board, "e2e4");
+    push_uci(board, "a7a6");
+    push_uci(board, "e4e5");
+    push_uci(board, "d7d5");
+    Position before_ep = board.get_position();
+    push_uci(board, "e5d6");
+    check(board.get_position().piece_on(make_square(4, 3)) == EMPTY, "en-passant removes the captured pawn");
+    check(board.get_position().piece_on(make_square(5, 3)) == PAWN, "en-passant moves the capturing pawn");
+    board.pop();
+    check(same_position(board.get_position(), before_ep), "en-passant pop");
+
+    // castling, both sides
+    board.reset();
+    for (const char *uci : {"e2e4", "e7e5", "g1f3", "b8c6", "f1c4", "d7d6", "d2d3", "c8g4", "b1c3", "d8d7", "c1e3"}) {
+        push_uci(board, uci);
+    }
+    Position before_castle = board.get_position();
+    push_uci(board, "e8c8");
+    check(board.get_position().piece_on(make_square(7, 2)) == KING, "queenside castle moves the king");
+    check(board.get_position().piece_on(make_square(7, 3)) == ROOK, "queenside castle moves the rook");
+    check((board.get_position().castling & (BLACK_OO | BLACK_OOO)) == 0, "castling clears the castling rights");
+    push_uci(board, "e1g1");
+    check(board.get_position().piece_on(make_square(0, 6)) == KING, "kingside castle moves the king");
+    check(board.get_position().piece_on(make_square(0, 5)) == ROOK, "kingside castle moves the rook");
+    board.pop();
+    board.pop();
+    check(same_position(board.get_position(), before_castle), "castle pop");
+
+    // promotion with capture
+    board.reset();
+    for (const char *uci : {"h2h4", "g7g5", "h4g5", "h7h6", "g5h6", "f8g7", "h6g7"}) {
+        push_uci(board, uci);
+    }
+    Position before_promotion = board.get_position();
+    push_uci(board, "a7a6");
+    push_uci(board, "g7h8q");
+    check(board.get_position().piece_on(make_square(7, 7)) == QUEEN, "promotion places the new piece");
+    check((board.get_position().castling & BLACK_OO) == 0, "capturing the rook clears its castling right");
+    board.pop();
+    board.pop();
+    check(same_position(board.get_position(), before_promotion), "promotion pop");
+}
+
+static void test_packed_moves() {
+    Board board = Board();
+    Position start = board.get_position();
+
+    check(sizeof(PackedMove) == 2 && std::is_trivially_copyable<PackedMove>::value, "PackedMove is 16 bits");
+    check(std::is_trivially_copyable<UndoState>::value, "UndoState is trivially copyable");
+    check(PackedMove(12, 28, DOUBLE_PUSH).from() == 12 && PackedMove(12, 28, DOUBLE_PUSH).to() == 28, "PackedMove squares");
+    check(PackedMove(52, 61, QUEEN_PROMO_CAPTURE).promotion_piece() == QUEEN, "queen promotion piece");
+    check(PackedMove(52, 61, KNIGHT_PROMOTION).promotion_piece() == KNIGHT, "knight promotion piece");
+
+    board.push(PackedMove(make_square(1, 4), make_square(3, 4), DOUBLE_PUSH));
+    board.push(PackedMove(make_square(7, 6), make_square(5, 5), QUIET));
+    check(board.get_ply() == 2, "two moves on the stack");
+    check(board.get_position().halfmove_clock == 1, "knight move advances the halfmove clock");
+    check(board.last_move() == PackedMove(make_square(7, 6), make_square(5, 5), QUIET), "last move");
+    board.pop();
+    board.pop();
+    check(same_position(board.get_position(), start), "packed push/pop round trip");
+}
+
+static unsigned long long count_leaves(Board &board, int depth) {
+    MoveList list;
+    unsigned long long nodes = 0;
+
+    board.legal_moves(list);
+    if (depth == 1) {
+        return list.size;
+    }
+    for (PackedMove move : list) {
+        board.push(move);
+        nodes += count_leaves(board, depth - 1);
+        board.pop();
+    }
+    return nodes;
+}
+
+// slider attacks the slow way, walking each direction until something is in the way
+static Bitboard walk_attacks(int sq, Bitboard occupied, bool rook) {
+    const int steps[8][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}, {1, 1}, {1, -1}, {-1, 1}, {-1, -1}};
+    Bitboard attacks = 0;
+    int d, r, c;
+
+    for (d = rook ? 0 : 4; d < (rook ? 4 : 8); d++) {
+        for (r = square_row(sq) + steps[d][0], c = square_col(sq) + steps[d][1]; 0 <= r && r < 8 && 0 <= c && c < 8;
+             r += steps[d][0], c += steps[d][1]) {
+            attacks |= square_bb(make_square(r, c));
+            if (occupied & square_bb(make_square(r, c))) {
+                break;
+            }
+        }
+    }
+    return attacks;
+}
+
+static void test_move_generation() {
+    Board board = Board();
+    MoveList list;
+
+    // the tables are built by the compiler, check them against a walk over random occupancies
+    bool tables_agree = true;
+    uint64_t seed = 0x2545F4914F6CDD1DULL;
+    for (int i = 0; i < 20000; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        int sq = (int) (seed % 64);
+        Bitboard occupied = seed & (seed >> 17) & (seed << 11);
+        tables_agree &= rook_attacks(sq, occupied) == walk_attacks(sq, occupied, true);
+        tables_agree &= bishop_attacks(sq, occupied) == walk_attacks(sq, occupied, false);
+        tables_agree &= piece_attacks<QUEEN>(sq, occupied) == (walk_attacks(sq, occupied, true) | walk_attacks(sq, occupied, false));
+    }
+    check(tables_agree, "slider tables agree with walking the rays");
+    check(BETWEEN_BB[make_square(0, 0)][make_square(7, 7)] == (0x8040201008040201ULL & ~square_bb(0) & ~square_bb(63)) &&
+          BETWEEN_BB[make_square(0, 0)][make_square(1, 2)] == 0 && LINE_BB[make_square(3, 0)][make_square(3, 5)] == ROW_1 << 24,
+          "between and line tables");
+    check(knight_attacks(make_square(0, 0)) == (square_bb(make_square(1, 2)) | square_bb(make_square(2, 1))) &&
+          pawn_attacks(BLACK, make_square(3, 0)) == square_bb(make_square(2, 1)) && popcount(king_attacks(make_square(4, 4))) == 8,
+          "leaper tables");
+
+    board.legal_moves(list);
+    check(list.size == 20, "20 legal moves from the start position");
+    check(count_leaves(board, 3) == 8902, "start position has 8902 nodes at depth 3");
+    check(count_leaves(board, 4) == 197281, "start position has 197281 nodes at depth 4");
+
+    // fool's mate, white has no moves left
+    for (const char *uci : {"f2f3", "e7e5", "g2g4", "d8h4"}) {
+        push_uci(board, uci);
+    }
+    board.legal_moves(list);
+    check(board.in_check() && list.size == 0, "fool's mate is checkmate");
+    board.pop();
+    board.pop();
+
+    King king = King(WHITE);
+    check(king.get_pseudo_legal_moves(&board, 0, 4).size() == 1, "king on e1 can only go to f2");
+
+    // is_legal has to accept exactly the generated moves, whatever the flags say
+    bool agrees = true;
+    for (const PerftPosition &position : PERFT_SUITE) {
+        board.set_fen(position.fen);
+        board.legal_moves(list);
+        int accepted = 0;
+        for (int from = 0; from < 64; from++) {
+            for (int to = 0; to < 64; to++) {
+                for (int flags = 0; flags < 16; flags++) {
+                    PackedMove move = PackedMove(from, to, flags);
+                    if (is_legal(board.get_position(), move)) {
+                        accepted++;
+                        agrees &= list.contains(move);
+                    }
+                }
+            }
+        }
+        agrees &= accepted == list.size;
+    }
+    check(agrees, "is_legal agrees with the generator");
+}
+
+static void test_fen() {
+    Board board = Board();
+    const char *kiwipete = "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1";
+
+    check(board.get_fen() == STARTING_FEN, "start position fen");
+    push_uci(board, "e2e4");
+    check(board.get_fen() == "rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1", "fen after e2e4");
+    push_uci(board, "g8f6");
+    check(board.get_fen() == "rnbqkb1r/pppppppp/5n2/8/4P3/8/PPPP1PPP/RNBQKBNR w KQkq - 1 2", "fen after g8f6");
+
+    check(board.set_fen(kiwipete) && board.get_fen() == kiwipete, "kiwipete fen round trip");
+    check(board.set_fen("8/8/8/8/8/8/8/8 b - - 12 40") == false, "fen without kings is rejected");
+    check(board.set_fen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBN w KQkq - 0 1") == false, "short row is rejected");
+    check(board.get_fen() == STARTING_FEN, "a rejected fen resets the board");
+}
+
+static void test_fen_parser() {
+    Position position;
+    FenResult result;
+    std::string_view operations, operand;
+    char buffer[FEN_BUFFER_SIZE];
+    size_t length;
+
+    for (const PerftPosition &entry : PERFT_SUITE) {
+        result = parse_fen(entry.fen, position);
+        length = write_fen(position, result.fullmove_number, buffer, sizeof(buffer));
+        if (!result.ok || std::string_view(buffer, length) != entry.fen) {
+            check(false, entry.name);
+        }
+    }
+    check(write_fen(position, 1, buffer, 16) == 0, "write_fen refuses a short buffer");
+
+    result = parse_fen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq -", position);
+    check(result.ok && result.fullmove_number == 1 && position.halfmove_clock == 0, "move counters are optional");
+    result = parse_fen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR  w  KQkq  -  3  9 \n", position);
+    check(result.ok && result.fullmove_number == 9 && position.halfmove_clock == 3, "runs of spaces are tolerated");
+    result = parse_fen("4k3/8/8/8/8/8/8/4K2R w KQkq - 0 1", position);
+    check(result.ok && position.castling == WHITE_OO, "castling rights without their rook are dropped");
+
+    // error offsets point at the offending character
+    result = parse_fen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNX w KQkq - 0 1", position);
+    check(!result.ok && result.offset == 42, "bad piece letter is located");
+    result = parse_fen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR x KQkq - 0 1", position);
+    check(!result.ok && result.offset == 44, "bad side to move is located");
+    result = parse_fen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQxq - 0 1", position);
+    check(!result.ok && result.offset == 48, "bad castling right is located");
+    result = parse_fen("rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e6 0 1", position);
+    check(!result.ok && result.offset == 54, "en-passant row of the wrong side is located");
+    result = parse_fen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1 extra", position);
+    check(!result.ok && result.offset == 57, "trailing garbage is located");
+    result = parse_fen("rnbqkbnr/pppppppp/44/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", position);
+    check(!result.ok && result.offset == 19, "consecutive digits are rejected");
+    check(!parse_fen("P3k3/8/8/8/8/8/8/4K3 w - - 0 1", position).ok, "pawn on the last row is rejected");
+    check(!parse_fen("4k3/8/8/8/8/8/8/r3K3 b - - 0 1", position).ok, "side not to move in check is rejected");
+    check(!parse_fen("", position).ok, "empty fen is rejected");
+
+    result = parse_epd("1k1r4/pp1b1R2/3q2pp/4p3/2B5/4Q3/PPP2B2/2K5 b - - bm Qd1+; id \"BK.01\"; hmvc 7;", position, operations);
+    check(result.ok && position.halfmove_clock == 7, "epd position and hmvc");
+    check(epd_operation(operations, "bm", operand) && operand == "Qd1+", "epd bm operation");
+    check(epd_operation(operations, "id", operand) && operand == "BK.01", "epd quoted operation");
+    check(!epd_operation(operations, "am", operand), "missing epd operation");
+
+    const char *file = "# comment\n\n4k3/8/8/8/8/8/8/4K3 w - - id \"a\";\n4k3/8/8/8/8/8/8/4K3 w - z id \"b\";\r\n";
+    EpdReader reader(file);
+    check(reader.next(position, operations, result) && result.ok && reader.line_number() == 3, "epd reader skips comments");
+    check(reader.next(position, operations, result) && !result.ok && result.offset == 69, "epd reader offsets are file relative");
+    check(!reader.next(position, operations, result), "epd reader stops at the end");
+}
+
+static void test_game_file() {
+    std::string path = "/tmp/cpp_chess_test.games", text;
+    std::vector<std::vector<PackedMove>> games;
+    Position position, unpacked;
+    PackedPosition packed;
+    GameWriter writer;
+    GameReader reader;
+    GameDecoder decoder;
+    GameRecord record;
+    ConvertResult converted;
+    Board board = Board();
+    MoveList list;
+    PackedMove move;
+    uint64_t seed = 12345;
+    bool round_trip = true, replayed = true;
+    int fullmove, game, ply;
+    size_t i;
+
+    for (const PerftPosition &suite : PERFT_SUITE) {
+        board.set_fen(suite.fen);
+        position = board.get_position();
+        round_trip &= pack_position(position, 42, packed) && unpack_position(packed, unpacked, fullmove) &&
+                      same_position(position, unpacked) && unpacked.key == position.key && unpacked.psqt == position.psqt &&
+                      fullmove == 42;
+    }
+    check(round_trip, "packed positions round trip");
+    pack_position(board.get_position(), 1, packed);
+    packed.pieces[0] = 0x77;
+    check(!unpack_position(packed, unpacked, fullmove), "packed position with a bad piece rejected");
+
+    // random games, the last one longer than the undo stack
+    check(writer.open(path), "game file opens");
+    for (game = 0; game < 20; game++) {
+        // knight against a bare king can't end in mate, so the last game runs its full length
+        if (game == 19) {
+            board.set_fen("4k3/8/8/8/8/8/8/1N2K3 w - - 0 1");
+        } else {
+            board.reset();
+        }
+        writer.begin_game(board.get_position(), 1);
+        games.emplace_back();
+        for (ply = 0; ply < (game == 19 ? 2000 : 150); ply++) {
+            board.legal_moves(list);
+            if (list.size == 0) {
+                break;
+            }
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+            move = list.moves[seed % list.size];
+            board.push(move);
+            round_trip &= writer.add_move(move);
+            games.back().push_back(move);
+        }
+        writer.end_game(game % 2 ? RESULT_DRAW : RESULT_UNKNOWN);
+    }
+    check(round_trip && !writer.add_move(games[0][0]) && games[19].size() > (size_t) MAX_GAME_PLY, "game writer takes legal moves only");
+    check(writer.finish() && reader.open(path) && reader.game_count() == 20, "game file written and mapped");
+
+    // backwards, random access has to work
+    for (game = 19; game >= 0; game--) {
+        replayed &= reader.game((uint64_t) game, record) && decoder.start(record, board) &&
+                    record.plies == (int) games[game].size() && record.result == (game % 2 ? RESULT_DRAW : RESULT_UNKNOWN);
+        for (i = 0; i < games[game].size(); i++) {
+            replayed &= decoder.next(board, move) && move == games[game][i];
+        }
+        replayed &= !decoder.next(board, move);
+    }
+    check(replayed && !reader.game(20, record), "games replay from the file");
+    reader.close();
+
+    text = "# two games\nstartpos moves e2e4 e7e5 g1f3 1-0\n\nfen 4k3/8/8/8/8/8/4P3/4K3 w - - 0 30 moves e2e4 e8d7 1/2-1/2\n";
+    writer.open(path);
+    converted = convert_uci_games(text, writer);
+    check(converted.ok && converted.games == 2 && writer.finish() && reader.open(path) && reader.game_count() == 2,
+          "uci games converted");
+    check(reader.game(1, record) && decoder.start(record, board) && decoder.next(board, move) && decoder.next(board, move) &&
+          board.get_fen() == "8/3k4/8/8/4P3/8/8/4K3 w - - 1 31" && record.result == RESULT_DRAW, "converted game replays");
+    reader.close();
+
+    writer.open(path);
+    converted = convert_uci_games("startpos moves e2e4\nstartpos moves e2e5\nstartpos\n", writer);
+    check(!converted.ok && converted.games == 1 && converted.line == 2 && writer.finish() && reader.open(path) &&
+          reader.game_count() == 1, "bad uci game stops the conversion");
+    reader.close();
+
+    std::ofstream(path, std::ios::binary) << "CCGF but not really";
+    check(!reader.open(path), "broken game file rejected");
+    remove(path.c_str());
+}
+
+static bool san_round_trips_all_the_way_down(Board &board, int depth) {
+    MoveList list;
+    char san[SAN_BUFFER_SIZE];
+
+    board.legal_moves(list);
+    for (PackedMove move : list) {
+        if (format_san(board, move, san) >= SAN_BUFFER_SIZE || parse_san(board.get_position(), san) != move) {
+            std::cout << board.get_fen() << " " << san << std::endl;
+            return false;
+        }
+        if (depth > 1) {
+            board.push(move);
+            if (!san_round_trips_all_the_way_down(board, depth - 1)) {
+                return false;
+            }
+            board.pop();
+        }
+    }
+    return true;
+}
+
+static std::string san_line(Board &board, std::initializer_list<const char *> line) {
+    std::string text;
+    char san[SAN_BUFFER_SIZE];
+
+    for (const char *uci : line) {
+        format_san(board, board.parse_uci(uci), san);
+        board.push_uci(uci);
+        text += san;
+        text.push_back(' ');
+    }
+    return text;
+}
+
+static void test_pgn() {
+    std::string path = "/tmp/cpp_chess_test.pgn", games_path = "/tmp/cpp_chess_test_pgn.games", text;
+    std::vector<std::string> finals;
+    std::vector<uint64_t> keys(40, 0);
+    std::vector<int> plies(40, 0);
+    Board board = Board();
+    PgnReader reader(64);
+    PgnGame game;
+    PgnReplay replay;
+    PgnStats stats;
+    GameWriter writer;
+    GameReader games;
+    GameRecord record;
+    GameDecoder decoder;
+    ConvertResult converted;
+    PackedMove move;
+    ThreadPool pool(3);
+    MoveList list;
+    uint64_t seed = 99;
+    bool round_trip = true, matches = true;
+    int i, ply;
+    char san[SAN_BUFFER_SIZE];
+
+    for (const PerftPosition &position : PERFT_SUITE) {
+        board.set_fen(position.fen);
+        round_trip &= san_round_trips_all_the_way_down(board, 2);
+    }
+    check(round_trip, "SAN round trips");
+
+    board.reset();
+    check(san_line(board, {"g1f3", "d7d5", "e2e4", "d5e4", "f3g5", "g8f6", "b1c3", "b8d7", "g5e4", "d7b6", "e4f6"}) ==
+          "Nf3 d5 e4 dxe4 Ng5 Nf6 Nc3 Nbd7 Ngxe4 Nb6 Nxf6+ ", "SAN disambiguation and check");
+    board.set_fen("r3k2r/1P6/8/3pP3/8/8/8/R3K2R w KQkq d6 0 1");
+    check(parse_san(board.get_position(), "exd6") == board.parse_uci("e5d6") &&
+          parse_san(board.get_position(), "bxa8=Q+") == board.parse_uci("b7a8q") &&
+          parse_san(board.get_position(), "b8N") == board.parse_uci("b7b8n") &&
+          parse_san(board.get_position(), "O-O") == board.parse_uci("e1g1") &&
+          parse_san(board.get_position(), "0-0-0") == board.parse_uci("e1c1") &&
+          parse_san(board.get_position(), "Rad1!?") == board.parse_uci("a1d1"), "SAN forms");
+    check(parse_san(board.get_position(), "b8") == NULL_MOVE && parse_san(board.get_position(), "Nf3") == NULL_MOVE &&
+          parse_san(board.get_position(), "Ke3") == NULL_MOVE && parse_san(board.get_position(), "e5") == NULL_MOVE &&
+          parse_san(board.get_position(), "") == NULL_MOVE && parse_san(board.get_position(), "Qx") == NULL_MOVE,
+          "bad SAN rejected");
+    format_san(board, board.parse_uci("b7a8q"), san);
+    check(std::string(san) == "bxa8=Q+", "SAN promotion");
+
+    text = "[Event \"Test \\\"one\\\"\"]\n[Result \"1-0\"]\n\n1. e4 {a [comment]\n[not a tag]} e5 2.Nf3 (2. f4 exf4 (2... d5)) 2... Nc6 $1\n"
+           "3. Bb5 ; rest of line\n1-0\n\n"
+           "[Event \"Two\"]\n[SetUp \"1\"]\n[FEN \"4k3/8/8/8/8/8/4P3/4K3 w - - 0 30\"]\n\n30. e4 Kd7 *\n"
+           "[Event \"Three\"]\n1. e4 e5?? 2. Qh5 Bad 0-1\n";
+    std::ofstream(path, std::ios::binary) << text;
+    check(reader.open(path) && reader.next(game) && game.tag("Event") == "Test \\\"one\\\"" && game.result() == RESULT_WHITE_WINS,
+          "PGN tags");
+    replay = replay_pgn_game(game, board, 0, 0, [&](const PgnPosition &position) {
+        finals.push_back(position.board->get_fen());
+    });
+    check(replay.ok && replay.plies == 5 && finals.size() == 6 &&
+          finals.back() == "r1bqkbnr/pppp1ppp/2n5/1B2p3/4P3/5N2/PPPP1PPP/RNBQK2R b KQkq - 3 3", "PGN game replays");
+    check(reader.next(game) && game.tag("Event") == "Two" && replay_pgn_game(game, board, 1, 0, nullptr).plies == 2 &&
+          board.get_fen() == "8/3k4/8/8/4P3/8/8/4K3 w - - 1 31", "PGN game with a FEN tag");
+    check(reader.next(game) && game.tag("Event") == "Three" && game.result() == RESULT_UNKNOWN, "PGN game without a result tag");
+    replay = replay_pgn_game(game, board, 2, 0, nullptr);
+    check(!replay.ok && replay.started && replay.plies == 3 && game.movetext.substr(replay.error_offset, 3) == "Bad",
+          "PGN replay stops at a bad move");
+    check(!reader.next(game) && reader.offset() == text.size(), "PGN reader ends with the file");
+
+    // the same file into a game file: the first two games go through, the third stops the conversion
+    writer.open(games_path);
+    converted = convert_pgn_games(path, writer);
+    check(!converted.ok && converted.games == 2 && converted.line == 3 && writer.finish() && games.open(games_path) &&
+          games.game_count() == 2, "PGN games converted");
+    check(games.game(0, record) && decoder.start(record, board), "converted PGN game starts");
+    for (ply = 0; decoder.next(board, move); ply++) {}
+    check(ply == 5 && board.get_fen() == finals.back() && record.result == RESULT_WHITE_WINS && games.game(1, record) &&
+          decoder.start(record, board) && board.get_fen() == "4k3/8/8/8/8/8/4P3/4K3 w - - 0 30" && record.plies == 2,
+          "converted PGN game replays");
+    games.close();
+    remove(games_path.c_str());
+
+    // random games written as PGN, replayed on the pool and checked against the games as played
+    {
+        std::ofstream out(path, std::ios::binary);
+        for (i = 0; i < 40; i++) {
+            board.reset();
+            out << "[Event \"random " << i << "\"]\n[Result \"*\"]\n\n";
+            for (ply = 0; ply < 120; ply++) {
+                board.legal_moves(list);
+                if (list.size == 0) {
+                    break;
+                }
+                seed ^= seed << 13;
+                seed ^= seed >> 7;
+                seed ^= seed << 17;
+                format_san(board, list.moves[seed % list.size], san);
+                board.push(list.moves[seed % list.size]);
+                out << (ply % 2 ? "" : std::to_string(ply / 2 + 1) + ". ") << san << (ply % 10 == 9 ? "\n" : " ");
+            }
+            out << "*\n\n";
+            keys[i] = board.key();
+            plies[i] = board.get_ply();
+        }
+    }
+    std::vector<uint64_t> replayed_keys(40, 0);
+    std::vector<int> replayed_plies(40, -1);
+    stats = replay_pgn_parallel(path, pool, [&](const PgnPosition &position) {
+        replayed_keys[position.game] = position.board->key();
+        replayed_plies[position.game]++;
+    });
+    for (i = 0; i < 40; i++) {
+        matches &= replayed_keys[i] == keys[i] && replayed_plies[i] == plies[i];
+    }
+    check(matches && stats.games == 40 && stats.failed_games == 0, "parallel PGN replay");
+    remove(path.c_str());
+}
+
+static void test_perft_suite() {
+    Board board = Board();
+    int depth;
+
+    for (const PerftPosition &position : PERFT_SUITE) {
+        for (depth = 7; depth > 0 && (position.nodes[depth] == 0 || position.nodes[depth] > 2000000); depth--);
+        board.set_fen(position.fen);
+        check(perft(board, depth) == position.nodes[depth], position.name);
+    }
+    board.set_fen(PERFT_SUITE[1].fen);
+    check(perft_full(board, 3) == 97862, "kiwipete depth 3 without bulk counting");
+    uint64_t total = 0;
+    for (const PerftDivide &entry : perft_divide(board, 2)) {
+        total += entry.nodes;
+    }
+    check(total == 2039, "kiwipete divide sums to the depth 2 count");
+
+    ThreadPool pool(3);
+    std::vector<PerftThreadStats> stats;
+    check(perft_parallel(board, 4, pool, true, &stats) == 4085603, "parallel kiwipete depth 4");
+    check(stats.size() == 3, "one stats entry per worker");
+    board.reset();
+    check(perft_parallel(board, 4, pool, false) == 197281, "parallel start position without bulk counting");
+    stats.clear();
+    check(perft_parallel(board, 1, pool, true, &stats) == 20 && stats.size() == 3, "parallel depth 1");
+    stats.clear();
+    check(perft_parallel(board, 0, pool, false, &stats) == 1 && stats.size() == 3, "parallel depth 0");
+}
+
+static bool key_matches_all_the_way_down(Board &board, int depth) {
+    MoveList list;
+
+    if (board.key() != board.get_position().compute_key()) {
+        return false;
+    }
+    if (depth == 0) {
+        return true;
+    }
+    board.legal_moves(list);
+    for (PackedMove move : list) {
+        board.push(move);
+        if (!key_matches_all_the_way_down(board, depth - 1)) {
+            return false;
+        }
+        board.pop();
+    }
+    return true;
+}
+
+static void test_zobrist() {
+    Board board = Board();
+    Board other = Board();
+    uint64_t start = board.key();
+
+    for (const char *uci : {"g1f3", "g8f6", "b1c3"}) {
+        push_uci(board, uci);
+    }
+    for (const char *uci : {"b1c3", "g8f6", "g1f3"}) {
+        push_uci(other, uci);
+    }
+    check(board.key() == other.key(), "transpositions share a key");
+    board.pop();
+    board.pop();
+    board.pop();
+    check(board.key() == start, "pop restores the key");
+
+    // e3 can't be taken, so the en-passant file must not change the key
+    push_uci(board, "e2e4");
+    other.set_fen("rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq - 0 1");
+    check(board.key() == other.key(), "an uncapturable en-passant square isn't hashed");
+    other.set_fen("rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR w KQkq - 0 1");
+    check(board.key() != other.key(), "side to move is hashed");
+
+    for (const PerftPosition &position : PERFT_SUITE) {
+        board.set_fen(position.fen);
+        check(key_matches_all_the_way_down(board, 3), position.name);
+    }
+}
+
+static void test_transposition_table() {
+    TranspositionTable table(1);
+    Board board = Board();
+    TTHit hit;
+
+    check(table.size_bytes() == 1024 * 1024 && table.entry_count() == 65536, "1MB table has 65536 entries");
+    check(!table.probe(0x1234, hit), "empty table misses");
+    table.store(0x1234, 7, 2, 0xABCDEF);
+    check(table.probe(0x1234, hit) && hit.payload == 0xABCDEF && hit.depth == 7 && hit.flags == 2, "stored entry is found");
+    check(!table.probe(0x1235, hit), "other keys miss");
+    check(table.stats().hits == 1 && table.stats().misses == 2, "hit and miss counters");
+    check(table.huge_page_bytes() == 0, "no huge pages unless asked for");
+    // whether the kernel grants them depends on the machine, but it can't grant more than the table
+    TranspositionTable huge(8, true);
+    check(huge.size_bytes() == 8 * 1024 * 1024 && huge.huge_page_bytes() <= huge.size_bytes(), "huge page table");
+
+    // a tiny table forces replacement and collisions, the counts must not change
+    for (const PerftPosition &position : PERFT_SUITE) {
+        board.set_fen(position.fen);
+        if (position.nodes[4]) {
+            check(perft_hashed(board, 4, table) == position.nodes[4], position.name);
+        }
+    }
+    check(table.stats().collisions > 0, "small table reports collisions");
+
+    ThreadPool pool(3);
+    table.clear();
+    board.set_fen(PERFT_SUITE[1].fen);
+    check(perft_parallel(board, 5, pool, true, nullptr, &table) == 193690690, "parallel hashed kiwipete depth 5");
+}
+
+static void test_state_adapter() {
+    Board board = Board();
+    Board other = Board();
+
+    push_uci(board, "g1f3");
+    other.set_state(std::move(*board.get_state()));
+    check(board.get_position().pieces == other.get_position().pieces, "get_state/set_state round trip");
+
+    // set_state starts a new stack, and only keeps castling rights the board already had
+    Board third;
+    push_uci(third, "e2e4");
+    push_uci(third, "e7e5");
+    third.set_state(std::move(*board.get_state()));
+    check(third.get_ply() == 0 && third.get_position().castling == ALL_CASTLING &&
+          third.get_position().key == third.get_position().compute_key(), "set_state clears the move stack");
+    third.set_fen("r3k2r/8/8/8/8/8/8/R3K2R w Kq - 0 1");
+    third.set_state(std::move(*third.get_state()));
+    check(third.get_position().castling == (WHITE_OO | BLACK_OOO), "set_state grants no new castling rights");
+
+    board.switch_colors();
+    board.switch_colors();
+    check(board.get_position().pieces == other.get_position().pieces, "switch_colors twice is the identity");
+    board.mirror();
+    check(board.get_position().piece_on(make_square(7, 3)) == KING, "mirror rotates the board");
+}
+
+static bool psqt_matches_all_the_way_down(Board &board, int depth) {
+    MoveList list;
+
+    if (!(board.get_position().psqt == board.get_position().compute_psqt())) {
+        return false;
+    }
+    if (depth == 0) {
+        return true;
+    }
+    board.legal_moves(list);
+    for (PackedMove move : list) {
+        board.push(move);
+        if (!psqt_matches_all_the_way_down(board, depth - 1)) {
+            return false;
+        }
+        board.pop();
+    }
+    return true;
+}
+
+static void test_evaluation() {
+    Board board = Board();
+    Board flipped = Board();
+    bool symmetric = true, matches = true;
+    int before;
+
+    check(evaluate(board.get_position()) == 0, "start position evaluates to 0");
+    for (const PerftPosition &position : PERFT_SUITE) {
+        board.set_fen(position.fen);
+        flipped.set_fen(position.fen);
+        flipped.switch_colors();
+        symmetric &= evaluate(board.get_position()) == evaluate(flipped.get_position());
+        before = evaluate(board.get_position());
+        matches &= psqt_matches_all_the_way_down(board, 3) && evaluate(board.get_position()) == before;
+    }
+    check(symmetric, "evaluation is colour symmetric");
+    check(matches, "incremental evaluation matches a recomputation");
+
+    // a pawn is worth more once the pieces are gone, the queens themselves cancel out
+    board.set_fen("4k3/8/8/3P4/8/8/8/4K3 w - - 0 1");
+    before = evaluate(board.get_position());
+    board.set_fen("3qk3/8/8/3P4/8/8/8/3QK3 w - - 0 1");
+    check(before > evaluate(board.get_position()), "tapered pawn bonus");
+    check(evaluate_from_scratch(board.get_position()) == evaluate(board.get_position()), "evaluate_from_scratch");
+}
+
+static bool accumulator_matches_all_the_way_down(Board &board, NnueEvaluator &evaluator, NnueEvaluator &fresh, int depth) {
+    MoveList list;
+
+    fresh.reset(board.get_position());
+    if (memcmp(&evaluator.current(), &fresh.current(), sizeof(Accumulator)) != 0) {
+        return false;
+    }
+    if (depth == 0) {
+        return true;
+    }
+    if (!board.in_check()) {
+        board.push_null();
+        evaluator.push(board);
+        if (!accumulator_matches_all_the_way_down(board, evaluator, fresh, 0)) {
+            return false;
+        }
+        board.pop_null();
+        evaluator.pop();
+    }
+    board.legal_moves(list);
+    for (PackedMove move : list) {
+        board.push(move);
+        evaluator.push(board);
+        if (!accumulator_matches_all_the_way_down(board, evaluator, fresh, depth - 1)) {
+            return false;
+        }
+        board.pop();
+        evaluator.pop();
+    }
+    return true;
+}
+
+static void test_nnue() {
+    std::string path = "/tmp/cpp_chess_test.nnue";
+    Network network, loaded, broken;
+    NnueEvaluator evaluator(network), fresh(network), reloaded(loaded);
+    Board board = Board();
+    NNUE_KERNEL kernel, best = nnue_best_kernel();
+    bool matches = true, agree = true, same = true;
+    int scalar;
+    std::vector<char> bytes;
+    TranspositionTable table(4);
+    Search search(table);
+    SearchLimits limits;
+    SearchResult result;
+
+    network.randomize(7);
+    check(network.is_loaded() && !broken.is_loaded(), "randomize makes a network");
+    for (const PerftPosition &position : PERFT_SUITE) {
+        board.set_fen(position.fen);
+        evaluator.reset(board.get_position());
+        matches &= accumulator_matches_all_the_way_down(board, evaluator, fresh, 3);
+    }
+    check(matches, "incremental accumulator matches a refresh");
+
+    // every kernel has to compute exactly what the scalar code does
+    check(nnue_set_kernel(NNUE_SCALAR) && nnue_kernel() == NNUE_SCALAR, "scalar kernel is always there");
+    for (const PerftPosition &position : PERFT_SUITE) {
+        board.set_fen(position.fen);
+        nnue_set_kernel(NNUE_SCALAR);
+        evaluator.reset(board.get_position());
+        scalar = evaluator.evaluate(board.get_position());
+        for (kernel = NNUE_SSE41; kernel <= NNUE_AVX2; kernel = static_cast<NNUE_KERNEL>(kernel + 1)) {
+            if (nnue_set_kernel(kernel)) {
+                evaluator.reset(board.get_position());
+                agree &= evaluator.evaluate(board.get_position()) == scalar;
+            }
+        }
+    }
+    nnue_set_kernel(best);
+    check(agree, "kernels agree");
+
+    check(network.save(path) && loaded.load(path), "network save and load");
+    for (const PerftPosition &position : PERFT_SUITE) {
+        board.set_fen(position.fen);
+        evaluator.reset(board.get_position());
+        reloaded.reset(board.get_position());
+        same &= evaluator.evaluate(board.get_position()) == reloaded.evaluate(board.get_position());
+    }
+    check(same, "loaded network evaluates like the saved one");
+
+    {
+        std::ifstream in(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    std::ofstream(path, std::ios::binary).write(bytes.data(), (std::streamsize) bytes.size() - 1);
+    check(!broken.load(path) && !broken.is_loaded(), "truncated network rejected");
+    bytes[0] = 'X';
+    std::ofstream(path, std::ios::binary).write(bytes.data(), (std::streamsize) bytes.size());
+    check(!broken.load(path), "network with a bad header rejected");
+    check(!broken.load("/nonexistent/cpp_chess.nnue"), "missing network rejected");
+    remove(path.c_str());
+
+    // whatever the network thinks, mate is mate
+    search.set_network(&network);
+    limits.depth = 3;
+    board.set_fen("r1bqkb1r/pppp1ppp/2n2n2/4p2Q/2B1P3/8/PPPP1PPP/RNB1K1NR w KQkq - 4 4");
+    result = search.run(board, limits);
+    check(result.score == MATE_SCORE - 1, "search with a network finds mate in one");
+}
+
+static void test_batch() {
+    std::vector<Position> positions;
+    std::vector<uint8_t> legal(PERFT_SUITE.size()), checks(PERFT_SUITE.size());
+    std::vector<int16_t> evals(PERFT_SUITE.size()), scores(PERFT_SUITE.size());
+    std::vector<PackedMove> moves(PERFT_SUITE.size());
+    ThreadPool pool(3);
+    TranspositionTable table(1);
+    Search search(table);
+    SearchLimits limits;
+    SearchResult result;
+    BatchOptions options;
+    BatchResults results;
+    BatchStats stats;
+    Board board = Board();
+    MoveList list;
+    bool matches = true;
+    size_t i;
+
+    for (const PerftPosition &position : PERFT_SUITE) {
+        board.set_fen(position.fen);
+        positions.push_back(board.get_position());
+    }
+    // tiny chunks so every worker gets some
+    options.search_depth = 3;
+    options.chunk_size = 2;
+    results.legal_moves = legal.data();
+    results.in_check = checks.data();
+    results.static_eval = evals.data();
+    results.score = scores.data();
+    results.best_move = moves.data();
+    stats = analyse_batch(positions.data(), positions.size(), options, results, pool);
+    check(stats.positions == positions.size() && stats.threads == 3, "batch stats");
+
+    limits.depth = 3;
+    for (i = 0; i < positions.size(); i++) {
+        board.set_position(positions[i]);
+        table.clear();
+        result = search.run(board, limits);
+        board.legal_moves(list);
+        matches &= legal[i] == list.size && checks[i] == board.in_check() &&
+                   evals[i] == evaluate(positions[i]) && scores[i] == result.score && moves[i] == result.best_move;
+    }
+    check(matches, "batch results match one position at a time");
+
+    // arrays left out aren't touched
+    results = BatchResults();
+    results.legal_moves = legal.data();
+    legal.assign(legal.size(), 0);
+    evals.assign(evals.size(), 12345);
+    analyse_batch(positions.data(), positions.size(), BatchOptions(), results, pool);
+    check(legal[0] == 20 && evals[0] == 12345, "batch fills only what is asked for");
+}
+
+static void test_game_end() {
+    Board board = Board();
+    int i;
+
+    check(board.status() == GAME_ONGOING && board.result() == RESULT_UNKNOWN && board.repetitions() == 0, "game goes on");
+    for (i = 0; i < 2; i++) {
+        for (const char *uci : {"g1f3", "g8f6", "f3g1", "f6g8"}) {
+            board.push_uci(uci);
+        }
+        check(board.repetitions() == i + 1 && board.is_draw(), "start position repeats");
+    }
+    check(board.status() == GAME_REPETITION && board.result() == RESULT_DRAW, "threefold repetition");
+    board.push_uci("e2e4");
+    board.push_uci("g8f6");
+    board.push_uci("f1e2");
+    board.push_uci("f6g8");
+    check(board.repetitions() == 0 && !board.is_draw(), "a pawn move ends the repetitions");
+    board.push_null();
+    board.push_uci("g1f3");
+    board.push_null();
+    board.push_uci("f3g1");
+    check(board.repetitions() == 0, "no repetition across a null move");
+
+    // longer than the undo stack: the oldest half is dropped, the move number and the repetitions carry on
+    board.reset();
+    for (i = 0; i < 300; i++) {
+        for (const char *uci : {"g1f3", "g8f6", "f3g1", "f6g8"}) {
+            board.push_uci(uci);
+        }
+    }
+    check(board.get_ply() == 1200 - MAX_GAME_PLY / 2 && board.fullmove_number() == 601 && board.repetitions() > 0 &&
+          board.get_fen() == "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 255 601", "game longer than the undo stack");
+    for (i = 0; i < 4; i++) {
+        board.pop();
+    }
+    check(board.get_position().key == Board().get_position().key && board.fullmove_number() == 599, "pop after the undo stack filled");
+
+    board.reset();
+    for (const char *uci : {"f2f3", "e7e5", "g2g4", "d8h4"}) {
+        board.push_uci(uci);
+    }
+    check(board.status() == GAME_CHECKMATE && board.result() == RESULT_BLACK_WINS, "checkmate");
+    board.set_fen("7k/5Q2/6K1/8/8/8/8/8 b - - 0 1");
+    check(board.status() == GAME_STALEMATE && board.result() == RESULT_DRAW, "stalemate");
+    board.set_fen("7k/8/8/8/8/8/8/KQ6 w - - 99 80");
+    check(board.status() == GAME_ONGOING, "ninety-nine plies is still a game");
+    board.push_uci("b1b2");
+    check(board.status() == GAME_FIFTY_MOVES && board.result() == RESULT_DRAW, "fifty move rule");
+    board.set_fen("6k1/6Q1/5K2/8/8/8/8/8 b - - 100 80");
+    check(board.status() == GAME_CHECKMATE, "mate beats the fifty move rule");
+
+    for (const char *fen : {"7k/8/8/8/8/8/8/K7 w - - 0 1", "7k/8/8/8/8/8/8/KN6 w - - 0 1", "7k/8/8/8/8/8/8/Kb6 w - - 0 1",
+                            "6bk/8/8/8/8/8/8/KB6 w - - 0 1", "b6k/1b6/8/8/8/8/8/KB6 w - - 0 1"}) {
+        board.set_fen(fen);
+        check(board.get_position().insufficient_material() && board.status() == GAME_INSUFFICIENT_MATERIAL, fen);
+    }
+    for (const char *fen : {"7k/8/8/8/8/8/8/KNN5 w - - 0 1", "1b5k/8/8/8/8/8/8/KB6 w - - 0 1", "7k/8/8/8/8/8/8/KBN5 w - - 0 1",
+                            "7k/8/8/8/8/8/P7/K7 w - - 0 1", "7k/8/8/8/8/8/8/KR6 w - - 0 1"}) {
+        board.set_fen(fen);
+        check(!board.get_position().insufficient_material(), fen);
+    }
+}
+
+static void test_copy_make() {
+    Board board = Board(), child = Board(), copy = Board();
+    BoardView view = board.view();
+    MoveList list;
+    Position position;
+    bool same = true;
+    int i;
+
+    // every move of a position with castling, en-passant and promotions, copy-made and pushed
+    board.set_fen("r3k2r/1P2p3/8/3pP3/8/8/8/R3K2R w KQkq d6 0 1");
+    board.legal_moves(list);
+    for (PackedMove move : list) {
+        position = board.get_position().after(move);
+        board.push(move);
+        same = same && same_position(position, board.get_position());
+        board.pop();
+    }
+    check(same && list.size > 20, "copy-make matches push");
+
+    view = board.view();
+    check(view.get_fen() == board.get_fen() && view.key() == board.key() && view.piece_on(make_square(6, 1)) == PAWN &&
+          view.is_legal(view.parse_uci("b7b8q")) && view.after(view.parse_uci("e5d6")).ep_square == NO_SQUARE, "board view");
+
+    // the fork keeps what repetitions need and the fullmove number, but none of the irreversible history
+    board.reset();
+    for (const char *uci : {"e2e4", "e7e5", "g1f3", "g8f6", "f3g1", "f6g8", "g1f3"}) {
+        board.push_uci(uci);
+    }
+    board.fork(child);
+    check(child.get_fen() == board.get_fen() && child.get_ply() == 5 && child.last_move() == board.last_move() &&
+          child.repetitions() == 1, "fork");
+    for (const char *uci : {"g8f6", "f3g1", "f6g8"}) {
+        child.push_uci(uci);
+    }
+    check(child.repetitions() == 2 && child.status() == GAME_REPETITION && child.fullmove_number() == 6,
+          "fork keeps the repetition history");
+    for (i = 0; i < 8; i++) {
+        child.pop();
+    }
+    copy.push_uci("e2e4");
+    copy.push_uci("e7e5");
+    check(child.get_ply() == 0 && child.get_fen() == copy.get_fen(), "fork pops back to the pawn move");
+
+    copy = board;
+    check(copy.get_fen() == board.get_fen() && copy.get_ply() == board.get_ply(), "plain board copy");
+}
+
+// the value the tables give a position has to follow from the values of its moves
+static bool tablebase_consistent(const Tablebases &tables, const Position &position) {
+    PackedMove moves[MAX_MOVES];
+    TbProbe probe, child;
+    int n = generate_legal_moves(position, moves), i, win = INT32_MAX, longest = -1;
+    bool drawn = false;
+
+    if (!tables.probe(position, probe)) {
+        return false;
+    }
+    if (n == 0) {
+        return position.in_check() ? probe.wdl == WDL_LOSS && probe.dtm == 0 : probe.wdl == WDL_DRAW;
+    }
+    for (i = 0; i < n; i++) {
+        if (!tables.probe(position.after(moves[i]), child)) {
+            return false;
+        }
+        if (child.wdl == WDL_LOSS) {
+            win = std::min(win, child.dtm + 1);
+        } else if (child.wdl == WDL_WIN) {
+            longest = std::max(longest, child.dtm + 1);
+        } else {
+            drawn = true;
+        }
+    }
+    if (win != INT32_MAX) {
+        return probe.wdl == WDL_WIN && probe.dtm == win;
+    }
+    return drawn ? probe.wdl == WDL_DRAW : probe.wdl == WDL_LOSS && probe.dtm == longest;
+}
+
+static void test_tablebase() {
+    std::string directory = "/tmp/cpp_chess_test_tb";
+    TbGenerateStats stats;
+    Tablebases tables, small(2);
+    TranspositionTable table(4);
+    Search search(table);
+    SearchLimits limits;
+    SearchResult result;
+    TbCacheStats cache;
+    Board board = Board();
+    Position position;
+    TbProbe probe, other;
+    std::vector<std::pair<Position, TbProbe>> sampled;
+    std::vector<std::thread> threads;
+    std::atomic<bool> agree(true);
+    int longest[3] = {0, 0, 0}, wk, bk, sq, piece, t;
+    bool consistent = true, same = true;
+
+    for (const char *signature : {"KPvKP", "KQ", "QvK", "KQvKvK", "KQRBNvK", "KqvK"}) {
+        check(!generate_tablebases(signature, directory), signature);
+    }
+    check(generate_tablebases("KPvK", directory, &stats) && stats.tables == 6 && stats.bytes_written > 0,
+          "generate KPvK and the tables it promotes into");
+    check(tables.open(directory) == 6 && tables.max_pieces() == 3 && small.open(directory) == 6, "open tablebases");
+
+    for (const char *fen : {"6k1/6Q1/5K2/8/8/8/8/8 b - - 0 1", "7k/5Q2/6K1/8/8/8/8/8 b - - 0 1", "7k/8/5K2/8/8/8/8/6Q1 w - - 0 1",
+                            "k7/8/K7/P7/8/8/8/8 w - - 0 1", "k7/8/8/8/8/8/p7/7K b - - 0 1", "8/8/3k4/8/8/8/8/KB6 w - - 0 1"}) {
+        board.set_fen(fen);
+        check(tables.probe(board.get_position(), probe) && tablebase_consistent(tables, board.get_position()), fen);
+    }
+    board.set_fen("6k1/6Q1/5K2/8/8/8/8/8 b - - 0 1");
+    check(tables.probe(board.get_position(), probe) && probe.wdl == WDL_LOSS && probe.dtm == 0, "mated");
+    board.set_fen("7k/8/5K2/8/8/8/8/6Q1 w - - 0 1");
+    check(tables.probe(board.get_position(), probe) && probe.wdl == WDL_WIN && probe.dtm == 1, "mate in one");
+    board.set_fen("k7/8/K7/P7/8/8/8/8 w - - 0 1");
+    check(tables.probe(board.get_position(), probe) && probe.wdl == WDL_DRAW, "rook pawn draw");
+    board.set_fen("k7/8/8/8/8/8/p7/7K b - - 0 1");
+    check(tables.probe(board.get_position(), probe) && probe.wdl == WDL_WIN, "black promotes and wins");
+    board.set_fen("4k3/8/8/8/8/8/8/R3K3 w Q - 0 1");
+    check(!tables.probe(board.get_position(), probe), "no probes with castling rights");
+    board.set_fen("4k3/8/8/8/8/8/8/RR2K3 w - - 0 1");
+    check(!tables.probe(board.get_position(), probe), "no table for KRRvK");
+
+    // every placement, white to move: the longest mates are the textbook ones, and all values add up
+    for (piece = 0; piece < 3; piece++) {
+        for (wk = 0; wk < 64; wk++) {
+            for (bk = 0; bk < 64; bk++) {
+                for (sq = 0; sq < 64; sq++) {
+                    if (wk == bk || sq == wk || sq == bk || (king_attacks(wk) & square_bb(bk)) ||
+                        (piece == 2 && (square_bb(sq) & (ROW_1 | ROW_8)))) {
+                        continue;
+                    }
+                    position.clear();
+                    position.put_piece(WHITE, KING, wk);
+                    position.put_piece(BLACK, KING, bk);
+                    position.put_piece(WHITE, piece == 0 ? QUEEN : piece == 1 ? ROOK : PAWN, sq);
+                    position.key = position.compute_key();
+                    if (position.attackers_to(bk, position.occupied()) & position.occupancy[WHITE]) {
+                        continue;
+                    }
+                    tables.probe(position, probe);
+                    if (probe.wdl == WDL_WIN) {
+                        longest[piece] = std::max(longest[piece], probe.dtm);
+                    }
+                    if ((wk + bk + sq) % 61 == 0) {
+                        consistent = consistent && tablebase_consistent(tables, position);
+                        same = same && small.probe(position, other) &&
+                               other.wdl == probe.wdl && other.dtm == probe.dtm;
+                        sampled.emplace_back(position, probe);
+                    }
+                }
+            }
+        }
+    }
+    check(longest[0] == 19 && longest[1] == 31 && longest[2] == 55, "KQvK mates in 10, KRvK in 16, KPvK in 28");
+    check(consistent, "tablebase values follow from their moves");
+    cache = small.cache_stats();
+    check(same && cache.misses > 0 && cache.hits + cache.misses == cache.probes, "tiny block cache");
+
+    // threads evicting each other's blocks from the tiny cache still read the right values
+    for (t = 0; t < 4; t++) {
+        threads.emplace_back([&, t] {
+            TbProbe mine;
+            size_t i;
+
+            for (i = 0; i < sampled.size(); i++) {
+                const std::pair<Position, TbProbe> &sample = sampled[(i * (t + 1)) % sampled.size()];
+                if (!small.probe(sample.first, mine) || mine.wdl != sample.second.wdl || mine.dtm != sample.second.dtm) {
+                    agree = false;
+                }
+            }
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    cache = small.cache_stats();
+    check(agree && cache.hits + cache.misses == cache.probes, "tablebase probes from several threads");
+
+    // the search takes the shortest mate the tables know
+    search.set_tablebases(&tables);
+    limits.depth = 2;
+    board.set_fen("8/8/8/4k3/8/8/8/R3K3 w - - 0 1");
+    tables.probe(board.get_position(), probe);
+    result = search.run(board, limits);
+    check(probe.wdl == WDL_WIN && result.score == MATE_SCORE - probe.dtm && result.tb_hits > 0, "search probes the tables");
+}
+
+static void test_profile() {
+    Board board = Board();
+    ProfileReport report;
+    std::ostringstream text, json, csv;
+    TranspositionTable table(1);
+    Search search(table);
+    SearchLimits limits;
+    SearchResult result;
+
+    profile_reset();
+    count_leaves(board, 3);
+    // a thread that is gone by the time of the report still counts
+    std::thread([] {
+        Board other = Board();
+        count_leaves(other, 2);
+    }).join();
+    report = profile_report();
+    write_profile_report(text, report);
+    write_profile_json(json, report);
+    write_profile_csv(csv, report);
+    check(json.str().find("\"generated_captures\": ") != std::string::npos &&
+          csv.str().find("timer,make_move,") != std::string::npos && !text.str().empty(), "profile exports");
+    if (!PROFILE_ENABLED) {
+        check(!report.enabled && report.counters[PROFILE_MAKE_MOVES] == 0 && report.timers[TIMER_MAKE_MOVE].calls == 0,
+              "profile is empty when not compiled in");
+        return;
+    }
+    // depth 3 from the start: 1 + 20 + 400 generator calls, 20 + 400 moves made, 34 captures among the leaves.
+    // the thread adds 1 + 20 calls and 20 moves
+    check(report.threads >= 2 && report.counters[PROFILE_GENERATE_CALLS] == 421 + 21 &&
+          report.counters[PROFILE_MAKE_MOVES] == 420 + 20 && report.counters[PROFILE_UNMAKE_MOVES] == 440 &&
+          report.counters[PROFILE_GENERATED_MOVES] == 20 + 400 + 8902 + 20 + 400 &&
+          report.counters[PROFILE_GENERATED_CAPTURES] == 34 && report.timers[TIMER_MAKE_MOVE].calls == 440 &&
+          report.timers[TIMER_GENERATE_MOVES].ticks > 0, "profile counts moves");
+
+    profile_reset();
+    limits.depth = 3;
+    result = search.run(board, limits);
+    report = profile_report();
+    check(report.counters[PROFILE_NODES] == result.nodes && report.timers[TIMER_EVALUATE].calls > 0 &&
+          report.timers[TIMER_TT_PROBE].calls > 0 && report.timers[TIMER_SEARCH].calls >= 1, "profile counts search nodes");
+}
+
+static void test_search() {
+    TranspositionTable table(4);
+    Search search(table);
+    SearchLimits limits;
+    SearchResult result;
+    Board board = Board();
+    char uci[6];
+
+    limits.depth = 4;
+    board.set_fen("r1bqkb1r/pppp1ppp/2n2n2/4p2Q/2B1P3/8/PPPP1PPP/RNB1K1NR w KQkq - 4 4");
+    result = search.run(board, limits);
+    format_uci(result.best_move, uci);
+    check(std::string(uci) == "h5f7" && result.score == MATE_SCORE - 1, "search finds mate in one");
+    check(format_score(result.score) == "mate 1" && format_score(-MATE_SCORE + 2) == "mate -1" && format_score(-35) == "cp -35",
+          "format_score");
+
+    board.set_fen("4k3/8/8/3q4/8/8/3R4/4K3 w - - 0 1");
+    result = search.run(board, limits);
+    format_uci(result.best_move, uci);
+    check(std::string(uci) == "d2d5" && result.score > 0 && result.depth == 4, "search takes the hanging queen");
+
+    board.set_fen("7k/5Q2/6K1/8/8/8/8/8 b - - 0 1");
+    result = search.run(board, limits);
+    check(result.best_move == NULL_MOVE && result.score == 0, "stalemate has no best move");
+
+    // taking the knight leaves black without a move, quiescence has to see the stalemate behind the capture
+    limits.depth = 1;
+    board.set_fen("5Knk/7p/7P/3B4/8/8/8/8 w - - 0 1");
+    result = search.run(board, limits);
+    format_uci(result.best_move, uci);
+    check(std::string(uci) != "d5g8" && result.score > 0, "quiescence scores stalemate as a draw");
+    limits.depth = 4;
+
+    // a queen up, but whatever white does the fifty moves are over
+    board.set_fen("7k/8/8/8/8/8/8/KQ6 w - - 99 80");
+    result = search.run(board, limits);
+    check(result.score == 0 && result.best_move != NULL_MOVE, "search knows the fifty move rule");
+
+    limits.depth = 0;
+    limits.nodes = 5000;
+    board.reset();
+    result = search.run(board, limits);
+    check(result.nodes <= 5000 && result.best_move != NULL_MOVE, "node limit");
+
+    // an infinite search has to come back once stopped from another thread, the bound is loose for loaded machines
+    limits.nodes = 0;
+    limits.infinite = true;
+    std::thread thread([&] { result = search.run(board, limits); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    std::chrono::steady_clock::time_point stopped = std::chrono::steady_clock::now();
+    search.stop();
+    thread.join();
+    check(std::chrono::duration<double>(std::chrono::steady_clock::now() - stopped).count() < 1.0 &&
+          result.best_move != NULL_MOVE, "stop ends an infinite search");
+
+    // lazy SMP has to agree on the forced lines
+    search.set_threads(3);
+    limits.infinite = false;
+    limits.depth = 6;
+    board.set_fen("4k3/8/8/3q4/8/8/3R4/4K3 w - - 0 1");
+    result = search.run(board, limits);
+    format_uci(result.best_move, uci);
+    check(search.threads() == 3 && std::string(uci) == "d2d5" && result.depth >= 6, "parallel search takes the hanging queen");
+    board.set_fen("r1bqkb1r/pppp1ppp/2n2n2/4p2Q/2B1P3/8/PPPP1PPP/RNB1K1NR w KQkq - 4 4");
+    result = search.run(board, limits);
+    check(result.score == MATE_SCORE - 1, "parallel search finds mate in one");
+}
+
 int main() {
     Board board = Board();
     board.print_board();
     board.push(move_from_uci(std::unique_ptr<std::string>(new std::string("e2e4"))));
     board.print_board();
-    return 0;
-}
 
+    test_uci();
+    test_push_pop();
+    test_packed_moves();
+    test_move_generation();
+    test_fen();
+    test_fen_parser();
+    test_game_file();
+    test_pgn();
+    test_perft_suite();
+    test_zobrist();
+    test_transposition_table();
+    test_state_adapter();
+    test_evaluation();
+    test_nnue();
+    test_batch();
+    test_game_end();
+    test_copy_make();
+    test_tablebase();
+    test_profile();
+    test_search();
 
+    if (failures) {
+        std::cout << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "all checks passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,115 @@
+#include "thread_pool.h"
+
+// lets submit() find the queue of the worker it is called from
+static thread_local const ThreadPool *current_pool = nullptr;
+static thread_local int current_worker = -1;
+
+ThreadPool::ThreadPool(int thread_count) {
+    int i;
+
+    if (thread_count <= 0) {
+        thread_count = (int) std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (i = 0; i < thread_count; i++) {
+        queues.push_back(std::make_unique<WorkQueue>());
+    }
+    for (i = 0; i < thread_count; i++) {
+        threads.emplace_back(&ThreadPool::run, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(state_lock);
+        stopping = true;
+    }
+    work_available.notify_all();
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+}
+
+void ThreadPool::submit(Task task) {
+    int worker = current_pool == this ? current_worker : (int) (next_queue++ % queues.size());
+
+    unfinished++;
+    {
+        std::lock_guard<std::mutex> guard(queues[worker]->lock);
+        queues[worker]->tasks.push_back(std::move(task));
+    }
+    queued++;
+    // taking the state lock orders this against a worker that has just checked queued and is about to sleep
+    {
+        std::lock_guard<std::mutex> guard(state_lock);
+    }
+    work_available.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(state_lock);
+    all_done.wait(lock, [this] { return unfinished == 0; });
+}
+
+int ThreadPool::size() const {
+    return (int) threads.size();
+}
+
+int ThreadPool::idle_workers() const {
+    return idle;
+}
+
+uint64_t ThreadPool::steals(int worker) const {
+    return queues[worker]->steals;
+}
+
+bool ThreadPool::take(int worker, Task &task) {
+    int i, victim, count = (int) queues.size();
+
+    {
+        std::lock_guard<std::mutex> guard(queues[worker]->lock);
+        if (!queues[worker]->tasks.empty()) {
+            task = std::move(queues[worker]->tasks.back());
+            queues[worker]->tasks.pop_back();
+            queued--;
+            return true;
+        }
+    }
+    for (i = 1; i < count; i++) {
+        victim = (worker + i) % count;
+        std::lock_guard<std::mutex> guard(queues[victim]->lock);
+        if (!queues[victim]->tasks.empty()) {
+            task = std::move(queues[victim]->tasks.front());
+            queues[victim]->tasks.pop_front();
+            queued--;
+            queues[worker]->steals++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::run(int worker) {
+    Task task;
+
+    current_pool = this;
+    current_worker = worker;
+    while (true) {
+        if (take(worker, task)) {
+            task(worker);
+            task = nullptr;
+            if (--unfinished == 0) {
+                std::lock_guard<std::mutex> guard(state_lock);
+                all_done.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(state_lock);
+        idle++;
+        work_available.wait(lock, [this] { return stopping || queued > 0; });
+        idle--;
+        if (stopping && queued == 0) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef CPP_CHESS_THREAD_POOL_H
+#define CPP_CHESS_THREAD_POOL_H
+
+// fixed set of workers, each with its own task deque. a worker takes its newest task first and steals the oldest
+// task of another worker once its own deque is empty, so big subtrees get split up where the work actually is
+class ThreadPool {
+public:
+    // tasks get the index of the worker running them, so per-thread state can live in plain arrays
+    typedef std::function<void(int)> Task;
+
+    // 0 threads means one per hardware thread
+    explicit ThreadPool(int thread_count = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // tasks submitted from inside a task go to the current worker's deque, others are spread round robin
+    void submit(Task task);
+    // blocks until every submitted task (including the ones they submitted) has finished
+    void wait();
+    int size() const;
+    int idle_workers() const;
+    uint64_t steals(int worker) const;
+
+private:
+    struct WorkQueue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+        uint64_t steals = 0;
+    };
+
+    bool take(int worker, Task &task);
+    void run(int worker);
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::thread> threads;
+    std::mutex state_lock;
+    std::condition_variable work_available;
+    std::condition_variable all_done;
+    std::atomic<int> queued {0};
+    std::atomic<int> unfinished {0};
+    std::atomic<int> idle {0};
+    std::atomic<unsigned> next_queue {0};
+    bool stopping = false;
+};
+
+#endif //CPP_CHESS_THREAD_POOL_H
@@ -0,0 +1,243 @@
+#include "tt.h"
+#include "profile.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <string>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+static uint64_t entry_depth(uint64_t data) {
+    return data & 0xFF;
+}
+
+static uint64_t entry_generation(uint64_t data) {
+    return (data >> 8) & 0x3F;
+}
+
+TranspositionTable::TranspositionTable(size_t megabytes, bool huge_pages) {
+    resize(megabytes, huge_pages);
+}
+
+TranspositionTable::~TranspositionTable() {
+    release();
+}
+
+void TranspositionTable::release() {
+    if (!buckets) {
+        return;
+    }
+#ifdef __linux__
+    if (mapped) {
+        munmap(buckets, allocated_bytes);
+    } else {
+        free(buckets);
+    }
+#else
+    free(buckets);
+#endif
+    buckets = nullptr;
+    bucket_count = 0;
+    allocated_bytes = 0;
+}
+
+void TranspositionTable::resize(size_t megabytes, bool huge_pages) {
+    void *memory = nullptr;
+
+    release();
+    bucket_count = std::max<size_t>(1, megabytes * 1024 * 1024 / sizeof(Bucket));
+    allocated_bytes = bucket_count * sizeof(Bucket);
+    hugetlb = false;
+    mapped = false;
+
+#ifdef __linux__
+    if (huge_pages) {
+        // explicit huge pages first (needs vm.nr_hugepages), then transparent huge pages on an aligned mapping
+        allocated_bytes = (allocated_bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+        memory = mmap(nullptr, allocated_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (memory == MAP_FAILED) {
+            memory = mmap(nullptr, allocated_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (memory == MAP_FAILED) {
+                memory = nullptr;
+            } else {
+                // only a hint, huge_page_bytes finds out whether the kernel took it
+                madvise(memory, allocated_bytes, MADV_HUGEPAGE);
+            }
+        } else {
+            hugetlb = true;
+        }
+        mapped = memory != nullptr;
+    }
+#endif
+    if (!memory) {
+        allocated_bytes = bucket_count * sizeof(Bucket);
+        memory = aligned_alloc(alignof(Bucket), allocated_bytes);
+        if (!memory) {
+            throw std::bad_alloc();
+        }
+    }
+    buckets = static_cast<Bucket *>(memory);
+    clear();
+}
+
+void TranspositionTable::clear() {
+    size_t i;
+    int j;
+
+    for (i = 0; i < bucket_count; i++) {
+        for (j = 0; j < ENTRIES_PER_BUCKET; j++) {
+            buckets[i].entries[j].check.store(0, std::memory_order_relaxed);
+            buckets[i].entries[j].data.store(0, std::memory_order_relaxed);
+        }
+    }
+    generation = 0;
+    reset_stats();
+}
+
+void TranspositionTable::new_generation() {
+    generation = (uint8_t) ((generation + 1) & MAX_GENERATION);
+}
+
+TranspositionTable::Bucket *TranspositionTable::bucket_for(uint64_t key) const {
+    // multiply-high maps the key onto any bucket count, not just powers of two
+    return &buckets[(size_t) (((unsigned __int128) key * bucket_count) >> 64)];
+}
+
+TranspositionTable::Counters &TranspositionTable::counters() {
+    static std::atomic<unsigned> next_shard {0};
+    static thread_local unsigned shard = next_shard++ % COUNTER_SHARDS;
+    return shards[shard];
+}
+
+bool TranspositionTable::probe(uint64_t key, TTHit &hit) {
+    PROFILE_SCOPE(TIMER_TT_PROBE);
+    Bucket *bucket = bucket_for(key);
+    Counters &count = counters();
+    uint64_t data;
+    int i;
+
+    count.probes.fetch_add(1, std::memory_order_relaxed);
+    for (i = 0; i < ENTRIES_PER_BUCKET; i++) {
+        data = bucket->entries[i].data.load(std::memory_order_relaxed);
+        if ((bucket->entries[i].check.load(std::memory_order_relaxed) ^ data) == key && data) {
+            hit.payload = data >> 16;
+            hit.depth = (int) entry_depth(data);
+            hit.flags = (int) ((data >> 14) & 3);
+            count.hits.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void TranspositionTable::store(uint64_t key, int depth, int flags, uint64_t payload) {
+    Bucket *bucket = bucket_for(key);
+    Counters &count = counters();
+    uint64_t data, old, victim_data = 0;
+    int i, victim = 0, worth, victim_worth = 1 << 30, age;
+
+    data = (uint64_t) (depth & 0xFF) | ((uint64_t) generation << 8) | ((uint64_t) (flags & 3) << 14) | (payload << 16);
+    for (i = 0; i < ENTRIES_PER_BUCKET; i++) {
+        old = bucket->entries[i].data.load(std::memory_order_relaxed);
+        if ((bucket->entries[i].check.load(std::memory_order_relaxed) ^ old) == key || !old) {
+            victim = i;
+            victim_data = old;
+            break;
+        }
+        // shallow entries and entries from old generations are worth the least
+        age = (int) ((generation - entry_generation(old)) & MAX_GENERATION);
+        worth = (int) entry_depth(old) - 8 * age;
+        if (worth < victim_worth) {
+            victim = i;
+            victim_worth = worth;
+            victim_data = old;
+        }
+    }
+
+    if (victim_data && i == ENTRIES_PER_BUCKET && entry_generation(victim_data) == generation) {
+        count.collisions.fetch_add(1, std::memory_order_relaxed);
+    }
+    count.stores.fetch_add(1, std::memory_order_relaxed);
+    bucket->entries[victim].check.store(key ^ data, std::memory_order_relaxed);
+    bucket->entries[victim].data.store(data, std::memory_order_relaxed);
+}
+
+size_t TranspositionTable::size_bytes() const {
+    return bucket_count * sizeof(Bucket);
+}
+
+size_t TranspositionTable::entry_count() const {
+    return bucket_count * ENTRIES_PER_BUCKET;
+}
+
+size_t TranspositionTable::huge_page_bytes() const {
+#ifdef __linux__
+    std::ifstream smaps;
+    std::string line;
+    unsigned long start, end, begin = (unsigned long) buckets, kilobytes;
+    size_t bytes = 0;
+    bool inside = false;
+
+    if (!mapped) {
+        return 0;
+    }
+    if (hugetlb) {
+        return allocated_bytes;
+    }
+    // the mapping may have been split up, every piece of it has a header line "start-end perms ..." of its own
+    smaps.open("/proc/self/smaps");
+    while (std::getline(smaps, line)) {
+        if (sscanf(line.c_str(), "%lx-%lx ", &start, &end) == 2) {
+            inside = start >= begin && end <= begin + allocated_bytes;
+        } else if (inside && sscanf(line.c_str(), "AnonHugePages: %lu kB", &kilobytes) == 1) {
+            bytes += kilobytes * 1024;
+        }
+    }
+    return bytes;
+#else
+    return 0;
+#endif
+}
+
+int TranspositionTable::hashfull() const {
+    size_t i, buckets_sampled = std::min<size_t>(bucket_count, 1000 / ENTRIES_PER_BUCKET);
+    int j, used = 0;
+    uint64_t data;
+
+    for (i = 0; i < buckets_sampled; i++) {
+        for (j = 0; j < ENTRIES_PER_BUCKET; j++) {
+            data = buckets[i].entries[j].data.load(std::memory_order_relaxed);
+            used += data && entry_generation(data) == generation;
+        }
+    }
+    return (int) (used * 1000 / (buckets_sampled * ENTRIES_PER_BUCKET));
+}
+
+TTStats TranspositionTable::stats() const {
+    TTStats total {0, 0, 0, 0, 0};
+
+    for (const Counters &shard : shards) {
+        total.probes += shard.probes.load(std::memory_order_relaxed);
+        total.hits += shard.hits.load(std::memory_order_relaxed);
+        total.stores += shard.stores.load(std::memory_order_relaxed);
+        total.collisions += shard.collisions.load(std::memory_order_relaxed);
+    }
+    total.misses = total.probes - total.hits;
+    return total;
+}
+
+void TranspositionTable::reset_stats() {
+    for (Counters &shard : shards) {
+        shard.probes.store(0, std::memory_order_relaxed);
+        shard.hits.store(0, std::memory_order_relaxed);
+        shard.stores.store(0, std::memory_order_relaxed);
+        shard.collisions.store(0, std::memory_order_relaxed);
+    }
+}
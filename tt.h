@@ -0,0 +1,93 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#ifndef CPP_CHESS_TT_H
+#define CPP_CHESS_TT_H
+
+// what a probe found. payload is whatever the caller stored (48 bits), flags are its two spare bits
+struct TTHit {
+    uint64_t payload;
+    int depth;
+    int flags;
+};
+
+struct TTStats {
+    uint64_t probes;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t stores;
+    // stores that had to throw out another position's entry from the current generation
+    uint64_t collisions;
+};
+
+// fixed size hash table shared by any number of threads without locks. every entry is two 64 bit words, the key
+// is stored xor'ed with the data word, so an entry torn by two racing writers simply fails to validate.
+// the data word is laid out as: bits 0-7 depth, bits 8-13 generation, bits 14-15 flags, bits 16-63 payload
+class TranspositionTable {
+public:
+    static const int ENTRIES_PER_BUCKET = 4;
+    static const int MAX_GENERATION = 63;
+
+    // huge_pages asks the kernel to back the table with 2MB pages where it can
+    explicit TranspositionTable(size_t megabytes = 16, bool huge_pages = false);
+    ~TranspositionTable();
+    TranspositionTable(const TranspositionTable &) = delete;
+    TranspositionTable &operator=(const TranspositionTable &) = delete;
+
+    // reallocates (and clears) the table, not safe while other threads are using it
+    void resize(size_t megabytes, bool huge_pages = false);
+    void clear();
+    // entries from older generations are replaced first, call once per search
+    void new_generation();
+
+    bool probe(uint64_t key, TTHit &hit);
+    void store(uint64_t key, int depth, int flags, uint64_t payload);
+
+    size_t size_bytes() const;
+    size_t entry_count() const;
+    // how much of the table the kernel actually backs with huge pages, not just whether they were asked for
+    size_t huge_page_bytes() const;
+    // per mille of the first thousand buckets' entries that belong to the current generation
+    int hashfull() const;
+    TTStats stats() const;
+    void reset_stats();
+
+private:
+    struct Entry {
+        std::atomic<uint64_t> check;
+        std::atomic<uint64_t> data;
+    };
+
+    // one bucket per cache line, so a probe touches a single line
+    struct alignas(64) Bucket {
+        std::array<Entry, ENTRIES_PER_BUCKET> entries;
+    };
+
+    // statistics are sharded by thread so that counting doesn't put every thread on the same cache line
+    struct alignas(64) Counters {
+        std::atomic<uint64_t> probes {0};
+        std::atomic<uint64_t> hits {0};
+        std::atomic<uint64_t> stores {0};
+        std::atomic<uint64_t> collisions {0};
+    };
+    static const int COUNTER_SHARDS = 64;
+
+    Bucket *bucket_for(uint64_t key) const;
+    Counters &counters();
+    void release();
+
+    Bucket *buckets = nullptr;
+    size_t bucket_count = 0;
+    size_t allocated_bytes = 0;
+    // explicit huge pages (MAP_HUGETLB), the transparent kind are looked up in /proc when asked for
+    bool hugetlb = false;
+    bool mapped = false;
+    uint8_t generation = 0;
+    std::array<Counters, COUNTER_SHARDS> shards;
+};
+
+#endif //CPP_CHESS_TT_H
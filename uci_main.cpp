@@ -0,0 +1,354 @@
+//
+// UCI front end. stdin is read on the main thread, the search runs on a thread of its own and everything printed
+// goes through a writer thread, so isready and stop are answered mid-search and nobody waits on a slow pipe.
+//
+// usage: uci        (then speak UCI on stdin/stdout)
+//
+
+#include "chess.h"
+#include "nnue.h"
+#include "search.h"
+#include "tablebase.h"
+
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unistd.h>
+
+// lines queued by any thread are written out by one writer thread, batched into as few write() calls as possible
+class Output {
+public:
+    Output() : writer(&Output::run, this) {}
+
+    // flushes whatever is still queued
+    ~Output() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        ready.notify_one();
+        writer.join();
+    }
+
+    void send(std::string_view line) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            pending.append(line);
+            pending.push_back('\n');
+        }
+        ready.notify_one();
+    }
+
+private:
+    void run() {
+        std::string writing;
+        size_t done;
+        ssize_t written;
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                ready.wait(guard, [this] { return stopping || !pending.empty(); });
+                if (pending.empty()) {
+                    return;
+                }
+                writing.swap(pending);
+            }
+            for (done = 0; done < writing.size(); done += written) {
+                written = write(STDOUT_FILENO, writing.data() + done, writing.size() - done);
+                if (written < 0) {
+                    if (errno != EINTR) {
+                        break;
+                    }
+                    written = 0;
+                }
+            }
+            writing.clear();
+        }
+    }
+
+    std::mutex lock;
+    std::condition_variable ready;
+    std::string pending;
+    bool stopping = false;
+    std::thread writer;
+};
+
+// owns the search thread, which sleeps between searches so a "go" doesn't pay for starting a thread
+class Searcher {
+public:
+    explicit Searcher(Output &output) : output(output), table(16), search(table), thread(&Searcher::run, this) {}
+
+    ~Searcher() {
+        stop();
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            quitting = true;
+        }
+        changed.notify_all();
+        thread.join();
+    }
+
+    // a search still running is stopped first, its bestmove is printed before the new search starts
+    void start(const Board &new_board, const SearchLimits &new_limits) {
+        stop();
+        wait();
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            board = new_board;
+            limits = new_limits;
+            stop_requested = false;
+            searching = true;
+        }
+        changed.notify_all();
+    }
+
+    // returns at once, the search notices the flag within a few nodes
+    void stop() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stop_requested = true;
+        }
+        search.stop();
+        changed.notify_all();
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [this] { return !searching; });
+    }
+
+    // only between searches
+    void new_game() {
+        wait();
+        table.clear();
+        search.clear();
+    }
+
+    void set_hash(size_t megabytes) {
+        wait();
+        table.resize(std::max<size_t>(megabytes, 1));
+    }
+
+    void set_threads(int count) {
+        wait();
+        search.set_threads(count);
+    }
+
+    // an empty path (or "<empty>") goes back to the hand written evaluation, so does a file that won't load
+    bool set_eval_file(const std::string &path) {
+        bool loaded;
+
+        wait();
+        search.set_network(nullptr);
+        loaded = !path.empty() && path != "<empty>" && network.load(path);
+        search.set_network(loaded ? &network : nullptr);
+        return loaded;
+    }
+
+    // every table of the directory, an empty path (or "<empty>") turns probing off. returns how many tables were found
+    int set_tablebase_path(const std::string &path) {
+        int found;
+
+        wait();
+        search.set_tablebases(nullptr);
+        tablebases.close();
+        found = !path.empty() && path != "<empty>" ? tablebases.open(path) : 0;
+        search.set_tablebases(found ? &tablebases : nullptr);
+        return found;
+    }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> guard(lock);
+
+        while (true) {
+            // a search that was started still gets its bestmove out, even if quit came right after go
+            changed.wait(guard, [this] { return quitting || searching; });
+            if (!searching) {
+                return;
+            }
+            guard.unlock();
+            search_position();
+            guard.lock();
+            searching = false;
+            changed.notify_all();
+        }
+    }
+
+    void search_position() {
+        SearchResult result;
+        char uci[6] = "0000";
+
+        result = search.run(board, limits, [this](const SearchInfo &info) { send_info(info); });
+        // UCI doesn't allow the bestmove of an infinite search before the GUI says stop
+        if (limits.infinite) {
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [this] { return stop_requested.load(); });
+        }
+        if (result.best_move != NULL_MOVE) {
+            format_uci(result.best_move, uci);
+        }
+        output.send(std::string("bestmove ") + uci);
+    }
+
+    void send_info(const SearchInfo &info) {
+        std::string line;
+        char uci[6];
+        int i;
+
+        line = "info depth " + std::to_string(info.depth) + " seldepth " + std::to_string(info.seldepth) + " score " +
+               format_score(info.score) + " nodes " + std::to_string(info.nodes) + " nps " +
+               std::to_string((uint64_t) (info.nodes / std::max(info.seconds, 1e-6))) + " tbhits " +
+               std::to_string(info.tb_hits) + " hashfull " + std::to_string(info.hashfull) + " time " +
+               std::to_string((int64_t) (info.seconds * 1000)) + " pv";
+        for (i = 0; i < info.pv_length; i++) {
+            format_uci(info.pv[i], uci);
+            line.push_back(' ');
+            line += uci;
+        }
+        output.send(line);
+    }
+
+    Output &output;
+    std::mutex lock;
+    std::condition_variable changed;
+    TranspositionTable table;
+    Network network;
+    Tablebases tablebases;
+    Search search;
+    Board board;
+    SearchLimits limits;
+    bool searching = false;
+    bool quitting = false;
+    std::atomic<bool> stop_requested {false};
+    std::thread thread;
+};
+
+static int64_t to_number(std::string_view token) {
+    int64_t value = 0;
+    bool negative = !token.empty() && token[0] == '-';
+    size_t i;
+
+    for (i = negative; i < token.size() && '0' <= token[i] && token[i] <= '9'; i++) {
+        value = value * 10 + (token[i] - '0');
+    }
+    return negative ? -value : value;
+}
+
+// position [startpos | fen FEN] [moves m1 m2 ...], anything malformed leaves the start position
+static void set_position(Board &board, std::string_view rest) {
+    std::string_view token = next_token(rest), fen;
+    size_t moves;
+
+    if (token == "fen") {
+        moves = rest.find(" moves");
+        fen = rest.substr(0, moves);
+        rest = moves == std::string_view::npos ? std::string_view() : rest.substr(moves);
+        if (!board.set_fen(fen.substr(std::min(fen.find_first_not_of(' '), fen.size())))) {
+            board.reset();
+        }
+    } else {
+        board.reset();
+    }
+
+    if (next_token(rest) != "moves") {
+        return;
+    }
+    for (token = next_token(rest); !token.empty(); token = next_token(rest)) {
+        if (!board.push_uci(token)) {
+            break;
+        }
+    }
+}
+
+static SearchLimits parse_go(std::string_view rest) {
+    SearchLimits limits;
+    std::string_view token;
+
+    for (token = next_token(rest); !token.empty(); token = next_token(rest)) {
+        if (token == "infinite") limits.infinite = true;
+        else if (token == "depth") limits.depth = (int) to_number(next_token(rest));
+        else if (token == "nodes") limits.nodes = (uint64_t) to_number(next_token(rest));
+        else if (token == "movetime") limits.movetime = to_number(next_token(rest));
+        else if (token == "wtime") limits.time[WHITE] = to_number(next_token(rest));
+        else if (token == "btime") limits.time[BLACK] = to_number(next_token(rest));
+        else if (token == "winc") limits.increment[WHITE] = to_number(next_token(rest));
+        else if (token == "binc") limits.increment[BLACK] = to_number(next_token(rest));
+        else if (token == "movestogo") limits.movestogo = (int) to_number(next_token(rest));
+    }
+    return limits;
+}
+
+static const int MAX_THREADS = 512;
+
+// setoption name NAME [value VALUE], unknown options are ignored
+static void set_option(Searcher &searcher, Output &output, std::string_view rest) {
+    std::string_view name, value;
+    size_t start;
+
+    if (next_token(rest) != "name") {
+        return;
+    }
+    name = next_token(rest);
+    if (next_token(rest) == "value") {
+        // the value is the rest of the line, file names may contain spaces
+        start = rest.find_first_not_of(" \t");
+        value = start == std::string_view::npos ? std::string_view() : rest.substr(start);
+        value = value.substr(0, value.find_last_not_of(" \t\r") + 1);
+    }
+    if (name == "Hash") {
+        searcher.set_hash((size_t) to_number(value));
+    } else if (name == "Threads") {
+        searcher.set_threads((int) std::min<int64_t>(std::max<int64_t>(to_number(value), 1), MAX_THREADS));
+    } else if (name == "EvalFile") {
+        if (!searcher.set_eval_file(std::string(value)) && !value.empty() && value != "<empty>") {
+            output.send("info string EvalFile " + std::string(value) + " not loaded, using the classical evaluation");
+        }
+    } else if (name == "TablebasePath") {
+        if (!searcher.set_tablebase_path(std::string(value)) && !value.empty() && value != "<empty>") {
+            output.send("info string TablebasePath " + std::string(value) + " has no tables");
+        }
+    }
+}
+
+int main() {
+    Output output;
+    Searcher searcher(output);
+    Board board = Board();
+    std::string line;
+    std::string_view rest, command;
+
+    std::ios::sync_with_stdio(false);
+    while (std::getline(std::cin, line)) {
+        rest = line;
+        command = next_token(rest);
+        if (command == "uci") {
+            output.send("id name cpp_chess\nid author the cpp_chess authors\noption name Hash type spin default 16 min 1 max 65536\n"
+                        "option name Threads type spin default 1 min 1 max 512\noption name EvalFile type string default <empty>\n"
+                        "option name TablebasePath type string default <empty>\nuciok");
+        } else if (command == "isready") {
+            output.send("readyok");
+        } else if (command == "setoption") {
+            set_option(searcher, output, rest);
+        } else if (command == "ucinewgame") {
+            searcher.new_game();
+            board.reset();
+        } else if (command == "position") {
+            set_position(board, rest);
+        } else if (command == "go") {
+            searcher.start(board, parse_go(rest));
+        } else if (command == "stop") {
+            searcher.stop();
+        } else if (command == "quit") {
+            break;
+        }
+    }
+    // the searcher's destructor stops and joins the search, then the output drains
+    return 0;
+}